@@ -0,0 +1,87 @@
+#ifndef ARKANOID_H
+#define ARKANOID_H
+
+// API C del gioco "headless" di `p16.cpp` e dei segmenti
+// successivi, per usarlo da altri linguaggi (ad esempio per
+// addestrare dei bot). Si ottiene compilando uno di questi file con
+// `-DARKANOID_LIBRARY`, ad esempio come libreria condivisa
+// (`-shared -fPIC`).
+//
+// Un `ArkanoidEnv` contiene un gruppo di partite indipendenti, e ogni
+// funzione opera su tutte insieme. Dopo `arkanoid_create` e
+// `arkanoid_reset`, `arkanoid_step` e `arkanoid_observe` non
+// allocano memoria.
+//
+// Le osservazioni vengono scritte in buffer forniti dal chiamante. Per
+// ogni partita vengono scritti `ARKANOID_STATE_SIZE` float (vedi
+// `ArkanoidState`) e `arkanoid_grid_size` byte con i colpi rimanenti
+// di ogni mattoncino.
+//
+// Le funzioni restituiscono `NULL` o un valore negativo in caso di
+// errore, anche quando ricevono un `ArkanoidEnv` o un buffer nullo;
+// `arkanoid_env_count` e `arkanoid_grid_size` restituiscono zero.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct ArkanoidEnv ArkanoidEnv;
+
+    // Azioni del paddle, una per partita, passate a `arkanoid_step`.
+    enum ArkanoidAction
+    {
+        ARKANOID_NONE = 0,
+        ARKANOID_LEFT = 1,
+        ARKANOID_RIGHT = 2
+    };
+
+    // Indici dei valori scritti da `arkanoid_observe` per ogni partita.
+    enum ArkanoidState
+    {
+        ARKANOID_BALL_X,
+        ARKANOID_BALL_Y,
+        ARKANOID_BALL_VX,
+        ARKANOID_BALL_VY,
+        ARKANOID_BALL_COUNT,
+        ARKANOID_PADDLE_X,
+        ARKANOID_PADDLE_Y,
+        ARKANOID_LIVES,
+        ARKANOID_SCORE,
+        ARKANOID_STATUS,
+        ARKANOID_STATE_SIZE
+    };
+
+    // Crea `mCount` partite su livelli procedurali. `mPattern` è un
+    // indice in `solid`, `checker`, `stripes`, `diamond`, `random`;
+    // larghezza e altezza della griglia devono essere positive, e la
+    // densità (la probabilità che una cella sia occupata) compresa
+    // tra 0 e 1.
+    ArkanoidEnv* arkanoid_create(size_t mCount, int mPattern,
+        uint32_t mWidth, uint32_t mHeight, float mDensity);
+    void arkanoid_destroy(ArkanoidEnv* mEnv);
+
+    size_t arkanoid_env_count(const ArkanoidEnv* mEnv);
+    size_t arkanoid_grid_size(const ArkanoidEnv* mEnv);
+
+    // Ricomincia ogni partita con il suo seme (`mSeeds` contiene un
+    // seme per partita).
+    int arkanoid_reset(ArkanoidEnv* mEnv, const uint64_t* mSeeds);
+
+    // Avanza di un tick le partite in corso, con un'azione per partita.
+    // Restituisce quante partite sono ancora in corso.
+    long long arkanoid_step(ArkanoidEnv* mEnv, const uint8_t* mActions);
+
+    // `mStates` deve contenere `ARKANOID_STATE_SIZE` float per partita;
+    // `mGrids`, se non nullo, `arkanoid_grid_size` byte per partita.
+    int arkanoid_observe(
+        const ArkanoidEnv* mEnv, float* mStates, uint8_t* mGrids);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1658 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: MIT License | http://opensource.org/licenses/MIT
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+// In questo segmento di codice aggiungeremo qualche feature
+// al nostro gioco:
+// * Testi dell'interfaccia rigenerati solo quando cambiano
+// * Caricamento asincrono delle risorse
+// * Pre-rasterizzazione dei glifi usati dall'interfaccia
+
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <typeinfo>
+#include <map>
+#include <set>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <string>
+#include <SFML/Graphics.hpp>
+
+template <typename T>
+auto getLength(const T& mVec) noexcept
+{
+    return std::sqrt(std::pow(mVec.x, 2) + std::pow(mVec.y, 2));
+}
+
+template <typename T>
+auto getNormalized(const sf::Vector2<T>& mVec) noexcept
+{
+    return mVec / static_cast<T>(getLength(mVec));
+}
+
+template <typename T1, typename T2>
+auto getDotProduct(const T1& mVec1, const T2& mVec2)
+{
+    return mVec1.x * mVec2.x + mVec1.y * mVec2.y;
+}
+
+template <typename T1, typename T2>
+auto getReflected(const T1& mVec, const T2& mNormal)
+{
+    return mVec - (mNormal * (2.f * getDotProduct(mVec, mNormal)));
+}
+
+template <typename T1, typename T2>
+bool isIntersecting(const T1& mA, const T2& mB) noexcept
+{
+    return mA.right() >= mB.left() && mA.left() <= mB.right() &&
+           mA.bottom() >= mB.top() && mA.top() <= mB.bottom();
+}
+
+constexpr unsigned int wndWidth{800}, wndHeight{600};
+
+// Un semplice thread pool "work stealing": ogni worker ha la sua
+// coda di job, da cui preleva in ordine LIFO. Un worker senza lavoro
+// "ruba" dalla testa delle code degli altri worker.
+class ThreadPool
+{
+public:
+    // Un job è un riferimento non proprietario ad un oggetto
+    // invocabile: chi lo accoda deve mantenere in vita l'oggetto
+    // finché il job non è stato eseguito. In questo modo accodare un
+    // job non alloca memoria.
+    struct Job
+    {
+        void (*func)(void*);
+        void* context;
+
+        void operator()() const { func(context); }
+    };
+
+    template <typename T>
+    static Job makeJob(T& mCallable) noexcept
+    {
+        return {[](void* mContext)
+            {
+                (*static_cast<T*>(mContext))();
+            },
+            &mCallable};
+    }
+
+private:
+    // Le code hanno una capacità fissa, allocata una volta sola: se
+    // una coda è piena, `submit` esegue il job immediatamente.
+    static constexpr std::size_t queueCapacity{1024};
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::array<Job, queueCapacity> jobs;
+        std::size_t head{0}, count{0};
+    };
+
+    // Stato condiviso dai job di una chiamata a `parallelFor`: ogni
+    // job prende il primo blocco non ancora assegnato. Vive sullo
+    // stack del chiamante, che ne attende il completamento.
+    template <typename TFunc>
+    struct ForContext
+    {
+        TFunc& func;
+        std::size_t count, grain;
+
+        std::atomic<std::size_t> next{0}, remaining;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        ForContext(TFunc& mFunc, std::size_t mCount, std::size_t mGrain,
+            std::size_t mChunkCount)
+            : func{mFunc}, count{mCount}, grain{mGrain},
+              remaining{mChunkCount}
+        {
+        }
+
+        void operator()()
+        {
+            auto begin(next++ * grain);
+            auto end(std::min(count, begin + grain));
+
+            try
+            {
+                func(begin, end);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock{errorMutex};
+                if(!error) error = std::current_exception();
+            }
+
+            // Dopo il decremento il chiamante può distruggere il
+            // contesto: non va più toccato.
+            --remaining;
+        }
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::atomic<bool> running{true};
+    std::atomic<std::size_t> pending{0}, nextQueue{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+
+    // Ogni thread sa se è un worker, e di quale pool.
+    static thread_local ThreadPool* currentPool;
+    static thread_local std::size_t currentIdx;
+
+    bool tryPop(std::size_t mIdx, Job& mJob, bool mFromBack)
+    {
+        auto& queue(*queues[mIdx]);
+        std::lock_guard<std::mutex> lock{queue.mutex};
+
+        if(queue.count == 0) return false;
+
+        if(mFromBack)
+            mJob = queue.jobs[(queue.head + queue.count - 1) % queueCapacity];
+        else
+        {
+            mJob = queue.jobs[queue.head];
+            queue.head = (queue.head + 1) % queueCapacity;
+        }
+
+        --queue.count;
+        --pending;
+        return true;
+    }
+
+    void workerLoop(std::size_t mIdx)
+    {
+        currentPool = this;
+        currentIdx = mIdx;
+
+        while(running)
+        {
+            if(runOne()) continue;
+
+            std::unique_lock<std::mutex> lock{sleepMutex};
+            sleepCv.wait(lock, [this]
+                {
+                    return !running || pending > 0;
+                });
+        }
+    }
+
+public:
+    ThreadPool(std::size_t mThreadCount = std::max(
+                   1u, std::thread::hardware_concurrency()) - 1)
+    {
+        // Anche i thread esterni possono accodare job: usiamo almeno
+        // una coda anche se non ci sono worker.
+        auto queueCount(std::max<std::size_t>(1, mThreadCount));
+        for(std::size_t i{0}; i < queueCount; ++i)
+            queues.emplace_back(std::make_unique<Queue>());
+
+        for(std::size_t i{0}; i < mThreadCount; ++i)
+            threads.emplace_back([this, i]
+                {
+                    workerLoop(i);
+                });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{sleepMutex};
+            running = false;
+        }
+
+        sleepCv.notify_all();
+        for(auto& t : threads) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    auto getThreadCount() const noexcept { return threads.size(); }
+
+    // I job che lanciano eccezioni terminano il programma: usare
+    // `parallelFor` per propagarle al chiamante.
+    void submit(Job mJob)
+    {
+        auto idx(currentPool == this ? currentIdx
+                                     : nextQueue++ % queues.size());
+
+        {
+            auto& queue(*queues[idx]);
+            std::unique_lock<std::mutex> lock{queue.mutex};
+            if(queue.count == queueCapacity)
+            {
+                lock.unlock();
+                mJob();
+                return;
+            }
+
+            queue.jobs[(queue.head + queue.count) % queueCapacity] = mJob;
+            ++queue.count;
+            ++pending;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{sleepMutex};
+        }
+        sleepCv.notify_one();
+    }
+
+    // Esegue un job disponibile, se c'è: prima dalla coda del thread
+    // corrente, poi rubandolo dalle altre code.
+    bool runOne()
+    {
+        Job job;
+        auto own(currentPool == this);
+        auto start(own ? currentIdx : 0);
+
+        if(own && tryPop(start, job, true))
+        {
+            job();
+            return true;
+        }
+
+        for(std::size_t i{0}; i < queues.size(); ++i)
+        {
+            auto idx((start + i) % queues.size());
+            if((own && idx == start) || !tryPop(idx, job, false)) continue;
+
+            job();
+            return true;
+        }
+
+        return false;
+    }
+
+    // Divide `[0, mCount)` in blocchi di `mGrain` elementi e chiama
+    // `mFunc(begin, end)` su ognuno. Il thread chiamante partecipa
+    // al lavoro finché tutti i blocchi non sono completati.
+    template <typename TFunc>
+    void parallelFor(std::size_t mCount, std::size_t mGrain, TFunc&& mFunc)
+    {
+        mGrain = std::max<std::size_t>(1, mGrain);
+        auto chunkCount((mCount + mGrain - 1) / mGrain);
+
+        if(chunkCount <= 1 || threads.empty())
+        {
+            if(mCount > 0) mFunc(std::size_t(0), mCount);
+            return;
+        }
+
+        ForContext<std::remove_reference_t<TFunc>> context{
+            mFunc, mCount, mGrain, chunkCount};
+
+        auto job(makeJob(context));
+        for(std::size_t i{0}; i < chunkCount; ++i) submit(job);
+
+        while(context.remaining > 0)
+            if(!runOne()) std::this_thread::yield();
+
+        if(context.error) std::rethrow_exception(context.error);
+    }
+};
+
+thread_local ThreadPool* ThreadPool::currentPool{nullptr};
+thread_local std::size_t ThreadPool::currentIdx{0};
+
+// Un `TaskGraph` descrive il lavoro di un frame come un insieme di
+// task con dipendenze. Ogni task ha un contatore delle dipendenze
+// non ancora completate: quando arriva a zero, il task viene
+// accodato sul thread pool. I task marcati "main thread" (ad esempio
+// il rendering) vengono eseguiti solo dal thread che chiama `run`.
+class TaskGraph
+{
+public:
+    using TaskId = std::size_t;
+
+private:
+    // Oggetto invocabile accodato sul thread pool quando un task è
+    // pronto: vive nel task, quindi accodarlo non alloca memoria.
+    struct Launcher
+    {
+        TaskGraph* graph;
+        TaskId id;
+
+        void operator()() const { graph->execute(*graph->pool, id); }
+    };
+
+    // Ogni task possiede il suo oggetto invocabile, e lo esegue
+    // tramite un `ThreadPool::Job` che vi punta.
+    struct Task
+    {
+        const char* name;
+        ThreadPool::Job job;
+        bool mainThread;
+        Launcher launcher;
+
+        std::vector<TaskId> dependents;
+        std::size_t dependencyCount{0};
+        std::atomic<std::size_t> remaining{0};
+
+        virtual ~Task() {}
+    };
+
+    template <typename TFunc>
+    struct CallableTask : Task
+    {
+        TFunc func;
+
+        CallableTask(TFunc mFunc) : func{std::move(mFunc)} {}
+    };
+
+    std::vector<std::unique_ptr<Task>> tasks;
+
+    // Stato di un'esecuzione di `run`.
+    ThreadPool* pool{nullptr};
+    std::atomic<std::size_t> unfinished{0};
+    std::mutex mainMutex;
+    std::vector<TaskId> mainReady;
+    std::exception_ptr error;
+
+    void schedule(ThreadPool& mPool, TaskId mId)
+    {
+        if(tasks[mId]->mainThread)
+        {
+            std::lock_guard<std::mutex> lock{mainMutex};
+            mainReady.emplace_back(mId);
+            return;
+        }
+
+        mPool.submit(ThreadPool::makeJob(tasks[mId]->launcher));
+    }
+
+    void execute(ThreadPool& mPool, TaskId mId)
+    {
+        auto& task(*tasks[mId]);
+
+        try
+        {
+            task.job();
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock{mainMutex};
+            if(!error) error = std::current_exception();
+        }
+
+        for(auto d : task.dependents)
+            if(--tasks[d]->remaining == 0) schedule(mPool, d);
+
+        --unfinished;
+    }
+
+    bool runMainThreadTask(ThreadPool& mPool)
+    {
+        TaskId id;
+
+        {
+            std::lock_guard<std::mutex> lock{mainMutex};
+            if(mainReady.empty()) return false;
+
+            id = mainReady.back();
+            mainReady.pop_back();
+        }
+
+        execute(mPool, id);
+        return true;
+    }
+
+public:
+    template <typename TFunc>
+    TaskId add(const char* mName, TFunc&& mFunc, bool mMainThread = false)
+    {
+        auto task(std::make_unique<CallableTask<std::decay_t<TFunc>>>(
+            std::forward<TFunc>(mFunc)));
+        task->name = mName;
+        task->job = ThreadPool::makeJob(task->func);
+        task->mainThread = mMainThread;
+        task->launcher = {this, tasks.size()};
+        tasks.emplace_back(std::move(task));
+
+        // Al più tutti i task possono essere pronti insieme: `run`
+        // non alloca mai.
+        mainReady.reserve(tasks.size());
+
+        return tasks.size() - 1;
+    }
+
+    // `mBefore` deve essere completato prima di iniziare `mAfter`.
+    void precede(TaskId mBefore, TaskId mAfter)
+    {
+        tasks[mBefore]->dependents.emplace_back(mAfter);
+        ++tasks[mAfter]->dependencyCount;
+    }
+
+    const char* getName(TaskId mId) const noexcept
+    {
+        return tasks[mId]->name;
+    }
+
+    // Esegue tutti i task rispettando le dipendenze. Il thread
+    // chiamante esegue i task "main thread" e aiuta il pool finché
+    // il grafo non è completato.
+    void run(ThreadPool& mPool)
+    {
+        pool = &mPool;
+        unfinished = tasks.size();
+        error = nullptr;
+
+        for(auto& t : tasks) t->remaining = t->dependencyCount;
+
+        for(TaskId i{0}; i < tasks.size(); ++i)
+            if(tasks[i]->dependencyCount == 0) schedule(mPool, i);
+
+        while(unfinished > 0)
+            if(!runMainThreadTask(mPool) && !mPool.runOne())
+                std::this_thread::yield();
+
+        if(error) std::rethrow_exception(error);
+    }
+};
+
+// Un tipo di entità può dichiarare che il suo `update` non ha
+// effetti su altre entità definendo `static constexpr bool
+// isolatedUpdate{true}`. Solo questi tipi vengono aggiornati in
+// parallelo dal `Manager`.
+template <typename T, typename = void>
+struct HasIsolatedUpdate : std::false_type
+{
+};
+
+template <typename T>
+struct HasIsolatedUpdate<T, std::enable_if_t<T::isolatedUpdate>>
+    : std::true_type
+{
+};
+
+class Entity
+{
+private:
+    friend class Manager;
+    bool parallelUpdate{false};
+
+public:
+    bool destroyed{false};
+
+    virtual ~Entity() {}
+    virtual void update() {}
+    virtual void draw(sf::RenderWindow& mTarget) {}
+};
+
+// Un `EntitySpan` è una "finestra" contigua su un gruppo di entità
+// dello stesso tipo. Non possiede la memoria: è valido finché il
+// gruppo non viene modificato (`create`, `refresh` o `clear`).
+template <typename T>
+class EntitySpan
+{
+private:
+    Entity* const* ptrs{nullptr};
+    std::size_t count{0};
+
+public:
+    EntitySpan() = default;
+    EntitySpan(const std::vector<Entity*>& mGroup) noexcept
+        : ptrs{mGroup.data()}, count{mGroup.size()}
+    {
+    }
+
+    auto size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+
+    T& operator[](std::size_t mI) const noexcept
+    {
+        return *static_cast<T*>(ptrs[mI]);
+    }
+};
+
+// Una `View` raggruppa due span, ottenuti una sola volta, e permette
+// di iterare su tutte le coppie `(TA, TB)`. Opzionalmente si può
+// fornire una "broadphase" che scarta a priori le coppie che non
+// possono sovrapporsi.
+template <typename TA, typename TB>
+class View
+{
+private:
+    EntitySpan<TA> spanA;
+    EntitySpan<TB> spanB;
+
+public:
+    View(EntitySpan<TA> mA, EntitySpan<TB> mB) noexcept
+        : spanA{mA}, spanB{mB}
+    {
+    }
+
+    const auto& first() const noexcept { return spanA; }
+    const auto& second() const noexcept { return spanB; }
+
+    template <typename TFunc>
+    void forEachPair(TFunc mFunc) const
+    {
+        for(std::size_t iA{0}; iA < spanA.size(); ++iA)
+            for(std::size_t iB{0}; iB < spanB.size(); ++iB)
+                mFunc(spanA[iA], spanB[iB]);
+    }
+
+    // La broadphase deve essere già stata costruita su `second()`.
+    template <typename TBroadphase, typename TFunc>
+    void forEachPair(const TBroadphase& mBroadphase, TFunc mFunc) const
+    {
+        for(std::size_t iA{0}; iA < spanA.size(); ++iA)
+        {
+            auto& a(spanA[iA]);
+            mBroadphase.query(a, [&a, &mFunc](TB& mB)
+                {
+                    mFunc(a, mB);
+                });
+        }
+    }
+};
+
+// Broadphase "sweep and prune" su un singolo asse: le entità vengono
+// ordinate per `left()`, e una query visita solo quelle il cui
+// intervallo orizzontale può intersecare quello dell'entità data.
+template <typename T>
+class SweepBroadphase
+{
+private:
+    std::vector<T*> sorted;
+    float maxWidth{0.f};
+
+public:
+    void build(const EntitySpan<T>& mSpan)
+    {
+        sorted.clear();
+        maxWidth = 0.f;
+
+        for(std::size_t i{0}; i < mSpan.size(); ++i)
+        {
+            auto& e(mSpan[i]);
+            sorted.emplace_back(&e);
+            maxWidth = std::max(maxWidth, e.right() - e.left());
+        }
+
+        std::sort(std::begin(sorted), std::end(sorted), [](auto mA, auto mB)
+            {
+                return mA->left() < mB->left();
+            });
+    }
+
+    template <typename TOther, typename TFunc>
+    void query(const TOther& mOther, TFunc mFunc) const
+    {
+        auto itr(std::lower_bound(std::begin(sorted), std::end(sorted),
+            mOther.left() - maxWidth, [](auto mPtr, float mX)
+            {
+                return mPtr->left() < mX;
+            }));
+
+        for(; itr != std::end(sorted) && (*itr)->left() <= mOther.right();
+            ++itr)
+            if(isIntersecting(**itr, mOther)) mFunc(**itr);
+    }
+};
+
+class Manager
+{
+private:
+    std::vector<std::unique_ptr<Entity>> entities;
+    std::map<std::size_t, std::vector<Entity*>> groupedEntities;
+
+    // Le entità distrutte non vengono deallocate: finiscono in un
+    // "pool" in base al loro tipo dinamico, e `create` ne riutilizza
+    // la memoria ricostruendo l'oggetto "in-place". In questo modo
+    // restart ripetuti non allocano nuova memoria.
+    std::map<std::size_t, std::vector<std::unique_ptr<Entity>>> pools;
+
+    // Gruppi i cui elementi possono essere aggiornati in parallelo.
+    // I valori di una `std::map` hanno indirizzi stabili.
+    std::set<std::vector<Entity*>*> isolatedGroups;
+
+    void recycle(std::unique_ptr<Entity>& mUPtr)
+    {
+        pools[typeid(*mUPtr).hash_code()].emplace_back(std::move(mUPtr));
+    }
+
+    template <typename T, typename... TArgs>
+    auto acquire(TArgs&&... mArgs)
+    {
+        auto& pool(pools[typeid(T).hash_code()]);
+        if(pool.empty())
+            return std::unique_ptr<Entity>{
+                std::make_unique<T>(std::forward<TArgs>(mArgs)...)};
+
+        auto uPtr(std::move(pool.back()));
+        pool.pop_back();
+
+        // Il pool contiene solo oggetti di tipo `T`: possiamo
+        // distruggerli e ricostruirli nella stessa memoria.
+        auto ptr(static_cast<T*>(uPtr.get()));
+        ptr->~T();
+
+        try
+        {
+            new(ptr) T(std::forward<TArgs>(mArgs)...);
+        }
+        catch(...)
+        {
+            // L'oggetto è già stato distrutto: liberiamo solo la
+            // memoria, senza chiamare di nuovo il distruttore.
+            uPtr.release();
+            ::operator delete(ptr);
+            throw;
+        }
+
+        return uPtr;
+    }
+
+public:
+    template <typename T, typename... TArgs>
+    T& create(TArgs&&... mArgs)
+    {
+        static_assert(
+            std::is_base_of<Entity, T>(), "`T` must derive from `Entity`");
+
+        auto uPtr(acquire<T>(std::forward<TArgs>(mArgs)...));
+
+        auto ptr(static_cast<T*>(uPtr.get()));
+        ptr->parallelUpdate = HasIsolatedUpdate<T>{};
+
+        auto& group(groupedEntities[typeid(T).hash_code()]);
+        group.emplace_back(ptr);
+        if(HasIsolatedUpdate<T>{}) isolatedGroups.emplace(&group);
+
+        entities.emplace_back(std::move(uPtr));
+
+        return *ptr;
+    }
+
+    void refresh()
+    {
+        for(auto& pair : groupedEntities)
+        {
+            auto& vector(pair.second);
+
+            vector.erase(std::remove_if(std::begin(vector), std::end(vector),
+                             [](auto mPtr)
+                             {
+                                 return mPtr->destroyed;
+                             }),
+                std::end(vector));
+        }
+
+        for(auto& uPtr : entities)
+            if(uPtr->destroyed) recycle(uPtr);
+
+        entities.erase(
+            std::remove(std::begin(entities), std::end(entities), nullptr),
+            std::end(entities));
+    }
+
+    // Anche `clear` restituisce le entità ai pool, e mantiene la
+    // capacità dei vettori.
+    void clear()
+    {
+        for(auto& pair : groupedEntities) pair.second.clear();
+
+        for(auto& uPtr : entities) recycle(uPtr);
+        entities.clear();
+    }
+
+    template <typename T>
+    auto& getAll()
+    {
+        return groupedEntities[typeid(T).hash_code()];
+    }
+
+    template <typename T, typename TFunc>
+    void forEach(TFunc mFunc)
+    {
+        for(auto ptr : getAll<T>()) mFunc(*static_cast<T*>(ptr));
+    }
+
+    template <typename TA, typename TB>
+    auto view()
+    {
+        // Otteniamo entrambi i gruppi prima di costruire gli span:
+        // `getAll` può inserire nuove chiavi nella mappa.
+        auto& groupA(getAll<TA>());
+        auto& groupB(getAll<TB>());
+
+        return View<TA, TB>{groupA, groupB};
+    }
+
+    template <typename TA, typename TB, typename TFunc>
+    void forEachPair(TFunc mFunc)
+    {
+        view<TA, TB>().forEachPair(mFunc);
+    }
+
+    void update()
+    {
+        for(auto& e : entities) e->update();
+    }
+
+    // Versione parallela di `update`: le entità "non isolate" vengono
+    // aggiornate in ordine sul thread corrente, poi ogni gruppo
+    // isolato viene diviso in blocchi eseguiti sul thread pool.
+    void update(ThreadPool& mPool, std::size_t mGrain = 1024)
+    {
+        for(auto& e : entities)
+            if(!e->parallelUpdate) e->update();
+
+        for(auto group : isolatedGroups)
+            mPool.parallelFor(group->size(), mGrain,
+                [group](std::size_t mBegin, std::size_t mEnd)
+                {
+                    for(auto i(mBegin); i < mEnd; ++i) (*group)[i]->update();
+                });
+    }
+    void draw(sf::RenderWindow& mTarget)
+    {
+        for(auto& e : entities) e->draw(mTarget);
+    }
+};
+
+struct Rectangle
+{
+    sf::RectangleShape shape;
+
+    float x() const noexcept { return shape.getPosition().x; }
+    float y() const noexcept { return shape.getPosition().y; }
+    float width() const noexcept { return shape.getSize().x; }
+    float height() const noexcept { return shape.getSize().y; }
+    float left() const noexcept { return x() - width() / 2.f; }
+    float right() const noexcept { return x() + width() / 2.f; }
+    float top() const noexcept { return y() - height() / 2.f; }
+    float bottom() const noexcept { return y() + height() / 2.f; }
+};
+
+struct Circle
+{
+    sf::CircleShape shape;
+
+    float x() const noexcept { return shape.getPosition().x; }
+    float y() const noexcept { return shape.getPosition().y; }
+    float radius() const noexcept { return shape.getRadius(); }
+    float left() const noexcept { return x() - radius(); }
+    float right() const noexcept { return x() + radius(); }
+    float top() const noexcept { return y() - radius(); }
+    float bottom() const noexcept { return y() + radius(); }
+};
+
+class Ball : public Entity, public Circle
+{
+public:
+    static const sf::Color defColor;
+    static constexpr float defRadius{10.f}, defVelocity{8.f};
+
+    sf::Vector2f velocity{-defVelocity, -defVelocity};
+
+    Ball(float mX, float mY)
+    {
+        shape.setPosition(mX, mY);
+        shape.setRadius(defRadius);
+        shape.setFillColor(defColor);
+        shape.setOrigin(defRadius, defRadius);
+    }
+
+    void update() override
+    {
+        shape.move(velocity);
+        solveBoundCollisions();
+    }
+
+    void draw(sf::RenderWindow& mTarget) override { mTarget.draw(shape); }
+
+private:
+    void solveBoundCollisions() noexcept
+    {
+        if(left() < 0 || right() > wndWidth) velocity.x *= -1.f;
+
+        if(top() < 0) velocity.y *= -1.f;
+
+        // Se la pallina ha lasciato la finestra in basso, deve
+        // essere distrutta.
+        else if(bottom() > wndHeight)
+            destroyed = true;
+    }
+};
+
+const sf::Color Ball::defColor{sf::Color::Red};
+
+class Paddle : public Entity, public Rectangle
+{
+public:
+    static const sf::Color defColor;
+    static constexpr float defWidth{75.f}, defHeight{20.f};
+    static constexpr float defVelocity{8.f};
+
+    sf::Vector2f velocity;
+
+    // L'input viene letto una volta per frame, nella fase "input"
+    // del game loop, e copiato qui prima dell'`update`.
+    struct Input
+    {
+        bool left{false}, right{false};
+    };
+
+    Input input;
+
+    Paddle(float mX, float mY)
+    {
+        shape.setPosition(mX, mY);
+        shape.setSize({defWidth, defHeight});
+        shape.setFillColor(defColor);
+        shape.setOrigin(defWidth / 2.f, defHeight / 2.f);
+    }
+
+    void update() override
+    {
+        processPlayerInput();
+        shape.move(velocity);
+    }
+
+    void draw(sf::RenderWindow& mTarget) override { mTarget.draw(shape); }
+
+private:
+    void processPlayerInput()
+    {
+        if(input.left && left() > 0)
+            velocity.x = -defVelocity;
+        else if(input.right && right() < wndWidth)
+            velocity.x = defVelocity;
+        else
+            velocity.x = 0;
+    }
+};
+
+const sf::Color Paddle::defColor{sf::Color::Red};
+
+class Brick : public Entity, public Rectangle
+{
+public:
+    static const sf::Color defClHits1;
+    static const sf::Color defClHits2;
+    static const sf::Color defClHits3;
+    static constexpr float defWidth{60.f}, defHeight{20.f};
+    static constexpr float defVelocity{8.f};
+
+    // `update` modifica solo il colore del mattoncino stesso.
+    static constexpr bool isolatedUpdate{true};
+
+    // Aggiungiamo un campo per il numero di colpi richiesti.
+    int requiredHits{1};
+
+    Brick(float mX, float mY)
+    {
+        shape.setPosition(mX, mY);
+        shape.setSize({defWidth, defHeight});
+        shape.setOrigin(defWidth / 2.f, defHeight / 2.f);
+    }
+
+    void update() override
+    {
+        // Alteriamo il colore del mattoncino in base al numero di
+        // colpi richiesti.
+        if(requiredHits == 1)
+            shape.setFillColor(defClHits1);
+        else if(requiredHits == 2)
+            shape.setFillColor(defClHits2);
+        else
+            shape.setFillColor(defClHits3);
+    }
+    void draw(sf::RenderWindow& mTarget) override { mTarget.draw(shape); }
+};
+
+const sf::Color Brick::defClHits1{255, 255, 0, 80};
+const sf::Color Brick::defClHits2{255, 255, 0, 170};
+const sf::Color Brick::defClHits3{255, 255, 0, 255};
+
+void solvePaddleBallCollision(const Paddle& mPaddle, Ball& mBall) noexcept
+{
+    if(!isIntersecting(mPaddle, mBall)) return;
+
+    auto newY(mPaddle.top() - mBall.shape.getRadius() * 2.f);
+    mBall.shape.setPosition(mBall.x(), newY);
+
+    auto paddleBallDiff(mBall.x() - mPaddle.x());
+    auto posFactor(paddleBallDiff / mPaddle.width());
+    auto velFactor(mPaddle.velocity.x * 0.05f);
+
+    sf::Vector2f collisionVec{posFactor + velFactor, -2.f};
+
+    mBall.velocity = getReflected(mBall.velocity, getNormalized(collisionVec));
+}
+
+// Invece di risolvere immediatamente ogni collisione, la fase di
+// "narrowphase" produce una lista di contatti. In questo modo la
+// rilevazione può avvenire in parallelo, e la risoluzione non
+// dipende dall'ordine in cui i mattoncini sono stati visitati.
+struct BrickContact
+{
+    Brick* brick;
+
+    // Normale uscente dal mattoncino verso la pallina, lungo l'asse
+    // di minima compenetrazione.
+    sf::Vector2f normal;
+    float penetration;
+};
+
+bool findBrickBallContact(
+    Brick& mBrick, const Ball& mBall, BrickContact& mContact) noexcept
+{
+    if(!isIntersecting(mBrick, mBall)) return false;
+
+    auto overlapLeft(mBall.right() - mBrick.left());
+    auto overlapRight(mBrick.right() - mBall.left());
+    auto overlapTop(mBall.bottom() - mBrick.top());
+    auto overlapBottom(mBrick.bottom() - mBall.top());
+
+    auto bFromLeft(std::abs(overlapLeft) < std::abs(overlapRight));
+    auto bFromTop(std::abs(overlapTop) < std::abs(overlapBottom));
+
+    auto minOverlapX(std::abs(bFromLeft ? overlapLeft : overlapRight));
+    auto minOverlapY(std::abs(bFromTop ? overlapTop : overlapBottom));
+
+    mContact.brick = &mBrick;
+
+    if(minOverlapX < minOverlapY)
+    {
+        mContact.normal = {bFromLeft ? -1.f : 1.f, 0.f};
+        mContact.penetration = minOverlapX;
+    }
+    else
+    {
+        mContact.normal = {0.f, bFromTop ? -1.f : 1.f};
+        mContact.penetration = minOverlapY;
+    }
+
+    return true;
+}
+
+// Risolve tutti i contatti di una pallina in un solo passo: i
+// contatti vengono ordinati con un criterio che dipende solo dalla
+// geometria, e per ogni asse viene usata la normale del contatto più
+// profondo. Due mattoncini adiacenti colpiti nello stesso frame
+// riflettono quindi la velocità una sola volta.
+void resolveBallContacts(Ball& mBall, std::vector<BrickContact>& mContacts)
+{
+    if(mContacts.empty()) return;
+
+    std::sort(std::begin(mContacts), std::end(mContacts),
+        [](const auto& mA, const auto& mB)
+        {
+            if(mA.penetration != mB.penetration)
+                return mA.penetration > mB.penetration;
+
+            if(mA.brick->y() != mB.brick->y())
+                return mA.brick->y() < mB.brick->y();
+
+            return mA.brick->x() < mB.brick->x();
+        });
+
+    bool resolvedX{false}, resolvedY{false};
+
+    for(const auto& c : mContacts)
+    {
+        if(c.normal.x != 0.f && !resolvedX)
+        {
+            mBall.velocity.x = std::abs(mBall.velocity.x) * c.normal.x;
+            resolvedX = true;
+        }
+        else if(c.normal.y != 0.f && !resolvedY)
+        {
+            mBall.velocity.y = std::abs(mBall.velocity.y) * c.normal.y;
+            resolvedY = true;
+        }
+    }
+}
+
+// Ogni mattoncino toccato perde un colpo per ogni pallina che lo ha
+// toccato, indipendentemente da quanti thread hanno prodotto i
+// contatti. Restituisce il numero di mattoncini distrutti.
+int applyBrickDamage(const std::vector<BrickContact>& mContacts) noexcept
+{
+    int destroyedCount{0};
+
+    for(const auto& c : mContacts)
+    {
+        --c.brick->requiredHits;
+        if(c.brick->requiredHits > 0 || c.brick->destroyed) continue;
+
+        c.brick->destroyed = true;
+        ++destroyedCount;
+    }
+
+    return destroyedCount;
+}
+
+// Compilando con `-DARKANOID_EMBEDDED_FONT='"font.inc"'` viene
+// incluso un font di riserva. Il file deve definire
+// `embeddedFontData` e `embeddedFontSize`, ad esempio partendo
+// dall'output di `xxd -i`.
+#ifdef ARKANOID_EMBEDDED_FONT
+#include ARKANOID_EMBEDDED_FONT
+#endif
+
+// Un `AssetManager` carica le risorse (font, e in futuro texture,
+// suoni e livelli) su un thread dedicato, per non bloccare l'avvio
+// della finestra. Le richieste per lo stesso file vengono
+// de-duplicate, e i file vengono cercati in una lista di percorsi.
+class AssetManager
+{
+private:
+    struct AssetBase
+    {
+        enum class Status
+        {
+            Loading,
+            Loaded,
+            Failed
+        };
+
+        std::atomic<Status> status{Status::Loading};
+        virtual ~AssetBase() {}
+    };
+
+public:
+    template <typename T>
+    class Asset : public AssetBase
+    {
+    private:
+        friend class AssetManager;
+        T resource;
+
+    public:
+        // Pronto quando il caricamento è terminato, anche se fallito.
+        bool isReady() const noexcept { return status != Status::Loading; }
+        bool isLoaded() const noexcept { return status == Status::Loaded; }
+
+        // Usabile solo dopo che `isLoaded` ha restituito `true`.
+        // Prima, il `T` può essere passato solo per riferimento
+        // (ad esempio a `sf::Text::setFont`).
+        const T& get() const noexcept { return resource; }
+    };
+
+private:
+    std::vector<std::string> searchPaths;
+    std::map<std::pair<std::size_t, std::string>, std::unique_ptr<AssetBase>>
+        assets;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> jobs;
+    bool running{true};
+    std::thread loader;
+
+    static bool loadFromFile(sf::Font& mFont, const std::string& mPath)
+    {
+        return mFont.loadFromFile(mPath);
+    }
+
+    // Se nessun percorso contiene il font, usiamo quello incluso
+    // nell'eseguibile tramite `-DARKANOID_EMBEDDED_FONT`.
+    static bool loadFallback(sf::Font& mFont)
+    {
+#ifdef ARKANOID_EMBEDDED_FONT
+        return mFont.loadFromMemory(embeddedFontData, embeddedFontSize);
+#else
+        (void)mFont;
+        return false;
+#endif
+    }
+
+    template <typename T>
+    void load(Asset<T>& mAsset, const std::string& mName)
+    {
+        auto loaded(false);
+
+        if(!mName.empty() && mName.front() == '/')
+            loaded = loadFromFile(mAsset.resource, mName);
+
+        for(const auto& p : searchPaths)
+        {
+            if(loaded) break;
+            loaded = loadFromFile(mAsset.resource, p + "/" + mName);
+        }
+
+        if(!loaded)
+        {
+            loaded = loadFallback(mAsset.resource);
+            std::cerr << "Asset `" << mName << "` not found"
+                      << (loaded ? ", using fallback\n" : "\n");
+        }
+
+        mAsset.status =
+            loaded ? AssetBase::Status::Loaded : AssetBase::Status::Failed;
+    }
+
+    void loaderLoop()
+    {
+        while(true)
+        {
+            std::function<void()> job;
+
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                cv.wait(lock, [this]
+                    {
+                        return !running || !jobs.empty();
+                    });
+
+                if(!running) return;
+
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            job();
+        }
+    }
+
+public:
+    AssetManager(std::vector<std::string> mSearchPaths)
+        : searchPaths{std::move(mSearchPaths)}, loader{[this]
+              {
+                  loaderLoop();
+              }}
+    {
+    }
+
+    ~AssetManager()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            running = false;
+        }
+
+        cv.notify_all();
+        loader.join();
+    }
+
+    // Restituisce subito l'asset, che verrà caricato in background.
+    // Richieste successive per lo stesso nome restituiscono lo
+    // stesso asset.
+    template <typename T>
+    const Asset<T>& request(const std::string& mName)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        auto& slot(assets[{typeid(T).hash_code(), mName}]);
+        if(slot != nullptr) return static_cast<Asset<T>&>(*slot);
+
+        auto asset(std::make_unique<Asset<T>>());
+        auto ptr(asset.get());
+        slot = std::move(asset);
+
+        jobs.emplace_back([this, ptr, mName]
+            {
+                load(*ptr, mName);
+            });
+        cv.notify_one();
+
+        return *ptr;
+    }
+
+    // Vero se tutte le risorse richieste finora sono pronte.
+    bool isIdle()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        for(const auto& pair : assets)
+            if(pair.second->status == AssetBase::Status::Loading)
+                return false;
+
+        return true;
+    }
+};
+
+// Un `HudText` è un testo dell'interfaccia legato ad un valore.
+// `refresh` confronta il valore con quello mostrato e rigenera la
+// stringa (e quindi la geometria dei glifi di `sf::Text`) solo se è
+// cambiato. I numeri vengono formattati in un buffer fisso, senza
+// allocazioni.
+class HudText
+{
+private:
+    sf::Text text;
+    std::array<char, 64> buffer;
+
+    const char* prefix{""};
+    const int* boundValue{nullptr};
+
+    // Come un `ThreadPool::Job`: una funzione e il contesto con cui
+    // chiamarla.
+    const char* (*labelFunc)(const void*){nullptr};
+    const void* labelContext{nullptr};
+
+    int lastValue{0};
+    const char* lastLabel{nullptr};
+    bool dirty{true};
+
+    // Tutti i caratteri che il testo può mostrare.
+    unsigned int characterSize;
+    std::string glyphSet;
+
+    void formatValue(int mValue) noexcept
+    {
+        auto prefixLen(std::min(std::strlen(prefix), buffer.size() - 16));
+        std::memcpy(buffer.data(), prefix, prefixLen);
+
+        // Scriviamo le cifre al contrario in un buffer temporaneo.
+        std::array<char, 12> digits;
+        std::size_t count{0};
+        auto negative(mValue < 0);
+        auto abs(negative ? -static_cast<long>(mValue) : mValue);
+
+        do
+        {
+            digits[count++] = '0' + abs % 10;
+            abs /= 10;
+        } while(abs > 0);
+
+        auto pos(prefixLen);
+        if(negative) buffer[pos++] = '-';
+        while(count > 0) buffer[pos++] = digits[--count];
+        buffer[pos] = '\0';
+    }
+
+public:
+    HudText(const sf::Font& mFont, unsigned int mSize, float mX, float mY)
+        : characterSize{mSize}
+    {
+        text.setFont(mFont);
+        text.setPosition(mX, mY);
+        text.setCharacterSize(mSize);
+        text.setColor(sf::Color::White);
+    }
+
+    // Lega il testo ad un intero, mostrato dopo `mPrefix`. Entrambi
+    // devono sopravvivere al widget.
+    void bind(const char* mPrefix, const int& mValue)
+    {
+        prefix = mPrefix;
+        boundValue = &mValue;
+        dirty = true;
+
+        glyphSet = std::string{mPrefix} + "-0123456789";
+    }
+
+    // Lega il testo ad una funzione che restituisce stringhe con
+    // durata statica: basta confrontare i puntatori. La funzione
+    // riceve `mContext`, che deve sopravvivere al widget. `mLabels`
+    // elenca tutte le stringhe che la funzione può restituire.
+    void bind(const char* (*mLabel)(const void*), const void* mContext,
+        std::initializer_list<const char*> mLabels)
+    {
+        labelFunc = mLabel;
+        labelContext = mContext;
+        dirty = true;
+
+        glyphSet.clear();
+        for(auto l : mLabels) glyphSet += l;
+    }
+
+    // Rasterizza in anticipo nella texture del font tutti i glifi
+    // che il testo può mostrare, per evitare rallentamenti al primo
+    // utilizzo. Deve essere chiamato dal thread di rendering.
+    void prewarm(const sf::Font& mFont) const
+    {
+        for(auto c : glyphSet)
+            mFont.getGlyph(static_cast<unsigned char>(c), characterSize, false);
+    }
+
+    auto getCharacterSize() const noexcept { return characterSize; }
+
+    void refresh()
+    {
+        if(boundValue != nullptr && (dirty || *boundValue != lastValue))
+        {
+            lastValue = *boundValue;
+            formatValue(lastValue);
+            text.setString(buffer.data());
+        }
+        else if(labelFunc != nullptr)
+        {
+            auto label(labelFunc(labelContext));
+            if(!dirty && label == lastLabel) return;
+
+            lastLabel = label;
+            text.setString(label);
+        }
+
+        dirty = false;
+    }
+
+    void draw(sf::RenderWindow& mTarget) const { mTarget.draw(text); }
+};
+
+class Game
+{
+private:
+    // Aggiungiamo due stati aggiuntivi: `GameOver` e `Victory`.
+    enum class State
+    {
+        Paused,
+        GameOver,
+        InProgress,
+        Victory
+    };
+
+    static constexpr int brkCountX{11}, brkCountY{4};
+    static constexpr int brkStartCol{1}, brkStartRow{2};
+    static constexpr float brkSpacing{3.f}, brkOffsetX{22.f};
+
+    sf::RenderWindow window{{wndWidth, wndHeight}, "Arkanoid - 11"};
+    Manager manager;
+    ThreadPool threadPool;
+    SweepBroadphase<Brick> brickBroadphase;
+
+    // Contatti prodotti dalla narrowphase, uno slot per pallina.
+    std::vector<std::vector<BrickContact>> ballContacts;
+
+    // Le fasi di un frame "in progress" sono descritte da un grafo
+    // di task, costruito una sola volta nel costruttore.
+    TaskGraph frameGraph;
+
+    State state{State::GameOver};
+    bool pausePressedLastFrame{false};
+
+    // Teniamo traccia delle vite del player nella classe `Game`.
+    int remainingLives{0};
+
+    // Il punteggio aumenta di uno per ogni mattoncino distrutto.
+    int score{0};
+
+    // Il font viene caricato in background: la finestra si apre
+    // subito, e i testi vengono mostrati appena il font è pronto.
+    AssetManager assets{{".", "assets", "/usr/share/fonts/TTF",
+        "/usr/share/fonts/truetype/liberation", "/usr/share/fonts/liberation"}};
+    const AssetManager::Asset<sf::Font>& liberationSans{
+        assets.request<sf::Font>("LiberationSans-Regular.ttf")};
+
+    // SFML offre delle classi `sf::Font` ed `sf::Text` molto facili
+    // da usare. Le impiegheremo, tramite `HudText`, per mostrare il
+    // numero di vite rimanenti, il punteggio e lo stato del gioco.
+    HudText hudState{liberationSans.get(), 35, 10.f, 10.f};
+    HudText hudLives{liberationSans.get(), 15, 10.f, 10.f};
+    HudText hudScore{liberationSans.get(), 15, 10.f, 30.f};
+
+    bool glyphsPrewarmed{false};
+
+    // Appena il font è disponibile, prepariamo i glifi di tutti i
+    // testi per ogni dimensione usata, così i cambi di stato non
+    // causano rallentamenti.
+    void prewarmGlyphs()
+    {
+        const auto& font(liberationSans.get());
+        const HudText* huds[]{&hudState, &hudLives, &hudScore};
+
+        std::set<unsigned int> characterSizes;
+
+        for(auto h : huds)
+        {
+            h->prewarm(font);
+            characterSizes.emplace(h->getCharacterSize());
+        }
+
+        for(auto cs : characterSizes)
+        {
+            auto size(font.getTexture(cs).getSize());
+            std::cout << "Glyph atlas (size " << cs << "): " << size.x << "x"
+                      << size.y << "\n";
+        }
+
+        glyphsPrewarmed = true;
+    }
+
+    static const char* getStateLabel(State mState) noexcept
+    {
+        switch(mState)
+        {
+            case State::Paused: return "Paused";
+            case State::GameOver: return "Game over!";
+            case State::Victory: return "You won!";
+            default: return "";
+        }
+    }
+
+public:
+    Game()
+    {
+        window.setFramerateLimit(60);
+
+        hudState.bind(
+            [](const void* mGame)
+            {
+                return getStateLabel(static_cast<const Game*>(mGame)->state);
+            },
+            this,
+            {getStateLabel(State::Paused), getStateLabel(State::GameOver),
+                getStateLabel(State::Victory)});
+        hudLives.bind("Lives: ", remainingLives);
+        hudScore.bind("Score: ", score);
+
+        buildFrameGraph();
+    }
+
+    void buildFrameGraph()
+    {
+        auto& g(frameGraph);
+
+        // Se non ci sono più palline sullo schermo, decrementiamo il
+        // numero di vite e creiamo una nuova pallina. Controlliamo
+        // anche le condizioni di vittoria e sconfitta.
+        auto rules(g.add("rules", [this]
+            {
+                if(manager.getAll<Ball>().empty())
+                {
+                    manager.create<Ball>(wndWidth / 2.f, wndHeight / 2.f);
+                    --remainingLives;
+                }
+
+                if(manager.getAll<Brick>().empty()) state = State::Victory;
+                if(remainingLives <= 0) state = State::GameOver;
+            }));
+
+        auto input(g.add("input", [this]
+            {
+                Paddle::Input in;
+                in.left = sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Left);
+                in.right =
+                    sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Right);
+
+                manager.forEach<Paddle>([&in](auto& mPaddle)
+                    {
+                        mPaddle.input = in;
+                    });
+            }));
+
+        auto update(g.add("update", [this]
+            {
+                manager.update(threadPool);
+            }));
+
+        // I mattoncini non si muovono durante `update`: la broadphase
+        // può essere costruita in parallelo all'aggiornamento.
+        auto broadphase(g.add("broadphase", [this]
+            {
+                brickBroadphase.build(manager.view<Ball, Brick>().second());
+            }));
+
+        // Ogni pallina scrive solo nel proprio slot di contatti: la
+        // narrowphase può essere eseguita in parallelo.
+        auto narrowphase(g.add("narrowphase", [this]
+            {
+                auto balls(manager.view<Ball, Brick>().first());
+                ballContacts.resize(balls.size());
+
+                threadPool.parallelFor(balls.size(), 1,
+                    [this, &balls](std::size_t mBegin, std::size_t mEnd)
+                    {
+                        for(auto i(mBegin); i < mEnd; ++i)
+                        {
+                            auto& contacts(ballContacts[i]);
+                            contacts.clear();
+
+                            BrickContact c;
+                            brickBroadphase.query(
+                                balls[i], [&](auto& mBrick)
+                                {
+                                    if(findBrickBallContact(
+                                           mBrick, balls[i], c))
+                                        contacts.emplace_back(c);
+                                });
+                        }
+                    });
+            }));
+
+        // La risoluzione è sequenziale e segue l'ordine delle
+        // palline: il risultato non dipende dal numero di thread.
+        auto resolve(g.add("resolve", [this]
+            {
+                auto balls(manager.view<Ball, Brick>().first());
+
+                for(std::size_t i{0}; i < balls.size(); ++i)
+                    resolveBallContacts(balls[i], ballContacts[i]);
+
+                for(std::size_t i{0}; i < balls.size(); ++i)
+                    score += applyBrickDamage(ballContacts[i]);
+
+                manager.forEachPair<Ball, Paddle>(
+                    [](auto& mBall, auto& mPaddle)
+                    {
+                        solvePaddleBallCollision(mPaddle, mBall);
+                    });
+            }));
+
+        auto refresh(g.add("refresh", [this]
+            {
+                manager.refresh();
+            }));
+
+        // Aggiorniamo i testi delle vite rimanenti e del punteggio:
+        // vengono rigenerati solo se i valori sono cambiati. Il
+        // punteggio viene scritto da `resolve`, quindi i testi vanno
+        // letti solo dopo la risoluzione.
+        auto hud(g.add("hud", [this]
+            {
+                hudLives.refresh();
+                hudScore.refresh();
+            }));
+
+        // Il rendering deve avvenire sul thread che possiede la
+        // finestra.
+        auto draw(g.add("draw",
+            [this]
+            {
+                manager.draw(window);
+
+                if(!liberationSans.isLoaded()) return;
+                hudLives.draw(window);
+                hudScore.draw(window);
+            },
+            true));
+
+        g.precede(rules, input);
+        g.precede(input, update);
+        g.precede(rules, broadphase);
+        g.precede(update, narrowphase);
+        g.precede(broadphase, narrowphase);
+        g.precede(narrowphase, resolve);
+        g.precede(resolve, refresh);
+        g.precede(resolve, hud);
+        g.precede(refresh, draw);
+        g.precede(hud, draw);
+    }
+
+    void restart()
+    {
+        // Ricordiamoci di settare le vite all'inizio di `restart`.
+        remainingLives = 3;
+        score = 0;
+
+        state = State::Paused;
+        manager.clear();
+
+        for(int iX{0}; iX < brkCountX; ++iX)
+            for(int iY{0}; iY < brkCountY; ++iY)
+            {
+                auto x((iX + brkStartCol) * (Brick::defWidth + brkSpacing));
+                auto y((iY + brkStartRow) * (Brick::defHeight + brkSpacing));
+
+                auto& brick(manager.create<Brick>(brkOffsetX + x, y));
+
+                // Settiamo il numero di colpi richiesti per la
+                // distruzione dei mattoncini usando un pattern
+                // periodico.
+                brick.requiredHits = 1 + ((iX * iY) % 3);
+            }
+
+        manager.create<Ball>(wndWidth / 2.f, wndHeight / 2.f);
+        manager.create<Paddle>(wndWidth / 2, wndHeight - 50);
+    }
+
+    void run()
+    {
+        while(true)
+        {
+            window.clear(sf::Color::Black);
+
+            if(!glyphsPrewarmed && liberationSans.isLoaded()) prewarmGlyphs();
+
+            if(sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Escape)) break;
+
+            if(sf::Keyboard::isKeyPressed(sf::Keyboard::Key::P))
+            {
+                if(!pausePressedLastFrame)
+                {
+                    if(state == State::Paused)
+                        state = State::InProgress;
+                    else if(state == State::InProgress)
+                        state = State::Paused;
+                }
+                pausePressedLastFrame = true;
+            }
+            else
+                pausePressedLastFrame = false;
+
+            if(sf::Keyboard::isKeyPressed(sf::Keyboard::Key::R)) restart();
+
+            // Se il gioco non è "in progress", non renderizziamo o
+            // aggiorniamo gli elementi, e mostriamo al player lo
+            // stato corrente con una stringa.
+            if(state != State::InProgress)
+            {
+                hudState.refresh();
+                if(liberationSans.isLoaded()) hudState.draw(window);
+            }
+            else
+                frameGraph.run(threadPool);
+
+            window.display();
+        }
+    }
+};
+
+int main()
+{
+    Game game;
+    game.restart();
+    game.run();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,2642 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: MIT License | http://opensource.org/licenses/MIT
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+// In questo segmento di codice aggiungeremo qualche feature
+// al nostro gioco:
+// * Livelli in formato binario, caricati tramite `mmap`
+// * Generazione procedurale di livelli e simulazione "headless"
+// * Mattoncini conservati in una griglia compatta di bit
+
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <array>
+#include <random>
+#include <cstring>
+#include <typeinfo>
+#include <map>
+#include <set>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <limits>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <SFML/Graphics.hpp>
+
+template <typename T>
+auto getLength(const T& mVec) noexcept
+{
+    return std::sqrt(std::pow(mVec.x, 2) + std::pow(mVec.y, 2));
+}
+
+template <typename T>
+auto getNormalized(const sf::Vector2<T>& mVec) noexcept
+{
+    return mVec / static_cast<T>(getLength(mVec));
+}
+
+template <typename T1, typename T2>
+auto getDotProduct(const T1& mVec1, const T2& mVec2)
+{
+    return mVec1.x * mVec2.x + mVec1.y * mVec2.y;
+}
+
+template <typename T1, typename T2>
+auto getReflected(const T1& mVec, const T2& mNormal)
+{
+    return mVec - (mNormal * (2.f * getDotProduct(mVec, mNormal)));
+}
+
+template <typename T1, typename T2>
+bool isIntersecting(const T1& mA, const T2& mB) noexcept
+{
+    return mA.right() >= mB.left() && mA.left() <= mB.right() &&
+           mA.bottom() >= mB.top() && mA.top() <= mB.bottom();
+}
+
+constexpr unsigned int wndWidth{800}, wndHeight{600};
+
+// Un semplice thread pool "work stealing": ogni worker ha la sua
+// coda di job, da cui preleva in ordine LIFO. Un worker senza lavoro
+// "ruba" dalla testa delle code degli altri worker.
+class ThreadPool
+{
+public:
+    // Un job è un riferimento non proprietario ad un oggetto
+    // invocabile: chi lo accoda deve mantenere in vita l'oggetto
+    // finché il job non è stato eseguito. In questo modo accodare un
+    // job non alloca memoria.
+    struct Job
+    {
+        void (*func)(void*);
+        void* context;
+
+        void operator()() const { func(context); }
+    };
+
+    template <typename T>
+    static Job makeJob(T& mCallable) noexcept
+    {
+        return {[](void* mContext)
+            {
+                (*static_cast<T*>(mContext))();
+            },
+            &mCallable};
+    }
+
+private:
+    // Le code hanno una capacità fissa, allocata una volta sola: se
+    // una coda è piena, `submit` esegue il job immediatamente.
+    static constexpr std::size_t queueCapacity{1024};
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::array<Job, queueCapacity> jobs;
+        std::size_t head{0}, count{0};
+    };
+
+    // Stato condiviso dai job di una chiamata a `parallelFor`: ogni
+    // job prende il primo blocco non ancora assegnato. Vive sullo
+    // stack del chiamante, che ne attende il completamento.
+    template <typename TFunc>
+    struct ForContext
+    {
+        TFunc& func;
+        std::size_t count, grain;
+
+        std::atomic<std::size_t> next{0}, remaining;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        ForContext(TFunc& mFunc, std::size_t mCount, std::size_t mGrain,
+            std::size_t mChunkCount)
+            : func{mFunc}, count{mCount}, grain{mGrain},
+              remaining{mChunkCount}
+        {
+        }
+
+        void operator()()
+        {
+            auto begin(next++ * grain);
+            auto end(std::min(count, begin + grain));
+
+            try
+            {
+                func(begin, end);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock{errorMutex};
+                if(!error) error = std::current_exception();
+            }
+
+            // Dopo il decremento il chiamante può distruggere il
+            // contesto: non va più toccato.
+            --remaining;
+        }
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::atomic<bool> running{true};
+    std::atomic<std::size_t> pending{0}, nextQueue{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+
+    // Ogni thread sa se è un worker, e di quale pool.
+    static thread_local ThreadPool* currentPool;
+    static thread_local std::size_t currentIdx;
+
+    bool tryPop(std::size_t mIdx, Job& mJob, bool mFromBack)
+    {
+        auto& queue(*queues[mIdx]);
+        std::lock_guard<std::mutex> lock{queue.mutex};
+
+        if(queue.count == 0) return false;
+
+        if(mFromBack)
+            mJob = queue.jobs[(queue.head + queue.count - 1) % queueCapacity];
+        else
+        {
+            mJob = queue.jobs[queue.head];
+            queue.head = (queue.head + 1) % queueCapacity;
+        }
+
+        --queue.count;
+        --pending;
+        return true;
+    }
+
+    void workerLoop(std::size_t mIdx)
+    {
+        currentPool = this;
+        currentIdx = mIdx;
+
+        while(running)
+        {
+            if(runOne()) continue;
+
+            std::unique_lock<std::mutex> lock{sleepMutex};
+            sleepCv.wait(lock, [this]
+                {
+                    return !running || pending > 0;
+                });
+        }
+    }
+
+public:
+    ThreadPool(std::size_t mThreadCount = std::max(
+                   1u, std::thread::hardware_concurrency()) - 1)
+    {
+        // Anche i thread esterni possono accodare job: usiamo almeno
+        // una coda anche se non ci sono worker.
+        auto queueCount(std::max<std::size_t>(1, mThreadCount));
+        for(std::size_t i{0}; i < queueCount; ++i)
+            queues.emplace_back(std::make_unique<Queue>());
+
+        for(std::size_t i{0}; i < mThreadCount; ++i)
+            threads.emplace_back([this, i]
+                {
+                    workerLoop(i);
+                });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{sleepMutex};
+            running = false;
+        }
+
+        sleepCv.notify_all();
+        for(auto& t : threads) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    auto getThreadCount() const noexcept { return threads.size(); }
+
+    // I job che lanciano eccezioni terminano il programma: usare
+    // `parallelFor` per propagarle al chiamante.
+    void submit(Job mJob)
+    {
+        auto idx(currentPool == this ? currentIdx
+                                     : nextQueue++ % queues.size());
+
+        {
+            auto& queue(*queues[idx]);
+            std::unique_lock<std::mutex> lock{queue.mutex};
+            if(queue.count == queueCapacity)
+            {
+                lock.unlock();
+                mJob();
+                return;
+            }
+
+            queue.jobs[(queue.head + queue.count) % queueCapacity] = mJob;
+            ++queue.count;
+            ++pending;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{sleepMutex};
+        }
+        sleepCv.notify_one();
+    }
+
+    // Esegue un job disponibile, se c'è: prima dalla coda del thread
+    // corrente, poi rubandolo dalle altre code.
+    bool runOne()
+    {
+        Job job;
+        auto own(currentPool == this);
+        auto start(own ? currentIdx : 0);
+
+        if(own && tryPop(start, job, true))
+        {
+            job();
+            return true;
+        }
+
+        for(std::size_t i{0}; i < queues.size(); ++i)
+        {
+            auto idx((start + i) % queues.size());
+            if((own && idx == start) || !tryPop(idx, job, false)) continue;
+
+            job();
+            return true;
+        }
+
+        return false;
+    }
+
+    // Divide `[0, mCount)` in blocchi di `mGrain` elementi e chiama
+    // `mFunc(begin, end)` su ognuno. Il thread chiamante partecipa
+    // al lavoro finché tutti i blocchi non sono completati.
+    template <typename TFunc>
+    void parallelFor(std::size_t mCount, std::size_t mGrain, TFunc&& mFunc)
+    {
+        mGrain = std::max<std::size_t>(1, mGrain);
+        auto chunkCount((mCount + mGrain - 1) / mGrain);
+
+        if(chunkCount <= 1 || threads.empty())
+        {
+            if(mCount > 0) mFunc(std::size_t(0), mCount);
+            return;
+        }
+
+        ForContext<std::remove_reference_t<TFunc>> context{
+            mFunc, mCount, mGrain, chunkCount};
+
+        auto job(makeJob(context));
+        for(std::size_t i{0}; i < chunkCount; ++i) submit(job);
+
+        while(context.remaining > 0)
+            if(!runOne()) std::this_thread::yield();
+
+        if(context.error) std::rethrow_exception(context.error);
+    }
+};
+
+thread_local ThreadPool* ThreadPool::currentPool{nullptr};
+thread_local std::size_t ThreadPool::currentIdx{0};
+
+// Un `TaskGraph` descrive il lavoro di un frame come un insieme di
+// task con dipendenze. Ogni task ha un contatore delle dipendenze
+// non ancora completate: quando arriva a zero, il task viene
+// accodato sul thread pool. I task marcati "main thread" (ad esempio
+// il rendering) vengono eseguiti solo dal thread che chiama `run`.
+class TaskGraph
+{
+public:
+    using TaskId = std::size_t;
+
+private:
+    // Oggetto invocabile accodato sul thread pool quando un task è
+    // pronto: vive nel task, quindi accodarlo non alloca memoria.
+    struct Launcher
+    {
+        TaskGraph* graph;
+        TaskId id;
+
+        void operator()() const { graph->execute(*graph->pool, id); }
+    };
+
+    // Ogni task possiede il suo oggetto invocabile, e lo esegue
+    // tramite un `ThreadPool::Job` che vi punta.
+    struct Task
+    {
+        const char* name;
+        ThreadPool::Job job;
+        bool mainThread;
+        Launcher launcher;
+
+        std::vector<TaskId> dependents;
+        std::size_t dependencyCount{0};
+        std::atomic<std::size_t> remaining{0};
+
+        virtual ~Task() {}
+    };
+
+    template <typename TFunc>
+    struct CallableTask : Task
+    {
+        TFunc func;
+
+        CallableTask(TFunc mFunc) : func{std::move(mFunc)} {}
+    };
+
+    std::vector<std::unique_ptr<Task>> tasks;
+
+    // Stato di un'esecuzione di `run`.
+    ThreadPool* pool{nullptr};
+    std::atomic<std::size_t> unfinished{0};
+    std::mutex mainMutex;
+    std::vector<TaskId> mainReady;
+    std::exception_ptr error;
+
+    void schedule(ThreadPool& mPool, TaskId mId)
+    {
+        if(tasks[mId]->mainThread)
+        {
+            std::lock_guard<std::mutex> lock{mainMutex};
+            mainReady.emplace_back(mId);
+            return;
+        }
+
+        mPool.submit(ThreadPool::makeJob(tasks[mId]->launcher));
+    }
+
+    void execute(ThreadPool& mPool, TaskId mId)
+    {
+        auto& task(*tasks[mId]);
+
+        try
+        {
+            task.job();
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock{mainMutex};
+            if(!error) error = std::current_exception();
+        }
+
+        for(auto d : task.dependents)
+            if(--tasks[d]->remaining == 0) schedule(mPool, d);
+
+        --unfinished;
+    }
+
+    bool runMainThreadTask(ThreadPool& mPool)
+    {
+        TaskId id;
+
+        {
+            std::lock_guard<std::mutex> lock{mainMutex};
+            if(mainReady.empty()) return false;
+
+            id = mainReady.back();
+            mainReady.pop_back();
+        }
+
+        execute(mPool, id);
+        return true;
+    }
+
+public:
+    template <typename TFunc>
+    TaskId add(const char* mName, TFunc&& mFunc, bool mMainThread = false)
+    {
+        auto task(std::make_unique<CallableTask<std::decay_t<TFunc>>>(
+            std::forward<TFunc>(mFunc)));
+        task->name = mName;
+        task->job = ThreadPool::makeJob(task->func);
+        task->mainThread = mMainThread;
+        task->launcher = {this, tasks.size()};
+        tasks.emplace_back(std::move(task));
+
+        // Al più tutti i task possono essere pronti insieme: `run`
+        // non alloca mai.
+        mainReady.reserve(tasks.size());
+
+        return tasks.size() - 1;
+    }
+
+    // `mBefore` deve essere completato prima di iniziare `mAfter`.
+    void precede(TaskId mBefore, TaskId mAfter)
+    {
+        tasks[mBefore]->dependents.emplace_back(mAfter);
+        ++tasks[mAfter]->dependencyCount;
+    }
+
+    const char* getName(TaskId mId) const noexcept
+    {
+        return tasks[mId]->name;
+    }
+
+    // Esegue tutti i task rispettando le dipendenze. Il thread
+    // chiamante esegue i task "main thread" e aiuta il pool finché
+    // il grafo non è completato.
+    void run(ThreadPool& mPool)
+    {
+        pool = &mPool;
+        unfinished = tasks.size();
+        error = nullptr;
+
+        for(auto& t : tasks) t->remaining = t->dependencyCount;
+
+        for(TaskId i{0}; i < tasks.size(); ++i)
+            if(tasks[i]->dependencyCount == 0) schedule(mPool, i);
+
+        while(unfinished > 0)
+            if(!runMainThreadTask(mPool) && !mPool.runOne())
+                std::this_thread::yield();
+
+        if(error) std::rethrow_exception(error);
+    }
+};
+
+// Un tipo di entità può dichiarare che il suo `update` non ha
+// effetti su altre entità definendo `static constexpr bool
+// isolatedUpdate{true}`. Solo questi tipi vengono aggiornati in
+// parallelo dal `Manager`.
+template <typename T, typename = void>
+struct HasIsolatedUpdate : std::false_type
+{
+};
+
+template <typename T>
+struct HasIsolatedUpdate<T, std::enable_if_t<T::isolatedUpdate>>
+    : std::true_type
+{
+};
+
+class Entity
+{
+private:
+    friend class Manager;
+    bool parallelUpdate{false};
+
+public:
+    bool destroyed{false};
+
+    virtual ~Entity() {}
+    virtual void update() {}
+    virtual void draw(sf::RenderWindow& mTarget) {}
+};
+
+// Un `EntitySpan` è una "finestra" contigua su un gruppo di entità
+// dello stesso tipo. Non possiede la memoria: è valido finché il
+// gruppo non viene modificato (`create`, `refresh` o `clear`).
+template <typename T>
+class EntitySpan
+{
+private:
+    Entity* const* ptrs{nullptr};
+    std::size_t count{0};
+
+public:
+    EntitySpan() = default;
+    EntitySpan(const std::vector<Entity*>& mGroup) noexcept
+        : ptrs{mGroup.data()}, count{mGroup.size()}
+    {
+    }
+
+    auto size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+
+    T& operator[](std::size_t mI) const noexcept
+    {
+        return *static_cast<T*>(ptrs[mI]);
+    }
+};
+
+// Una `View` raggruppa due span, ottenuti una sola volta, e permette
+// di iterare su tutte le coppie `(TA, TB)`. Opzionalmente si può
+// fornire una "broadphase" che scarta a priori le coppie che non
+// possono sovrapporsi.
+template <typename TA, typename TB>
+class View
+{
+private:
+    EntitySpan<TA> spanA;
+    EntitySpan<TB> spanB;
+
+public:
+    View(EntitySpan<TA> mA, EntitySpan<TB> mB) noexcept
+        : spanA{mA}, spanB{mB}
+    {
+    }
+
+    const auto& first() const noexcept { return spanA; }
+    const auto& second() const noexcept { return spanB; }
+
+    template <typename TFunc>
+    void forEachPair(TFunc mFunc) const
+    {
+        for(std::size_t iA{0}; iA < spanA.size(); ++iA)
+            for(std::size_t iB{0}; iB < spanB.size(); ++iB)
+                mFunc(spanA[iA], spanB[iB]);
+    }
+
+    // La broadphase deve essere già stata costruita su `second()`.
+    template <typename TBroadphase, typename TFunc>
+    void forEachPair(const TBroadphase& mBroadphase, TFunc mFunc) const
+    {
+        for(std::size_t iA{0}; iA < spanA.size(); ++iA)
+        {
+            auto& a(spanA[iA]);
+            mBroadphase.query(a, [&a, &mFunc](TB& mB)
+                {
+                    mFunc(a, mB);
+                });
+        }
+    }
+};
+
+// Broadphase "sweep and prune" su un singolo asse: le entità vengono
+// ordinate per `left()`, e una query visita solo quelle il cui
+// intervallo orizzontale può intersecare quello dell'entità data.
+template <typename T>
+class SweepBroadphase
+{
+private:
+    std::vector<T*> sorted;
+    float maxWidth{0.f};
+
+public:
+    void build(const EntitySpan<T>& mSpan)
+    {
+        sorted.clear();
+        maxWidth = 0.f;
+
+        for(std::size_t i{0}; i < mSpan.size(); ++i)
+        {
+            auto& e(mSpan[i]);
+            sorted.emplace_back(&e);
+            maxWidth = std::max(maxWidth, e.right() - e.left());
+        }
+
+        std::sort(std::begin(sorted), std::end(sorted), [](auto mA, auto mB)
+            {
+                return mA->left() < mB->left();
+            });
+    }
+
+    template <typename TOther, typename TFunc>
+    void query(const TOther& mOther, TFunc mFunc) const
+    {
+        auto itr(std::lower_bound(std::begin(sorted), std::end(sorted),
+            mOther.left() - maxWidth, [](auto mPtr, float mX)
+            {
+                return mPtr->left() < mX;
+            }));
+
+        for(; itr != std::end(sorted) && (*itr)->left() <= mOther.right();
+            ++itr)
+            if(isIntersecting(**itr, mOther)) mFunc(**itr);
+    }
+};
+
+class Manager
+{
+private:
+    std::vector<std::unique_ptr<Entity>> entities;
+    std::map<std::size_t, std::vector<Entity*>> groupedEntities;
+
+    // Le entità distrutte non vengono deallocate: finiscono in un
+    // "pool" in base al loro tipo dinamico, e `create` ne riutilizza
+    // la memoria ricostruendo l'oggetto "in-place". In questo modo
+    // restart ripetuti non allocano nuova memoria.
+    std::map<std::size_t, std::vector<std::unique_ptr<Entity>>> pools;
+
+    // Gruppi i cui elementi possono essere aggiornati in parallelo.
+    // I valori di una `std::map` hanno indirizzi stabili.
+    std::set<std::vector<Entity*>*> isolatedGroups;
+
+    void recycle(std::unique_ptr<Entity>& mUPtr)
+    {
+        pools[typeid(*mUPtr).hash_code()].emplace_back(std::move(mUPtr));
+    }
+
+    template <typename T, typename... TArgs>
+    auto acquire(TArgs&&... mArgs)
+    {
+        auto& pool(pools[typeid(T).hash_code()]);
+        if(pool.empty())
+            return std::unique_ptr<Entity>{
+                std::make_unique<T>(std::forward<TArgs>(mArgs)...)};
+
+        auto uPtr(std::move(pool.back()));
+        pool.pop_back();
+
+        // Il pool contiene solo oggetti di tipo `T`: possiamo
+        // distruggerli e ricostruirli nella stessa memoria.
+        auto ptr(static_cast<T*>(uPtr.get()));
+        ptr->~T();
+
+        try
+        {
+            new(ptr) T(std::forward<TArgs>(mArgs)...);
+        }
+        catch(...)
+        {
+            // L'oggetto è già stato distrutto: liberiamo solo la
+            // memoria, senza chiamare di nuovo il distruttore.
+            uPtr.release();
+            ::operator delete(ptr);
+            throw;
+        }
+
+        return uPtr;
+    }
+
+public:
+    template <typename T, typename... TArgs>
+    T& create(TArgs&&... mArgs)
+    {
+        static_assert(
+            std::is_base_of<Entity, T>(), "`T` must derive from `Entity`");
+
+        auto uPtr(acquire<T>(std::forward<TArgs>(mArgs)...));
+
+        auto ptr(static_cast<T*>(uPtr.get()));
+        ptr->parallelUpdate = HasIsolatedUpdate<T>{};
+
+        auto& group(groupedEntities[typeid(T).hash_code()]);
+        group.emplace_back(ptr);
+        if(HasIsolatedUpdate<T>{}) isolatedGroups.emplace(&group);
+
+        entities.emplace_back(std::move(uPtr));
+
+        return *ptr;
+    }
+
+    void refresh()
+    {
+        for(auto& pair : groupedEntities)
+        {
+            auto& vector(pair.second);
+
+            vector.erase(std::remove_if(std::begin(vector), std::end(vector),
+                             [](auto mPtr)
+                             {
+                                 return mPtr->destroyed;
+                             }),
+                std::end(vector));
+        }
+
+        for(auto& uPtr : entities)
+            if(uPtr->destroyed) recycle(uPtr);
+
+        entities.erase(
+            std::remove(std::begin(entities), std::end(entities), nullptr),
+            std::end(entities));
+    }
+
+    // Anche `clear` restituisce le entità ai pool, e mantiene la
+    // capacità dei vettori.
+    void clear()
+    {
+        for(auto& pair : groupedEntities) pair.second.clear();
+
+        for(auto& uPtr : entities) recycle(uPtr);
+        entities.clear();
+    }
+
+    template <typename T>
+    auto& getAll()
+    {
+        return groupedEntities[typeid(T).hash_code()];
+    }
+
+    template <typename T, typename TFunc>
+    void forEach(TFunc mFunc)
+    {
+        for(auto ptr : getAll<T>()) mFunc(*static_cast<T*>(ptr));
+    }
+
+    template <typename TA, typename TB>
+    auto view()
+    {
+        // Otteniamo entrambi i gruppi prima di costruire gli span:
+        // `getAll` può inserire nuove chiavi nella mappa.
+        auto& groupA(getAll<TA>());
+        auto& groupB(getAll<TB>());
+
+        return View<TA, TB>{groupA, groupB};
+    }
+
+    template <typename TA, typename TB, typename TFunc>
+    void forEachPair(TFunc mFunc)
+    {
+        view<TA, TB>().forEachPair(mFunc);
+    }
+
+    void update()
+    {
+        for(auto& e : entities) e->update();
+    }
+
+    // Versione parallela di `update`: le entità "non isolate" vengono
+    // aggiornate in ordine sul thread corrente, poi ogni gruppo
+    // isolato viene diviso in blocchi eseguiti sul thread pool.
+    void update(ThreadPool& mPool, std::size_t mGrain = 1024)
+    {
+        for(auto& e : entities)
+            if(!e->parallelUpdate) e->update();
+
+        for(auto group : isolatedGroups)
+            mPool.parallelFor(group->size(), mGrain,
+                [group](std::size_t mBegin, std::size_t mEnd)
+                {
+                    for(auto i(mBegin); i < mEnd; ++i) (*group)[i]->update();
+                });
+    }
+    void draw(sf::RenderWindow& mTarget)
+    {
+        for(auto& e : entities) e->draw(mTarget);
+    }
+};
+
+struct Rectangle
+{
+    sf::RectangleShape shape;
+
+    float x() const noexcept { return shape.getPosition().x; }
+    float y() const noexcept { return shape.getPosition().y; }
+    float width() const noexcept { return shape.getSize().x; }
+    float height() const noexcept { return shape.getSize().y; }
+    float left() const noexcept { return x() - width() / 2.f; }
+    float right() const noexcept { return x() + width() / 2.f; }
+    float top() const noexcept { return y() - height() / 2.f; }
+    float bottom() const noexcept { return y() + height() / 2.f; }
+};
+
+struct Circle
+{
+    sf::CircleShape shape;
+
+    float x() const noexcept { return shape.getPosition().x; }
+    float y() const noexcept { return shape.getPosition().y; }
+    float radius() const noexcept { return shape.getRadius(); }
+    float left() const noexcept { return x() - radius(); }
+    float right() const noexcept { return x() + radius(); }
+    float top() const noexcept { return y() - radius(); }
+    float bottom() const noexcept { return y() + radius(); }
+};
+
+class Ball : public Entity, public Circle
+{
+public:
+    static const sf::Color defColor;
+    static constexpr float defRadius{10.f}, defVelocity{8.f};
+
+    // `update` modifica solo la pallina stessa.
+    static constexpr bool isolatedUpdate{true};
+
+    sf::Vector2f velocity{-defVelocity, -defVelocity};
+
+    Ball(float mX, float mY)
+    {
+        shape.setPosition(mX, mY);
+        shape.setRadius(defRadius);
+        shape.setFillColor(defColor);
+        shape.setOrigin(defRadius, defRadius);
+    }
+
+    void update() override
+    {
+        shape.move(velocity);
+        solveBoundCollisions();
+    }
+
+    void draw(sf::RenderWindow& mTarget) override { mTarget.draw(shape); }
+
+private:
+    void solveBoundCollisions() noexcept
+    {
+        if(left() < 0 || right() > wndWidth) velocity.x *= -1.f;
+
+        if(top() < 0) velocity.y *= -1.f;
+
+        // Se la pallina ha lasciato la finestra in basso, deve
+        // essere distrutta.
+        else if(bottom() > wndHeight)
+            destroyed = true;
+    }
+};
+
+const sf::Color Ball::defColor{sf::Color::Red};
+
+class Paddle : public Entity, public Rectangle
+{
+public:
+    static const sf::Color defColor;
+    static constexpr float defWidth{75.f}, defHeight{20.f};
+    static constexpr float defVelocity{8.f};
+
+    // `update` legge solo l'input e modifica solo il paddle stesso.
+    static constexpr bool isolatedUpdate{true};
+
+    sf::Vector2f velocity;
+
+    // L'input viene letto una volta per frame, nella fase "input"
+    // del game loop, e copiato qui prima dell'`update`.
+    struct Input
+    {
+        bool left{false}, right{false};
+    };
+
+    Input input;
+
+    Paddle(float mX, float mY)
+    {
+        shape.setPosition(mX, mY);
+        shape.setSize({defWidth, defHeight});
+        shape.setFillColor(defColor);
+        shape.setOrigin(defWidth / 2.f, defHeight / 2.f);
+    }
+
+    void update() override
+    {
+        processPlayerInput();
+        shape.move(velocity);
+    }
+
+    void draw(sf::RenderWindow& mTarget) override { mTarget.draw(shape); }
+
+private:
+    void processPlayerInput()
+    {
+        if(input.left && left() > 0)
+            velocity.x = -defVelocity;
+        else if(input.right && right() < wndWidth)
+            velocity.x = defVelocity;
+        else
+            velocity.x = 0;
+    }
+};
+
+const sf::Color Paddle::defColor{sf::Color::Red};
+
+void solvePaddleBallCollision(const Paddle& mPaddle, Ball& mBall) noexcept
+{
+    if(!isIntersecting(mPaddle, mBall)) return;
+
+    auto newY(mPaddle.top() - mBall.shape.getRadius() * 2.f);
+    mBall.shape.setPosition(mBall.x(), newY);
+
+    auto paddleBallDiff(mBall.x() - mPaddle.x());
+    auto posFactor(paddleBallDiff / mPaddle.width());
+    auto velFactor(mPaddle.velocity.x * 0.05f);
+
+    sf::Vector2f collisionVec{posFactor + velFactor, -2.f};
+
+    mBall.velocity = getReflected(mBall.velocity, getNormalized(collisionVec));
+}
+
+// I livelli vengono salvati in un formato binario compatto e
+// versionato, pensato per essere letto direttamente dalla memoria
+// (mappata con `mmap`) senza alcun parsing. Il layout è:
+// * un `LevelHeader`;
+// * `spawnCount` strutture `LevelSpawn`;
+// * `width * height` byte, uno per cella, riga per riga.
+// I valori sono salvati nell'ordine dei byte della macchina.
+struct LevelHeader
+{
+    static constexpr char defMagic[4]{'A', 'R', 'K', 'L'};
+    static constexpr std::uint16_t defVersion{1};
+
+    char magic[4];
+    std::uint16_t version;
+    std::uint16_t spawnCount;
+    std::uint32_t width, height;
+
+    // Dimensioni di una cella, spaziatura tra le celle e centro
+    // della prima cella.
+    float cellWidth, cellHeight, spacing;
+    float originX, originY;
+};
+
+constexpr char LevelHeader::defMagic[4];
+
+struct LevelSpawn
+{
+    enum Type : std::uint32_t
+    {
+        Ball = 0,
+        Paddle = 1
+    };
+
+    std::uint32_t type;
+    float x, y;
+};
+
+static_assert(std::is_trivially_copyable<LevelHeader>() &&
+                  std::is_trivially_copyable<LevelSpawn>(),
+    "Level structures must be trivially copyable");
+
+// In ogni cella, i due bit meno significativi contengono i colpi
+// richiesti (0 = cella vuota). Gli altri bit sono riservati al tipo
+// di mattoncino.
+constexpr std::uint8_t levelCellHitsMask{0x3};
+
+// Una `LevelView` non possiede la memoria del livello: punta
+// direttamente ai dati validati.
+class LevelView
+{
+private:
+    const LevelHeader* header{nullptr};
+    const LevelSpawn* spawns{nullptr};
+    const std::uint8_t* cells{nullptr};
+
+public:
+    static bool fromMemory(
+        const void* mData, std::size_t mSize, LevelView& mView) noexcept
+    {
+        auto bytes(static_cast<const char*>(mData));
+        if(mSize < sizeof(LevelHeader)) return false;
+
+        auto h(reinterpret_cast<const LevelHeader*>(bytes));
+        if(std::memcmp(h->magic, LevelHeader::defMagic, 4) != 0 ||
+            h->version != LevelHeader::defVersion)
+            return false;
+
+        // La geometria deve essere sensata: `BrickField` divide per il
+        // passo delle celle, e gli indici delle celle sono a 32 bit.
+        auto cellCount(std::uint64_t(h->width) * h->height);
+        if(cellCount == 0 ||
+            cellCount > std::numeric_limits<std::uint32_t>::max())
+            return false;
+
+        if(!(h->cellWidth > 0.f) || !(h->cellHeight > 0.f) ||
+            !(h->spacing >= 0.f) || !std::isfinite(h->cellWidth) ||
+            !std::isfinite(h->cellHeight) || !std::isfinite(h->spacing) ||
+            !std::isfinite(h->originX) || !std::isfinite(h->originY))
+            return false;
+
+        auto required(sizeof(LevelHeader) +
+                      sizeof(LevelSpawn) * h->spawnCount + cellCount);
+        if(mSize < required) return false;
+
+        mView.header = h;
+        mView.spawns =
+            reinterpret_cast<const LevelSpawn*>(bytes + sizeof(LevelHeader));
+        mView.cells = reinterpret_cast<const std::uint8_t*>(
+            bytes + sizeof(LevelHeader) + sizeof(LevelSpawn) * h->spawnCount);
+
+        return true;
+    }
+
+    bool isValid() const noexcept { return header != nullptr; }
+    const LevelHeader& getHeader() const noexcept { return *header; }
+
+    auto getSpawnCount() const noexcept { return header->spawnCount; }
+    const auto& getSpawn(std::size_t mI) const noexcept
+    {
+        return spawns[mI];
+    }
+
+    int getHits(std::size_t mX, std::size_t mY) const noexcept
+    {
+        return cells[mY * header->width + mX] & levelCellHitsMask;
+    }
+
+    // Centro della cella `(mX, mY)` in coordinate del mondo.
+    sf::Vector2f getCellCenter(std::size_t mX, std::size_t mY) const noexcept
+    {
+        return {header->originX + mX * (header->cellWidth + header->spacing),
+            header->originY + mY * (header->cellHeight + header->spacing)};
+    }
+};
+
+// Un file mappato in memoria in sola lettura.
+class MappedFile
+{
+private:
+    void* data{nullptr};
+    std::size_t size{0};
+
+    void unmap() noexcept
+    {
+        if(data != nullptr) ::munmap(data, size);
+        data = nullptr;
+        size = 0;
+    }
+
+public:
+    MappedFile() = default;
+    ~MappedFile() { unmap(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& mPath)
+    {
+        unmap();
+
+        auto fd(::open(mPath.c_str(), O_RDONLY));
+        if(fd < 0) return false;
+
+        struct stat st;
+        if(::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            auto ptr(
+                ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+            if(ptr != MAP_FAILED)
+            {
+                data = ptr;
+                size = st.st_size;
+            }
+        }
+
+        // Il mapping resta valido anche dopo la chiusura del file.
+        ::close(fd);
+        return data != nullptr;
+    }
+
+    void swap(MappedFile& mOther) noexcept
+    {
+        std::swap(data, mOther.data);
+        std::swap(size, mOther.size);
+    }
+
+    const void* getData() const noexcept { return data; }
+    auto getSize() const noexcept { return size; }
+};
+
+// Costruisce un livello in memoria, nello stesso formato dei file.
+std::vector<char> buildLevel(LevelHeader mHeader,
+    const std::vector<LevelSpawn>& mSpawns,
+    const std::vector<std::uint8_t>& mCells)
+{
+    std::memcpy(mHeader.magic, LevelHeader::defMagic, 4);
+    mHeader.version = LevelHeader::defVersion;
+    mHeader.spawnCount = mSpawns.size();
+
+    std::vector<char> result(sizeof(LevelHeader) +
+                             sizeof(LevelSpawn) * mSpawns.size() +
+                             mCells.size());
+
+    auto ptr(result.data());
+    std::memcpy(ptr, &mHeader, sizeof(LevelHeader));
+    ptr += sizeof(LevelHeader);
+
+    if(!mSpawns.empty())
+        std::memcpy(ptr, mSpawns.data(), sizeof(LevelSpawn) * mSpawns.size());
+    ptr += sizeof(LevelSpawn) * mSpawns.size();
+
+    if(!mCells.empty()) std::memcpy(ptr, mCells.data(), mCells.size());
+    return result;
+}
+
+// Rettangolo allineato agli assi, con la stessa interfaccia di
+// `Rectangle`, usato per le celle della griglia di mattoncini.
+struct Box
+{
+    float l, t, r, b;
+
+    float x() const noexcept { return (l + r) / 2.f; }
+    float y() const noexcept { return (t + b) / 2.f; }
+    float left() const noexcept { return l; }
+    float right() const noexcept { return r; }
+    float top() const noexcept { return t; }
+    float bottom() const noexcept { return b; }
+};
+
+// Un mattoncino è definito solo dalla sua cella (che implica la
+// posizione) e dai colpi richiesti (da 1 a 3). Invece di creare
+// un'entità per ogni mattoncino, il `BrickField` li conserva in una
+// griglia compatta:
+// * 2 bit per cella con i colpi richiesti;
+// * una bitset per riga con le celle occupate, che permette di
+//   contare e visitare velocemente i mattoncini rimasti.
+class BrickField
+{
+public:
+    static const sf::Color defClHits1;
+    static const sf::Color defClHits2;
+    static const sf::Color defClHits3;
+    static constexpr float defWidth{60.f}, defHeight{20.f};
+
+private:
+    static constexpr std::uint32_t cellsPerHitWord{32};
+
+    std::uint32_t width{0}, height{0}, wordsPerRow{0};
+    float cellWidth{defWidth}, cellHeight{defHeight};
+    float pitchX{defWidth}, pitchY{defHeight};
+
+    // Angolo in alto a sinistra della cella `(0, 0)`.
+    float gridLeft{0.f}, gridTop{0.f};
+
+    std::vector<std::uint64_t> hitWords;
+    std::vector<std::uint64_t> rowBits;
+
+    // Celle modificate dall'ultima chiamata a `clearChanges`, e un
+    // contatore incrementato ad ogni `assign`. Servono al rendering.
+    std::vector<std::uint32_t> changedCells;
+    std::uint64_t generation{0};
+
+    void setHits(std::uint32_t mCell, int mHits) noexcept
+    {
+        auto& word(hitWords[mCell / cellsPerHitWord]);
+        auto shift((mCell % cellsPerHitWord) * 2);
+        word = (word & ~(std::uint64_t(3) << shift)) |
+               (std::uint64_t(mHits) << shift);
+
+        auto x(mCell % width), y(mCell / width);
+        auto& bits(rowBits[y * wordsPerRow + x / 64]);
+        auto mask(std::uint64_t(1) << (x % 64));
+        bits = mHits > 0 ? (bits | mask) : (bits & ~mask);
+    }
+
+    // Visita le celle occupate della riga `mY` con `mX0 <= x <= mX1`.
+    template <typename TFunc>
+    void forEachLiveInRow(std::uint32_t mY, std::uint32_t mX0,
+        std::uint32_t mX1, TFunc&& mFunc) const
+    {
+        const auto* row(&rowBits[mY * wordsPerRow]);
+
+        for(auto w(mX0 / 64); w <= mX1 / 64; ++w)
+        {
+            auto bits(row[w]);
+
+            // Mascheriamo i bit fuori dall'intervallo richiesto.
+            if(w == mX0 / 64) bits &= ~std::uint64_t(0) << (mX0 % 64);
+            if(w == mX1 / 64 && mX1 % 64 != 63)
+                bits &= (std::uint64_t(1) << (mX1 % 64 + 1)) - 1;
+
+            while(bits != 0)
+            {
+                auto x(w * 64 + __builtin_ctzll(bits));
+                mFunc(mY * width + x);
+                bits &= bits - 1;
+            }
+        }
+    }
+
+public:
+    void assign(const LevelView& mLevel)
+    {
+        const auto& h(mLevel.getHeader());
+
+        width = h.width;
+        height = h.height;
+        wordsPerRow = (width + 63) / 64;
+        cellWidth = h.cellWidth;
+        cellHeight = h.cellHeight;
+        pitchX = h.cellWidth + h.spacing;
+        pitchY = h.cellHeight + h.spacing;
+        gridLeft = h.originX - cellWidth / 2.f;
+        gridTop = h.originY - cellHeight / 2.f;
+
+        auto cellCount(std::size_t(width) * height);
+        hitWords.assign((cellCount + cellsPerHitWord - 1) / cellsPerHitWord, 0);
+        rowBits.assign(std::size_t(wordsPerRow) * height, 0);
+
+        for(std::uint32_t iY{0}; iY < height; ++iY)
+            for(std::uint32_t iX{0}; iX < width; ++iX)
+                setHits(iY * width + iX, mLevel.getHits(iX, iY));
+
+        changedCells.clear();
+        ++generation;
+    }
+
+    auto getWidth() const noexcept { return width; }
+    auto getHeight() const noexcept { return height; }
+
+    int getHits(std::uint32_t mCell) const noexcept
+    {
+        auto shift((mCell % cellsPerHitWord) * 2);
+        return (hitWords[mCell / cellsPerHitWord] >> shift) & 3;
+    }
+
+    Box getCellBox(std::uint32_t mCell) const noexcept
+    {
+        auto l(gridLeft + (mCell % width) * pitchX);
+        auto t(gridTop + (mCell / width) * pitchY);
+        return {l, t, l + cellWidth, t + cellHeight};
+    }
+
+    // Trova in O(1) la cella che contiene `mPos`. Restituisce `false`
+    // se il punto è fuori dalla griglia o nello spazio tra le celle.
+    bool getCellAt(sf::Vector2f mPos, std::uint32_t& mCell) const noexcept
+    {
+        auto fx((mPos.x - gridLeft) / pitchX);
+        auto fy((mPos.y - gridTop) / pitchY);
+        if(fx < 0.f || fy < 0.f || fx >= width || fy >= height) return false;
+
+        auto x(static_cast<std::uint32_t>(fx));
+        auto y(static_cast<std::uint32_t>(fy));
+        if((fx - x) * pitchX > cellWidth || (fy - y) * pitchY > cellHeight)
+            return false;
+
+        mCell = y * width + x;
+        return true;
+    }
+
+    // Numero di mattoncini rimasti, contando i bit delle righe.
+    std::size_t countLive() const noexcept
+    {
+        std::size_t result{0};
+        for(auto bits : rowBits) result += __builtin_popcountll(bits);
+        return result;
+    }
+
+    template <typename TFunc>
+    void forEachLive(TFunc&& mFunc) const
+    {
+        if(width == 0) return;
+        for(std::uint32_t iY{0}; iY < height; ++iY)
+            forEachLiveInRow(iY, 0, width - 1, mFunc);
+    }
+
+    // Visita le celle occupate che possono intersecare `mBox`.
+    template <typename T, typename TFunc>
+    void forEachLiveNear(const T& mBox, TFunc&& mFunc) const
+    {
+        auto toCell([](float mV, float mPitch, std::uint32_t mCount)
+            {
+                return static_cast<std::int64_t>(std::min(
+                    std::max(std::floor(mV / mPitch), -1.f), float(mCount)));
+            });
+
+        auto x0(toCell(mBox.left() - gridLeft, pitchX, width));
+        auto x1(toCell(mBox.right() - gridLeft, pitchX, width));
+        auto y0(toCell(mBox.top() - gridTop, pitchY, height));
+        auto y1(toCell(mBox.bottom() - gridTop, pitchY, height));
+
+        x0 = std::max<std::int64_t>(x0, 0);
+        y0 = std::max<std::int64_t>(y0, 0);
+        x1 = std::min<std::int64_t>(x1, std::int64_t(width) - 1);
+        y1 = std::min<std::int64_t>(y1, std::int64_t(height) - 1);
+        if(x0 > x1 || y0 > y1) return;
+
+        for(auto iY(y0); iY <= y1; ++iY)
+            forEachLiveInRow(iY, x0, x1, mFunc);
+    }
+
+    // Toglie un colpo al mattoncino. Restituisce `true` se è stato
+    // distrutto.
+    bool damage(std::uint32_t mCell)
+    {
+        auto hits(getHits(mCell));
+        if(hits == 0) return false;
+
+        setHits(mCell, hits - 1);
+        changedCells.emplace_back(mCell);
+        return hits == 1;
+    }
+
+    const auto& getChangedCells() const noexcept { return changedCells; }
+    void clearChanges() noexcept { changedCells.clear(); }
+    auto getGeneration() const noexcept { return generation; }
+
+    static const sf::Color& getColor(int mHits) noexcept
+    {
+        if(mHits == 1) return defClHits1;
+        if(mHits == 2) return defClHits2;
+        return defClHits3;
+    }
+};
+
+const sf::Color BrickField::defClHits1{255, 255, 0, 80};
+const sf::Color BrickField::defClHits2{255, 255, 0, 170};
+const sf::Color BrickField::defClHits3{255, 255, 0, 255};
+
+// Disegna un `BrickField` come un singolo `sf::VertexArray`. I
+// vertici vengono ricostruiti solo quando cambia il livello; ad ogni
+// frame vengono aggiornati solo i colori delle celle modificate.
+class BrickFieldRenderer
+{
+private:
+    sf::VertexArray quads{sf::Quads};
+    std::vector<std::uint32_t> cellIds;
+    std::uint64_t generation{0};
+
+    void setColor(std::size_t mQuad, sf::Color mColor) noexcept
+    {
+        for(std::size_t i{0}; i < 4; ++i) quads[mQuad * 4 + i].color = mColor;
+    }
+
+public:
+    void sync(const BrickField& mField)
+    {
+        if(generation != mField.getGeneration())
+        {
+            generation = mField.getGeneration();
+            quads.clear();
+            cellIds.clear();
+
+            mField.forEachLive([&](std::uint32_t mCell)
+                {
+                    auto box(mField.getCellBox(mCell));
+                    const auto& color(
+                        BrickField::getColor(mField.getHits(mCell)));
+
+                    quads.append({{box.l, box.t}, color});
+                    quads.append({{box.r, box.t}, color});
+                    quads.append({{box.r, box.b}, color});
+                    quads.append({{box.l, box.b}, color});
+                    cellIds.emplace_back(mCell);
+                });
+
+            return;
+        }
+
+        // `cellIds` è ordinato: troviamo il quad di ogni cella
+        // modificata con una ricerca binaria.
+        for(auto cell : mField.getChangedCells())
+        {
+            auto itr(std::lower_bound(
+                std::begin(cellIds), std::end(cellIds), cell));
+            if(itr == std::end(cellIds) || *itr != cell) continue;
+
+            auto hits(mField.getHits(cell));
+            setColor(itr - std::begin(cellIds),
+                hits > 0 ? BrickField::getColor(hits) : sf::Color::Transparent);
+        }
+    }
+
+    void draw(sf::RenderWindow& mTarget) const { mTarget.draw(quads); }
+};
+
+// Invece di risolvere immediatamente ogni collisione, la fase di
+// "narrowphase" produce una lista di contatti. In questo modo la
+// rilevazione può avvenire in parallelo, e la risoluzione non
+// dipende dall'ordine in cui i mattoncini sono stati visitati.
+struct BrickContact
+{
+    std::uint32_t cell;
+
+    // Normale uscente dal mattoncino verso la pallina, lungo l'asse
+    // di minima compenetrazione.
+    sf::Vector2f normal;
+    float penetration;
+};
+
+bool findBrickBallContact(std::uint32_t mCell, const Box& mBrick,
+    const Ball& mBall, BrickContact& mContact) noexcept
+{
+    if(!isIntersecting(mBrick, mBall)) return false;
+
+    auto overlapLeft(mBall.right() - mBrick.left());
+    auto overlapRight(mBrick.right() - mBall.left());
+    auto overlapTop(mBall.bottom() - mBrick.top());
+    auto overlapBottom(mBrick.bottom() - mBall.top());
+
+    auto bFromLeft(std::abs(overlapLeft) < std::abs(overlapRight));
+    auto bFromTop(std::abs(overlapTop) < std::abs(overlapBottom));
+
+    auto minOverlapX(std::abs(bFromLeft ? overlapLeft : overlapRight));
+    auto minOverlapY(std::abs(bFromTop ? overlapTop : overlapBottom));
+
+    mContact.cell = mCell;
+
+    if(minOverlapX < minOverlapY)
+    {
+        mContact.normal = {bFromLeft ? -1.f : 1.f, 0.f};
+        mContact.penetration = minOverlapX;
+    }
+    else
+    {
+        mContact.normal = {0.f, bFromTop ? -1.f : 1.f};
+        mContact.penetration = minOverlapY;
+    }
+
+    return true;
+}
+
+// Risolve tutti i contatti di una pallina in un solo passo: i
+// contatti vengono ordinati con un criterio che dipende solo dalla
+// geometria, e per ogni asse viene usata la normale del contatto più
+// profondo. Due mattoncini adiacenti colpiti nello stesso frame
+// riflettono quindi la velocità una sola volta.
+void resolveBallContacts(Ball& mBall, std::vector<BrickContact>& mContacts)
+{
+    if(mContacts.empty()) return;
+
+    std::sort(std::begin(mContacts), std::end(mContacts),
+        [](const auto& mA, const auto& mB)
+        {
+            if(mA.penetration != mB.penetration)
+                return mA.penetration > mB.penetration;
+
+            return mA.cell < mB.cell;
+        });
+
+    bool resolvedX{false}, resolvedY{false};
+
+    for(const auto& c : mContacts)
+    {
+        if(c.normal.x != 0.f && !resolvedX)
+        {
+            mBall.velocity.x = std::abs(mBall.velocity.x) * c.normal.x;
+            resolvedX = true;
+        }
+        else if(c.normal.y != 0.f && !resolvedY)
+        {
+            mBall.velocity.y = std::abs(mBall.velocity.y) * c.normal.y;
+            resolvedY = true;
+        }
+    }
+}
+
+// Ogni mattoncino toccato perde un colpo per ogni pallina che lo ha
+// toccato, indipendentemente da quanti thread hanno prodotto i
+// contatti. Restituisce il numero di mattoncini distrutti.
+int applyBrickDamage(
+    BrickField& mField, const std::vector<BrickContact>& mContacts)
+{
+    int destroyedCount{0};
+    for(const auto& c : mContacts)
+        if(mField.damage(c.cell)) ++destroyedCount;
+
+    return destroyedCount;
+}
+
+// Il livello originale: 11x4 mattoncini, con un numero di colpi
+// richiesti che segue un pattern periodico.
+std::vector<char> buildDefaultLevel()
+{
+    constexpr int brkCountX{11}, brkCountY{4};
+    constexpr int brkStartCol{1}, brkStartRow{2};
+    constexpr float brkSpacing{3.f}, brkOffsetX{22.f};
+
+    LevelHeader h;
+    h.width = brkCountX;
+    h.height = brkCountY;
+    h.cellWidth = BrickField::defWidth;
+    h.cellHeight = BrickField::defHeight;
+    h.spacing = brkSpacing;
+    h.originX = brkOffsetX + brkStartCol * (BrickField::defWidth + brkSpacing);
+    h.originY = brkStartRow * (BrickField::defHeight + brkSpacing);
+
+    std::vector<std::uint8_t> cells(brkCountX * brkCountY);
+    for(int iX{0}; iX < brkCountX; ++iX)
+        for(int iY{0}; iY < brkCountY; ++iY)
+            cells[iY * brkCountX + iX] = 1 + ((iX * iY) % 3);
+
+    return buildLevel(h,
+        {{LevelSpawn::Ball, wndWidth / 2.f, wndHeight / 2.f},
+            {LevelSpawn::Paddle, wndWidth / 2.f, wndHeight - 50.f}},
+        cells);
+}
+
+// Parametri per la generazione procedurale di un livello. A parità
+// di parametri (seed compreso) il livello generato è identico.
+struct LevelGenParams
+{
+    enum class Pattern
+    {
+        Solid,
+        Checker,
+        Stripes,
+        Diamond,
+        Random
+    };
+
+    std::uint64_t seed{0};
+    Pattern pattern{Pattern::Random};
+    std::uint32_t width{11}, height{4};
+
+    // Probabilità che una cella prevista dal pattern sia occupata.
+    float density{1.f};
+
+    // Pesi relativi dei mattoncini da 1, 2 e 3 colpi.
+    std::array<float, 3> hitWeights{{0.5f, 0.3f, 0.2f}};
+};
+
+bool parsePattern(const std::string& mName, LevelGenParams::Pattern& mOut)
+{
+    using P = LevelGenParams::Pattern;
+    static const std::map<std::string, P> names{{"solid", P::Solid},
+        {"checker", P::Checker}, {"stripes", P::Stripes},
+        {"diamond", P::Diamond}, {"random", P::Random}};
+
+    auto itr(names.find(mName));
+    if(itr == std::end(names)) return false;
+
+    mOut = itr->second;
+    return true;
+}
+
+// Genera un livello procedurale. Le celle vengono ridimensionate
+// (fino a `BrickField::defWidth` x `BrickField::defHeight`) in modo che la
+// griglia occupi la metà superiore della finestra: con griglie
+// enormi i mattoncini diventano più piccoli di un pixel.
+std::vector<char> generateLevel(const LevelGenParams& mParams)
+{
+    using P = LevelGenParams::Pattern;
+
+    // Usiamo direttamente i bit del generatore invece delle
+    // distribuzioni della libreria standard, la cui implementazione
+    // può cambiare tra compilatori.
+    std::mt19937_64 rng{mParams.seed};
+    auto unit([&rng]
+        {
+            return (rng() >> 40) * (1.f / (1 << 24));
+        });
+
+    constexpr float margin{20.f}, top{40.f};
+    auto pitchX(std::min(BrickField::defWidth * 1.05f,
+        (wndWidth - 2.f * margin) / std::max(1u, mParams.width)));
+    auto pitchY(std::min(BrickField::defHeight * 1.15f,
+        (wndHeight * 0.5f - top) / std::max(1u, mParams.height)));
+
+    LevelHeader h;
+    h.width = mParams.width;
+    h.height = mParams.height;
+    h.cellWidth = pitchX * 0.95f;
+    h.cellHeight = pitchY * 0.87f;
+    h.spacing = std::min(pitchX - h.cellWidth, pitchY - h.cellHeight);
+    h.originX = (wndWidth - h.width * pitchX) / 2.f + pitchX / 2.f;
+    h.originY = top + pitchY / 2.f;
+
+    // La spaziatura è la stessa sui due assi: ricalcoliamo le
+    // dimensioni delle celle di conseguenza.
+    h.cellWidth = pitchX - h.spacing;
+    h.cellHeight = pitchY - h.spacing;
+
+    auto weightSum(mParams.hitWeights[0] + mParams.hitWeights[1] +
+                   mParams.hitWeights[2]);
+
+    auto inPattern([&mParams](std::uint32_t mX, std::uint32_t mY)
+        {
+            auto cx((mParams.width - 1) / 2.f), cy((mParams.height - 1) / 2.f);
+
+            switch(mParams.pattern)
+            {
+                case P::Checker: return (mX + mY) % 2 == 0;
+                case P::Stripes: return mY % 2 == 0;
+                case P::Diamond:
+                    return std::abs(mX - cx) / std::max(cx, 1.f) +
+                               std::abs(mY - cy) / std::max(cy, 1.f) <=
+                           1.f;
+                default: return true;
+            }
+        });
+
+    std::vector<std::uint8_t> cells(std::size_t(h.width) * h.height, 0);
+    for(std::uint32_t iY{0}; iY < h.height; ++iY)
+        for(std::uint32_t iX{0}; iX < h.width; ++iX)
+        {
+            if(!inPattern(iX, iY) || unit() >= mParams.density) continue;
+
+            auto r(unit() * weightSum);
+            std::uint8_t hits{3};
+            if(r < mParams.hitWeights[0])
+                hits = 1;
+            else if(r < mParams.hitWeights[0] + mParams.hitWeights[1])
+                hits = 2;
+
+            cells[std::size_t(iY) * h.width + iX] = hits;
+        }
+
+    return buildLevel(h,
+        {{LevelSpawn::Ball, wndWidth / 2.f, wndHeight * 0.75f},
+            {LevelSpawn::Paddle, wndWidth / 2.f, wndHeight - 50.f}},
+        cells);
+}
+
+// Converte un livello dal formato testuale a quello binario. Il
+// formato testuale è:
+//
+//     # commento
+//     grid <larghezza> <altezza>
+//     cell <larghezza> <altezza> <spaziatura>
+//     origin <x> <y>
+//     spawn ball|paddle <x> <y>
+//     rows
+//     <una riga per ogni riga della griglia: '.' per le celle
+//      vuote, '1'-'3' per i colpi richiesti>
+//
+// `grid` deve precedere `rows`, e ogni riga della griglia deve avere
+// esattamente `<larghezza>` celle.
+bool convertLevel(const std::string& mTextPath, const std::string& mBinPath)
+{
+    std::ifstream in{mTextPath};
+    if(!in)
+    {
+        std::cerr << "Cannot open `" << mTextPath << "`\n";
+        return false;
+    }
+
+    LevelHeader h{};
+    h.cellWidth = BrickField::defWidth;
+    h.cellHeight = BrickField::defHeight;
+    std::vector<LevelSpawn> spawns;
+    std::vector<std::uint8_t> cells;
+
+    // Gli errori riportano la riga del file testuale che li causa.
+    std::size_t lineNumber{0};
+    auto fail([&](const std::string& mError)
+        {
+            std::cerr << mTextPath << ":" << lineNumber << ": " << mError
+                      << "\n";
+            return false;
+        });
+
+    bool hasGrid{false}, hasRows{false};
+
+    std::string line;
+    while(std::getline(in, line))
+    {
+        ++lineNumber;
+
+        std::istringstream ss{line};
+        std::string key;
+        if(!(ss >> key) || key[0] == '#') continue;
+
+        if(key == "grid")
+        {
+            // Le dimensioni servono per leggere le righe: non possono
+            // cambiare dopo `rows`.
+            if(hasRows) return fail("`grid` after `rows`");
+            if(!(ss >> h.width >> h.height))
+                return fail("malformed line `" + line + "`");
+
+            if(h.width == 0 || h.height == 0 ||
+                std::uint64_t(h.width) * h.height >
+                    std::numeric_limits<std::uint32_t>::max())
+                return fail("invalid grid size");
+
+            hasGrid = true;
+        }
+        else if(key == "cell")
+        {
+            ss >> h.cellWidth >> h.cellHeight >> h.spacing;
+            if(!ss.fail() &&
+                (!std::isfinite(h.cellWidth) || !std::isfinite(h.cellHeight) ||
+                    !std::isfinite(h.spacing) || !(h.cellWidth > 0.f) ||
+                    !(h.cellHeight > 0.f) || !(h.spacing >= 0.f)))
+                return fail("invalid cell size or spacing");
+        }
+        else if(key == "origin")
+        {
+            ss >> h.originX >> h.originY;
+            if(!ss.fail() &&
+                (!std::isfinite(h.originX) || !std::isfinite(h.originY)))
+                return fail("invalid origin");
+        }
+        else if(key == "spawn")
+        {
+            std::string type;
+            LevelSpawn spawn;
+            ss >> type >> spawn.x >> spawn.y;
+
+            if(type == "ball")
+                spawn.type = LevelSpawn::Ball;
+            else if(type == "paddle")
+                spawn.type = LevelSpawn::Paddle;
+            else
+                return fail("unknown spawn type `" + type + "`");
+
+            spawns.emplace_back(spawn);
+        }
+        else if(key == "rows")
+        {
+            if(!hasGrid) return fail("`rows` before `grid`");
+            if(hasRows) return fail("duplicate `rows` section");
+            hasRows = true;
+
+            cells.reserve(std::size_t(h.width) * h.height);
+
+            for(std::uint32_t iY{0}; iY < h.height; ++iY)
+            {
+                if(!std::getline(in, line))
+                    return fail("missing grid rows: expected " +
+                                std::to_string(h.height));
+                ++lineNumber;
+
+                // Tolleriamo i file con terminatori di riga Windows.
+                if(!line.empty() && line.back() == '\r') line.pop_back();
+
+                if(line.size() != h.width)
+                    return fail("grid row has " +
+                                std::to_string(line.size()) +
+                                " cells, expected " +
+                                std::to_string(h.width));
+
+                for(auto c : line)
+                {
+                    if(c == '.')
+                        cells.emplace_back(0);
+                    else if(c >= '1' && c <= '3')
+                        cells.emplace_back(c - '0');
+                    else
+                        return fail("invalid cell `" + std::string(1, c) + "`");
+                }
+            }
+        }
+        else
+            return fail("unknown key `" + key + "`");
+
+        if(ss.fail()) return fail("malformed line `" + line + "`");
+    }
+
+    if(!hasRows) return fail("missing `rows` section");
+
+    auto blob(buildLevel(h, spawns, cells));
+
+    std::ofstream out{mBinPath, std::ios::binary};
+    out.write(blob.data(), blob.size());
+    if(!out)
+    {
+        std::cerr << "Cannot write `" << mBinPath << "`\n";
+        return false;
+    }
+
+    return true;
+}
+
+// Compilando con `-DARKANOID_EMBEDDED_FONT='"font.inc"'` viene
+// incluso un font di riserva. Il file deve definire
+// `embeddedFontData` e `embeddedFontSize`, ad esempio partendo
+// dall'output di `xxd -i`.
+#ifdef ARKANOID_EMBEDDED_FONT
+#include ARKANOID_EMBEDDED_FONT
+#endif
+
+// Un `AssetManager` carica le risorse (font, e in futuro texture,
+// suoni e livelli) su un thread dedicato, per non bloccare l'avvio
+// della finestra. Le richieste per lo stesso file vengono
+// de-duplicate, e i file vengono cercati in una lista di percorsi.
+class AssetManager
+{
+private:
+    struct AssetBase
+    {
+        enum class Status
+        {
+            Loading,
+            Loaded,
+            Failed
+        };
+
+        std::atomic<Status> status{Status::Loading};
+        virtual ~AssetBase() {}
+    };
+
+public:
+    template <typename T>
+    class Asset : public AssetBase
+    {
+    private:
+        friend class AssetManager;
+        T resource;
+
+    public:
+        // Pronto quando il caricamento è terminato, anche se fallito.
+        bool isReady() const noexcept { return status != Status::Loading; }
+        bool isLoaded() const noexcept { return status == Status::Loaded; }
+
+        // Usabile solo dopo che `isLoaded` ha restituito `true`.
+        // Prima, il `T` può essere passato solo per riferimento
+        // (ad esempio a `sf::Text::setFont`).
+        const T& get() const noexcept { return resource; }
+    };
+
+private:
+    std::vector<std::string> searchPaths;
+    std::map<std::pair<std::size_t, std::string>, std::unique_ptr<AssetBase>>
+        assets;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> jobs;
+    bool running{true};
+    std::thread loader;
+
+    static bool loadFromFile(sf::Font& mFont, const std::string& mPath)
+    {
+        return mFont.loadFromFile(mPath);
+    }
+
+    // Se nessun percorso contiene il font, usiamo quello incluso
+    // nell'eseguibile tramite `-DARKANOID_EMBEDDED_FONT`.
+    static bool loadFallback(sf::Font& mFont)
+    {
+#ifdef ARKANOID_EMBEDDED_FONT
+        return mFont.loadFromMemory(embeddedFontData, embeddedFontSize);
+#else
+        (void)mFont;
+        return false;
+#endif
+    }
+
+    template <typename T>
+    void load(Asset<T>& mAsset, const std::string& mName)
+    {
+        auto loaded(false);
+
+        if(!mName.empty() && mName.front() == '/')
+            loaded = loadFromFile(mAsset.resource, mName);
+
+        for(const auto& p : searchPaths)
+        {
+            if(loaded) break;
+            loaded = loadFromFile(mAsset.resource, p + "/" + mName);
+        }
+
+        if(!loaded)
+        {
+            loaded = loadFallback(mAsset.resource);
+            std::cerr << "Asset `" << mName << "` not found"
+                      << (loaded ? ", using fallback\n" : "\n");
+        }
+
+        mAsset.status =
+            loaded ? AssetBase::Status::Loaded : AssetBase::Status::Failed;
+    }
+
+    void loaderLoop()
+    {
+        while(true)
+        {
+            std::function<void()> job;
+
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                cv.wait(lock, [this]
+                    {
+                        return !running || !jobs.empty();
+                    });
+
+                if(!running) return;
+
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            job();
+        }
+    }
+
+public:
+    AssetManager(std::vector<std::string> mSearchPaths)
+        : searchPaths{std::move(mSearchPaths)}, loader{[this]
+              {
+                  loaderLoop();
+              }}
+    {
+    }
+
+    ~AssetManager()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            running = false;
+        }
+
+        cv.notify_all();
+        loader.join();
+    }
+
+    // Restituisce subito l'asset, che verrà caricato in background.
+    // Richieste successive per lo stesso nome restituiscono lo
+    // stesso asset.
+    template <typename T>
+    const Asset<T>& request(const std::string& mName)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        auto& slot(assets[{typeid(T).hash_code(), mName}]);
+        if(slot != nullptr) return static_cast<Asset<T>&>(*slot);
+
+        auto asset(std::make_unique<Asset<T>>());
+        auto ptr(asset.get());
+        slot = std::move(asset);
+
+        jobs.emplace_back([this, ptr, mName]
+            {
+                load(*ptr, mName);
+            });
+        cv.notify_one();
+
+        return *ptr;
+    }
+
+    // Vero se tutte le risorse richieste finora sono pronte.
+    bool isIdle()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        for(const auto& pair : assets)
+            if(pair.second->status == AssetBase::Status::Loading)
+                return false;
+
+        return true;
+    }
+};
+
+// Un `HudText` è un testo dell'interfaccia legato ad un valore.
+// `refresh` confronta il valore con quello mostrato e rigenera la
+// stringa (e quindi la geometria dei glifi di `sf::Text`) solo se è
+// cambiato. I numeri vengono formattati in un buffer fisso, senza
+// allocazioni.
+class HudText
+{
+private:
+    sf::Text text;
+    std::array<char, 64> buffer;
+
+    const char* prefix{""};
+    const int* boundValue{nullptr};
+
+    // Come un `ThreadPool::Job`: una funzione e il contesto con cui
+    // chiamarla.
+    const char* (*labelFunc)(const void*){nullptr};
+    const void* labelContext{nullptr};
+
+    int lastValue{0};
+    const char* lastLabel{nullptr};
+    bool dirty{true};
+
+    // Tutti i caratteri che il testo può mostrare.
+    unsigned int characterSize;
+    std::string glyphSet;
+
+    void formatValue(int mValue) noexcept
+    {
+        auto prefixLen(std::min(std::strlen(prefix), buffer.size() - 16));
+        std::memcpy(buffer.data(), prefix, prefixLen);
+
+        // Scriviamo le cifre al contrario in un buffer temporaneo.
+        std::array<char, 12> digits;
+        std::size_t count{0};
+        auto negative(mValue < 0);
+        auto abs(negative ? -static_cast<long>(mValue) : mValue);
+
+        do
+        {
+            digits[count++] = '0' + abs % 10;
+            abs /= 10;
+        } while(abs > 0);
+
+        auto pos(prefixLen);
+        if(negative) buffer[pos++] = '-';
+        while(count > 0) buffer[pos++] = digits[--count];
+        buffer[pos] = '\0';
+    }
+
+public:
+    HudText(const sf::Font& mFont, unsigned int mSize, float mX, float mY)
+        : characterSize{mSize}
+    {
+        text.setFont(mFont);
+        text.setPosition(mX, mY);
+        text.setCharacterSize(mSize);
+        text.setColor(sf::Color::White);
+    }
+
+    // Lega il testo ad un intero, mostrato dopo `mPrefix`. Entrambi
+    // devono sopravvivere al widget.
+    void bind(const char* mPrefix, const int& mValue)
+    {
+        prefix = mPrefix;
+        boundValue = &mValue;
+        dirty = true;
+
+        glyphSet = std::string{mPrefix} + "-0123456789";
+    }
+
+    // Lega il testo ad una funzione che restituisce stringhe con
+    // durata statica: basta confrontare i puntatori. La funzione
+    // riceve `mContext`, che deve sopravvivere al widget. `mLabels`
+    // elenca tutte le stringhe che la funzione può restituire.
+    void bind(const char* (*mLabel)(const void*), const void* mContext,
+        std::initializer_list<const char*> mLabels)
+    {
+        labelFunc = mLabel;
+        labelContext = mContext;
+        dirty = true;
+
+        glyphSet.clear();
+        for(auto l : mLabels) glyphSet += l;
+    }
+
+    // Rasterizza in anticipo nella texture del font tutti i glifi
+    // che il testo può mostrare, per evitare rallentamenti al primo
+    // utilizzo. Deve essere chiamato dal thread di rendering.
+    void prewarm(const sf::Font& mFont) const
+    {
+        for(auto c : glyphSet)
+            mFont.getGlyph(static_cast<unsigned char>(c), characterSize, false);
+    }
+
+    auto getCharacterSize() const noexcept { return characterSize; }
+
+    void refresh()
+    {
+        if(boundValue != nullptr && (dirty || *boundValue != lastValue))
+        {
+            lastValue = *boundValue;
+            formatValue(lastValue);
+            text.setString(buffer.data());
+        }
+        else if(labelFunc != nullptr)
+        {
+            auto label(labelFunc(labelContext));
+            if(!dirty && label == lastLabel) return;
+
+            lastLabel = label;
+            text.setString(label);
+        }
+
+        dirty = false;
+    }
+
+    void draw(sf::RenderWindow& mTarget) const { mTarget.draw(text); }
+};
+
+// Il `World` contiene lo stato della simulazione, separato dalla
+// finestra e dall'interfaccia: può essere eseguito anche senza
+// rendering ("headless"), ad esempio per stress test.
+class World
+{
+public:
+    // Aggiungiamo due stati aggiuntivi: `GameOver` e `Victory`.
+    enum class State
+    {
+        Paused,
+        GameOver,
+        InProgress,
+        Victory
+    };
+
+    // Le fasi della simulazione aggiunte ad un `TaskGraph`: `first`
+    // precede tutte le altre, `last` le segue.
+    struct Tasks
+    {
+        TaskGraph::TaskId first, last;
+    };
+
+    Manager manager;
+    BrickField bricks;
+    State state{State::GameOver};
+
+    // Teniamo traccia delle vite del player nel `World`.
+    int remainingLives{0};
+
+    // Il punteggio aumenta di uno per ogni mattoncino distrutto.
+    int score{0};
+
+    // Input applicato al paddle durante la fase "input".
+    Paddle::Input paddleInput;
+
+private:
+    ThreadPool& threadPool;
+
+    // Contatti prodotti dalla narrowphase, uno slot per pallina.
+    std::vector<std::vector<BrickContact>> ballContacts;
+
+    // Broadphase sui paddle, ricostruita dal task che la usa: le
+    // palline visitano solo i paddle che possono toccare.
+    SweepBroadphase<Paddle> paddleBroadphase;
+
+    // Il livello non è posseduto dal `World`: chi lo fornisce deve
+    // mantenerlo valido.
+    LevelView level;
+    sf::Vector2f ballSpawn{wndWidth / 2.f, wndHeight / 2.f};
+
+    // Grafo usato da `step` quando non c'è rendering.
+    TaskGraph stepGraph;
+
+public:
+    World(ThreadPool& mThreadPool) : threadPool(mThreadPool)
+    {
+        addTasks(stepGraph);
+    }
+
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    Tasks addTasks(TaskGraph& mGraph)
+    {
+        auto& g(mGraph);
+
+        // Se non ci sono più palline sullo schermo, decrementiamo il
+        // numero di vite e creiamo una nuova pallina. Controlliamo
+        // anche le condizioni di vittoria e sconfitta.
+        auto rules(g.add("rules", [this]
+            {
+                bricks.clearChanges();
+
+                if(manager.getAll<Ball>().empty())
+                {
+                    manager.create<Ball>(ballSpawn.x, ballSpawn.y);
+                    --remainingLives;
+                }
+
+                if(bricks.countLive() == 0) state = State::Victory;
+                if(remainingLives <= 0) state = State::GameOver;
+            }));
+
+        auto input(g.add("input", [this]
+            {
+                manager.forEach<Paddle>([this](auto& mPaddle)
+                    {
+                        mPaddle.input = paddleInput;
+                    });
+            }));
+
+        auto update(g.add("update", [this]
+            {
+                manager.update(threadPool);
+            }));
+
+        // Ogni pallina scrive solo nel proprio slot di contatti: la
+        // narrowphase può essere eseguita in parallelo. Le celle
+        // vicine ad ogni pallina si trovano direttamente nella
+        // griglia, senza bisogno di una broadphase.
+        auto narrowphase(g.add("narrowphase", [this]
+            {
+                EntitySpan<Ball> balls{manager.getAll<Ball>()};
+                ballContacts.resize(balls.size());
+
+                threadPool.parallelFor(balls.size(), 1,
+                    [this, &balls](std::size_t mBegin, std::size_t mEnd)
+                    {
+                        for(auto i(mBegin); i < mEnd; ++i)
+                        {
+                            auto& contacts(ballContacts[i]);
+                            contacts.clear();
+
+                            BrickContact c;
+                            bricks.forEachLiveNear(
+                                balls[i], [&](std::uint32_t mCell)
+                                {
+                                    if(findBrickBallContact(mCell,
+                                           bricks.getCellBox(mCell), balls[i],
+                                           c))
+                                        contacts.emplace_back(c);
+                                });
+                        }
+                    });
+            }));
+
+        // La risoluzione è sequenziale e segue l'ordine delle
+        // palline: il risultato non dipende dal numero di thread.
+        auto resolve(g.add("resolve", [this]
+            {
+                EntitySpan<Ball> balls{manager.getAll<Ball>()};
+
+                for(std::size_t i{0}; i < balls.size(); ++i)
+                    resolveBallContacts(balls[i], ballContacts[i]);
+
+                for(std::size_t i{0}; i < balls.size(); ++i)
+                    score += applyBrickDamage(bricks, ballContacts[i]);
+
+                auto view(manager.view<Ball, Paddle>());
+                paddleBroadphase.build(view.second());
+                view.forEachPair(
+                    paddleBroadphase, [](auto& mBall, auto& mPaddle)
+                    {
+                        solvePaddleBallCollision(mPaddle, mBall);
+                    });
+            }));
+
+        auto refresh(g.add("refresh", [this]
+            {
+                manager.refresh();
+            }));
+
+        g.precede(rules, input);
+        g.precede(input, update);
+        g.precede(update, narrowphase);
+        g.precede(narrowphase, resolve);
+        g.precede(resolve, refresh);
+
+        return {rules, refresh};
+    }
+
+    void setLevel(const LevelView& mLevel) noexcept { level = mLevel; }
+
+    void restart()
+    {
+        // Ricordiamoci di settare le vite all'inizio di `restart`.
+        remainingLives = 3;
+        score = 0;
+
+        state = State::Paused;
+        manager.clear();
+
+        bricks.assign(level);
+
+        for(std::size_t i{0}; i < level.getSpawnCount(); ++i)
+        {
+            const auto& spawn(level.getSpawn(i));
+
+            if(spawn.type == LevelSpawn::Ball)
+            {
+                ballSpawn = {spawn.x, spawn.y};
+                manager.create<Ball>(spawn.x, spawn.y);
+            }
+            else if(spawn.type == LevelSpawn::Paddle)
+                manager.create<Paddle>(spawn.x, spawn.y);
+        }
+    }
+
+    // Esegue un singolo tick della simulazione.
+    void step() { stepGraph.run(threadPool); }
+};
+
+class Game
+{
+public:
+    // Da dove proviene il livello usato da `restart`.
+    enum class LevelSource
+    {
+        Default,
+        File,
+        Procedural
+    };
+
+private:
+    using State = World::State;
+
+    sf::RenderWindow window{{wndWidth, wndHeight}, "Arkanoid - 11"};
+    ThreadPool threadPool;
+    World world{threadPool};
+
+    // I livelli disponibili: quello di default, costruito in
+    // memoria, un file mappato in memoria e un livello procedurale.
+    LevelSource levelSource{LevelSource::Default};
+    std::vector<char> defaultLevel{buildDefaultLevel()};
+    MappedFile levelFile;
+    std::vector<char> generatedLevel;
+    LevelView defaultView, fileView, generatedView;
+
+    // Le fasi di un frame "in progress" sono descritte da un grafo
+    // di task, costruito una sola volta nel costruttore.
+    TaskGraph frameGraph;
+
+    BrickFieldRenderer brickRenderer;
+
+    bool pausePressedLastFrame{false};
+
+    // Il font viene caricato in background: la finestra si apre
+    // subito, e i testi vengono mostrati appena il font è pronto.
+    AssetManager assets{{".", "assets", "/usr/share/fonts/TTF",
+        "/usr/share/fonts/truetype/liberation", "/usr/share/fonts/liberation"}};
+    const AssetManager::Asset<sf::Font>& liberationSans{
+        assets.request<sf::Font>("LiberationSans-Regular.ttf")};
+
+    // SFML offre delle classi `sf::Font` ed `sf::Text` molto facili
+    // da usare. Le impiegheremo, tramite `HudText`, per mostrare il
+    // numero di vite rimanenti, il punteggio e lo stato del gioco.
+    HudText hudState{liberationSans.get(), 35, 10.f, 10.f};
+    HudText hudLives{liberationSans.get(), 15, 10.f, 10.f};
+    HudText hudScore{liberationSans.get(), 15, 10.f, 30.f};
+
+    bool glyphsPrewarmed{false};
+
+    // Appena il font è disponibile, prepariamo i glifi di tutti i
+    // testi per ogni dimensione usata, così i cambi di stato non
+    // causano rallentamenti.
+    void prewarmGlyphs()
+    {
+        const auto& font(liberationSans.get());
+        const HudText* huds[]{&hudState, &hudLives, &hudScore};
+
+        std::set<unsigned int> characterSizes;
+
+        for(auto h : huds)
+        {
+            h->prewarm(font);
+            characterSizes.emplace(h->getCharacterSize());
+        }
+
+        for(auto cs : characterSizes)
+        {
+            auto size(font.getTexture(cs).getSize());
+            std::cout << "Glyph atlas (size " << cs << "): " << size.x << "x"
+                      << size.y << "\n";
+        }
+
+        glyphsPrewarmed = true;
+    }
+
+    static const char* getStateLabel(State mState) noexcept
+    {
+        switch(mState)
+        {
+            case State::Paused: return "Paused";
+            case State::GameOver: return "Game over!";
+            case State::Victory: return "You won!";
+            default: return "";
+        }
+    }
+
+public:
+    Game()
+    {
+        window.setFramerateLimit(60);
+        LevelView::fromMemory(
+            defaultLevel.data(), defaultLevel.size(), defaultView);
+
+        hudState.bind(
+            [](const void* mWorld)
+            {
+                return getStateLabel(static_cast<const World*>(mWorld)->state);
+            },
+            &world,
+            {getStateLabel(State::Paused), getStateLabel(State::GameOver),
+                getStateLabel(State::Victory)});
+        hudLives.bind("Lives: ", world.remainingLives);
+        hudScore.bind("Score: ", world.score);
+
+        buildFrameGraph();
+    }
+
+    void buildFrameGraph()
+    {
+        auto& g(frameGraph);
+        auto simulation(world.addTasks(g));
+
+        // Aggiorniamo i testi delle vite rimanenti e del punteggio:
+        // vengono rigenerati solo se i valori sono cambiati. Vite e
+        // punteggio vengono scritti dalla simulazione, quindi i testi
+        // vanno letti solo dopo il suo ultimo task.
+        auto hud(g.add("hud", [this]
+            {
+                hudLives.refresh();
+                hudScore.refresh();
+            }));
+
+        // Il rendering deve avvenire sul thread che possiede la
+        // finestra.
+        auto draw(g.add("draw",
+            [this]
+            {
+                brickRenderer.sync(world.bricks);
+                brickRenderer.draw(window);
+                world.manager.draw(window);
+
+                if(!liberationSans.isLoaded()) return;
+                hudLives.draw(window);
+                hudScore.draw(window);
+            },
+            true));
+
+        g.precede(simulation.last, hud);
+        g.precede(simulation.last, draw);
+        g.precede(hud, draw);
+    }
+
+    // Sceglie la sorgente del livello usato dal prossimo `restart`.
+    // Le sorgenti `File` e `Procedural` devono essere state caricate
+    // con `loadLevel` o `generateLevel`.
+    void setLevelSource(LevelSource mSource) noexcept
+    {
+        levelSource = mSource;
+    }
+
+    void restart()
+    {
+        if(levelSource == LevelSource::File && fileView.isValid())
+            world.setLevel(fileView);
+        else if(levelSource == LevelSource::Procedural &&
+                generatedView.isValid())
+            world.setLevel(generatedView);
+        else
+            world.setLevel(defaultView);
+
+        world.restart();
+    }
+
+    // Carica un livello binario. In caso di errore, il livello
+    // corrente non viene modificato.
+    bool loadLevel(const std::string& mPath)
+    {
+        MappedFile file;
+        LevelView view;
+
+        if(!file.open(mPath) ||
+            !LevelView::fromMemory(file.getData(), file.getSize(), view))
+        {
+            std::cerr << "Invalid level file `" << mPath << "`\n";
+            return false;
+        }
+
+        levelFile.swap(file);
+        fileView = view;
+        levelSource = LevelSource::File;
+        return true;
+    }
+
+    void generateLevel(const LevelGenParams& mParams)
+    {
+        generatedLevel = ::generateLevel(mParams);
+        if(!LevelView::fromMemory(
+               generatedLevel.data(), generatedLevel.size(), generatedView))
+            return;
+
+        levelSource = LevelSource::Procedural;
+    }
+
+    void run()
+    {
+        auto& state(world.state);
+
+        while(true)
+        {
+            window.clear(sf::Color::Black);
+
+            if(!glyphsPrewarmed && liberationSans.isLoaded()) prewarmGlyphs();
+
+            if(sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Escape)) break;
+
+            if(sf::Keyboard::isKeyPressed(sf::Keyboard::Key::P))
+            {
+                if(!pausePressedLastFrame)
+                {
+                    if(state == State::Paused)
+                        state = State::InProgress;
+                    else if(state == State::InProgress)
+                        state = State::Paused;
+                }
+                pausePressedLastFrame = true;
+            }
+            else
+                pausePressedLastFrame = false;
+
+            if(sf::Keyboard::isKeyPressed(sf::Keyboard::Key::R)) restart();
+
+            // Se il gioco non è "in progress", non renderizziamo o
+            // aggiorniamo gli elementi, e mostriamo al player lo
+            // stato corrente con una stringa.
+            if(state != State::InProgress)
+            {
+                hudState.refresh();
+                if(liberationSans.isLoaded()) hudState.draw(window);
+            }
+            else
+            {
+                world.paddleInput.left =
+                    sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Left);
+                world.paddleInput.right =
+                    sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Right);
+
+                frameGraph.run(threadPool);
+            }
+
+            window.display();
+        }
+    }
+};
+
+// Esegue fino a `mTicks` tick di simulazione senza finestra, e
+// riporta il tempo medio per tick.
+int runStressTest(const LevelView& mLevel, std::size_t mTicks)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    ThreadPool threadPool;
+    World world{threadPool};
+    world.setLevel(mLevel);
+
+    auto restartStart(Clock::now());
+    world.restart();
+    auto restartTime(Clock::now() - restartStart);
+
+    auto bricks(world.bricks.countLive());
+    world.state = World::State::InProgress;
+
+    std::size_t ticks{0};
+    auto stepStart(Clock::now());
+    for(; ticks < mTicks && world.state == World::State::InProgress; ++ticks)
+        world.step();
+    auto stepTime(Clock::now() - stepStart);
+
+    using Ms = std::chrono::duration<double, std::milli>;
+    std::cout << "Bricks: " << bricks << "\n"
+              << "Restart: " << Ms{restartTime}.count() << " ms\n"
+              << "Ticks: " << ticks << ", "
+              << Ms{stepTime}.count() / std::max<std::size_t>(1, ticks)
+              << " ms/tick\n"
+              << "Bricks destroyed: " << world.score << "\n";
+
+    return 0;
+}
+
+// Legge i parametri di un livello procedurale, `<seed> <pattern>
+// <larghezza> <altezza> [densità]`, a partire da `mArgs[mFirst]`.
+bool parseLevelGenParams(const std::vector<std::string>& mArgs,
+    std::size_t mFirst, LevelGenParams& mParams)
+{
+    if(mArgs.size() < mFirst + 4 ||
+        !parsePattern(mArgs[mFirst + 1], mParams.pattern))
+    {
+        std::cerr << "Level arguments: <seed> "
+                     "<solid|checker|stripes|diamond|random> "
+                     "<width> <height> [density]\n";
+        return false;
+    }
+
+    mParams.seed = std::strtoull(mArgs[mFirst].c_str(), nullptr, 10);
+    mParams.width = std::strtoul(mArgs[mFirst + 2].c_str(), nullptr, 10);
+    mParams.height = std::strtoul(mArgs[mFirst + 3].c_str(), nullptr, 10);
+    if(mArgs.size() > mFirst + 4)
+        mParams.density = std::strtof(mArgs[mFirst + 4].c_str(), nullptr);
+
+    if(mParams.width == 0 || mParams.height == 0)
+    {
+        std::cerr << "Level width and height must be positive\n";
+        return false;
+    }
+
+    return true;
+}
+
+// Le modalità senza finestra ricevono tutti gli argomenti, a partire
+// dal nome della modalità, e restituiscono il codice di uscita.
+using Command = int (*)(const std::vector<std::string>&);
+
+// `--convert-level <livello.txt> <livello.lvl>` converte un livello
+// testuale.
+int runConvertCommand(const std::vector<std::string>& mArgs)
+{
+    if(mArgs.size() != 3)
+    {
+        std::cerr << "Usage: --convert-level <level.txt> <level.lvl>\n";
+        return 1;
+    }
+
+    return convertLevel(mArgs[1], mArgs[2]) ? 0 : 1;
+}
+
+// `--stress <tick> <livello procedurale>` simula un livello
+// procedurale senza finestra.
+int runStressCommand(const std::vector<std::string>& mArgs)
+{
+    LevelGenParams params;
+    if(mArgs.size() < 2 || !parseLevelGenParams(mArgs, 2, params)) return 1;
+
+    auto blob(generateLevel(params));
+    LevelView view;
+    LevelView::fromMemory(blob.data(), blob.size(), view);
+
+    return runStressTest(view, std::strtoull(mArgs[1].c_str(), nullptr, 10));
+}
+
+// Avvia il gioco con una finestra: `<livello.lvl>` gioca il livello
+// specificato, `--generate <livello procedurale>` un livello
+// procedurale.
+int runGame(const std::vector<std::string>& mArgs)
+{
+    Game game;
+
+    if(!mArgs.empty() && mArgs[0] == "--generate")
+    {
+        LevelGenParams params;
+        if(!parseLevelGenParams(mArgs, 1, params)) return 1;
+        game.generateLevel(params);
+    }
+    else if(mArgs.size() == 1 && !game.loadLevel(mArgs[0]))
+        return 1;
+
+    game.restart();
+    game.run();
+    return 0;
+}
+
+// Compilando con `-DARKANOID_LIBRARY` si esclude `main`: `tests.cpp`
+// include questo file in questo modo.
+#ifndef ARKANOID_LIBRARY
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+
+    const std::pair<const char*, Command> commands[]{
+        {"--convert-level", runConvertCommand},
+        {"--stress", runStressCommand}};
+
+    for(const auto& c : commands)
+        if(!args.empty() && args[0] == c.first) return c.second(args);
+
+    return runGame(args);
+}
+#endif
@@ -0,0 +1,7003 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: MIT License | http://opensource.org/licenses/MIT
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+// In questo segmento di codice aggiungeremo qualche feature
+// al nostro gioco:
+// * Simulazione opzionale in virgola fissa, identica su ogni build
+// * Generatore di numeri casuali deterministico, con flussi separati
+// * Particelle per la distruzione dei mattoncini, in array separati
+// * Power-up con entità preallocate ed effetti a tempo su una
+//   "timer wheel" gerarchica
+
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <typeinfo>
+#include <map>
+#include <set>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <limits>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#include <SFML/Graphics.hpp>
+#include "arkanoid.h"
+
+// Numero in virgola fissa Q16.16: 16 bit di parte intera e 16 di
+// parte frazionaria. Le operazioni usano solo aritmetica intera,
+// quindi danno lo stesso risultato con qualsiasi compilatore, flag
+// di ottimizzazione o vettorizzazione. Moltiplicazioni e divisioni
+// troncano il risultato.
+//
+// I valori fuori dall'intervallo rappresentabile saturano al minimo
+// o al massimo, invece di causare comportamento indefinito: anche
+// una divisione per zero dà un risultato deterministico.
+class Fixed
+{
+private:
+    std::int32_t raw{0};
+
+    static constexpr std::int32_t saturate(std::int64_t mRaw) noexcept
+    {
+        return static_cast<std::int32_t>(std::max<std::int64_t>(
+            std::numeric_limits<std::int32_t>::min(),
+            std::min<std::int64_t>(
+                std::numeric_limits<std::int32_t>::max(), mRaw)));
+    }
+
+    // Arrotonda al valore rappresentabile più vicino. NaN diventa
+    // zero.
+    static constexpr std::int32_t fromFloat(float mValue) noexcept
+    {
+        constexpr auto min(std::numeric_limits<std::int32_t>::min());
+        constexpr auto max(std::numeric_limits<std::int32_t>::max());
+
+        auto scaled(double(mValue) * one + (mValue < 0.f ? -0.5 : 0.5));
+        if(!(scaled == scaled)) return 0;
+        if(scaled <= min) return min;
+        if(scaled >= max) return max;
+
+        return static_cast<std::int32_t>(scaled);
+    }
+
+public:
+    static constexpr int fractionBits{16};
+    static constexpr std::int64_t one{std::int64_t(1) << fractionBits};
+
+    constexpr Fixed() noexcept = default;
+
+    // Anche gli interi fuori dall'intervallo saturano: limitandoli
+    // a ±`one`, il prodotto sta sempre in 64 bit.
+    template <typename T,
+        std::enable_if_t<std::is_integral<T>{}, int> = 0>
+    constexpr explicit Fixed(T mValue) noexcept
+        : raw{saturate(std::max(-std::int64_t(one),
+                           std::min(std::int64_t(one),
+                               static_cast<std::int64_t>(mValue))) *
+                       one)}
+    {
+    }
+
+    constexpr explicit Fixed(float mValue) noexcept : raw{fromFloat(mValue)}
+    {
+    }
+
+    static constexpr Fixed fromRaw(std::int32_t mRaw) noexcept
+    {
+        Fixed result;
+        result.raw = mRaw;
+        return result;
+    }
+
+    constexpr std::int32_t getRaw() const noexcept { return raw; }
+
+    constexpr explicit operator float() const noexcept
+    {
+        return static_cast<float>(raw) / one;
+    }
+
+    constexpr Fixed operator-() const noexcept
+    {
+        return fromRaw(saturate(-std::int64_t(raw)));
+    }
+
+    friend constexpr Fixed operator+(Fixed mA, Fixed mB) noexcept
+    {
+        return fromRaw(saturate(std::int64_t(mA.raw) + mB.raw));
+    }
+
+    friend constexpr Fixed operator-(Fixed mA, Fixed mB) noexcept
+    {
+        return fromRaw(saturate(std::int64_t(mA.raw) - mB.raw));
+    }
+
+    friend constexpr Fixed operator*(Fixed mA, Fixed mB) noexcept
+    {
+        return fromRaw(saturate(std::int64_t(mA.raw) * mB.raw / one));
+    }
+
+    // Dividendo per zero si ottiene il valore massimo con il segno del
+    // dividendo, o zero se anche il dividendo è zero.
+    friend constexpr Fixed operator/(Fixed mA, Fixed mB) noexcept
+    {
+        constexpr auto max(std::numeric_limits<std::int32_t>::max());
+        if(mB.raw == 0)
+            return fromRaw(mA.raw == 0 ? 0 : mA.raw > 0 ? max : -max - 1);
+
+        return fromRaw(saturate(std::int64_t(mA.raw) * one / mB.raw));
+    }
+
+    Fixed& operator+=(Fixed mB) noexcept { return *this = *this + mB; }
+    Fixed& operator-=(Fixed mB) noexcept { return *this = *this - mB; }
+    Fixed& operator*=(Fixed mB) noexcept { return *this = *this * mB; }
+    Fixed& operator/=(Fixed mB) noexcept { return *this = *this / mB; }
+
+    friend constexpr bool operator==(Fixed mA, Fixed mB) noexcept
+    {
+        return mA.raw == mB.raw;
+    }
+
+    friend constexpr bool operator!=(Fixed mA, Fixed mB) noexcept
+    {
+        return mA.raw != mB.raw;
+    }
+
+    friend constexpr bool operator<(Fixed mA, Fixed mB) noexcept
+    {
+        return mA.raw < mB.raw;
+    }
+
+    friend constexpr bool operator>(Fixed mA, Fixed mB) noexcept
+    {
+        return mA.raw > mB.raw;
+    }
+
+    friend constexpr bool operator<=(Fixed mA, Fixed mB) noexcept
+    {
+        return mA.raw <= mB.raw;
+    }
+
+    friend constexpr bool operator>=(Fixed mA, Fixed mB) noexcept
+    {
+        return mA.raw >= mB.raw;
+    }
+
+    friend constexpr Fixed abs(Fixed mA) noexcept
+    {
+        return mA.raw < 0 ? -mA : mA;
+    }
+};
+
+// Tipo numerico usato da posizioni e velocità della simulazione.
+// Compilando con `-DARKANOID_FIXED_POINT` la simulazione usa `Fixed`,
+// e i risultati sono identici bit per bit su ogni build; altrimenti
+// usa `float`. Il rendering usa sempre `float`.
+#ifdef ARKANOID_FIXED_POINT
+using Scalar = Fixed;
+#else
+using Scalar = float;
+#endif
+
+using Vec2 = sf::Vector2<Scalar>;
+
+// Radice quadrata intera per difetto, calcolata bit per bit.
+constexpr std::uint64_t getIntegerSqrt(std::uint64_t mValue) noexcept
+{
+    std::uint64_t result{0}, bit{std::uint64_t(1) << 62};
+    while(bit > mValue) bit >>= 2;
+
+    while(bit != 0)
+    {
+        if(mValue >= result + bit)
+        {
+            mValue -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+            result >>= 1;
+
+        bit >>= 2;
+    }
+
+    return result;
+}
+
+template <typename T>
+auto getLength(const T& mVec) noexcept
+{
+    return std::sqrt(std::pow(mVec.x, 2) + std::pow(mVec.y, 2));
+}
+
+// La somma dei quadrati delle componenti Q16.16 è un Q32.32: la sua
+// radice intera è direttamente la lunghezza in Q16.16.
+inline Fixed getLength(const sf::Vector2<Fixed>& mVec) noexcept
+{
+    std::int64_t x{mVec.x.getRaw()}, y{mVec.y.getRaw()};
+    return Fixed::fromRaw(static_cast<std::int32_t>(
+        getIntegerSqrt(static_cast<std::uint64_t>(x * x + y * y))));
+}
+
+template <typename T>
+auto getNormalized(const sf::Vector2<T>& mVec) noexcept
+{
+    return mVec / static_cast<T>(getLength(mVec));
+}
+
+template <typename T1, typename T2>
+auto getDotProduct(const T1& mVec1, const T2& mVec2)
+{
+    return mVec1.x * mVec2.x + mVec1.y * mVec2.y;
+}
+
+template <typename T1, typename T2>
+auto getReflected(const T1& mVec, const T2& mNormal)
+{
+    auto dot(getDotProduct(mVec, mNormal));
+    return mVec - (mNormal * (dot + dot));
+}
+
+template <typename T1, typename T2>
+bool isIntersecting(const T1& mA, const T2& mB) noexcept
+{
+    return mA.right() >= mB.left() && mA.left() <= mB.right() &&
+           mA.bottom() >= mB.top() && mA.top() <= mB.bottom();
+}
+
+constexpr unsigned int wndWidth{800}, wndHeight{600};
+
+// Flussi indipendenti ricavati da un unico seme: ogni sistema usa il
+// proprio, così le estrazioni di un sistema non cambiano quelle
+// degli altri.
+enum class RngStream : std::uint64_t
+{
+    Level,
+    Serve,
+    Drops,
+    Effects
+};
+
+// Generatore xoshiro256**: veloce, con uno stato di 256 bit che può
+// essere salvato e ripristinato. Lo stato iniziale viene ricavato
+// da seme e flusso con splitmix64. Non usa le distribuzioni della
+// libreria standard, la cui implementazione cambia tra compilatori:
+// a parità di seme le estrazioni sono identiche ovunque.
+class Rng
+{
+public:
+    using State = std::array<std::uint64_t, 4>;
+    using result_type = std::uint64_t;
+
+private:
+    State state;
+
+    static std::uint64_t getSplitMix(std::uint64_t& mX) noexcept
+    {
+        auto z(mX += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    static std::uint64_t rotl(std::uint64_t mX, int mK) noexcept
+    {
+        return (mX << mK) | (mX >> (64 - mK));
+    }
+
+public:
+    explicit Rng(std::uint64_t mSeed = 0,
+        RngStream mStream = RngStream::Level) noexcept
+    {
+        std::uint64_t x{mSeed ^ (static_cast<std::uint64_t>(mStream) *
+                                    0xd1b54a32d192ed03ull)};
+        for(auto& s : state) s = getSplitMix(x);
+    }
+
+    static constexpr result_type min() noexcept { return 0; }
+    static constexpr result_type max() noexcept
+    {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() noexcept
+    {
+        auto result(rotl(state[1] * 5, 7) * 9);
+        auto t(state[1] << 17);
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+
+        return result;
+    }
+
+    // Un nuovo generatore, inizializzato da un'estrazione di questo:
+    // utile per dare un flusso proprio a un sotto-sistema.
+    Rng split() noexcept
+    {
+        Rng result;
+        std::uint64_t x{(*this)()};
+        for(auto& s : result.state) s = getSplitMix(x);
+        return result;
+    }
+
+    // Intero uniforme in `[0, mBound)`, senza bias (metodo di Lemire).
+    std::uint32_t getBelow(std::uint32_t mBound) noexcept
+    {
+        auto m(std::uint64_t(std::uint32_t((*this)() >> 32)) * mBound);
+        if(std::uint32_t(m) < mBound)
+        {
+            auto threshold(std::uint32_t(-mBound) % mBound);
+            while(std::uint32_t(m) < threshold)
+                m = std::uint64_t(std::uint32_t((*this)() >> 32)) * mBound;
+        }
+        return static_cast<std::uint32_t>(m >> 32);
+    }
+
+    // Valore uniforme in `[0, 1)`, con 24 bit di precisione.
+    float getUnit() noexcept
+    {
+        return ((*this)() >> 40) * (1.f / (1 << 24));
+    }
+
+    const State& getState() const noexcept { return state; }
+    void setState(const State& mState) noexcept { state = mState; }
+};
+
+// Il `Tracer` registra intervalli di tempo ("scope") nominati, e li
+// scrive in un file JSON leggibile da `chrome://tracing` o Perfetto.
+// Ogni thread scrive in un proprio buffer circolare, senza lock; un
+// thread dedicato svuota periodicamente i buffer nel file.
+class Tracer
+{
+private:
+    struct Event
+    {
+        const char* name;
+        std::int64_t begin, end;
+    };
+
+    // Buffer "single producer, single consumer": scrive solo il
+    // thread proprietario, legge solo il thread di scrittura.
+    struct Buffer
+    {
+        static constexpr std::size_t capacity{1 << 14};
+
+        std::array<Event, capacity> events;
+        std::atomic<std::size_t> head{0}, tail{0};
+        std::atomic<std::size_t> dropped{0};
+        std::size_t threadId;
+    };
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point epoch{Clock::now()};
+
+    std::atomic<bool> enabled{false};
+
+    std::mutex buffersMutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+
+    std::mutex fileMutex;
+    std::ofstream file;
+    bool firstEvent{true};
+
+    std::thread writer;
+    std::atomic<bool> writerRunning{false};
+
+    Buffer& getLocalBuffer()
+    {
+        // Il buffer è posseduto dal `Tracer`, così sopravvive al
+        // thread e può essere svuotato anche dopo la sua fine.
+        thread_local Buffer* local{nullptr};
+        if(local != nullptr) return *local;
+
+        std::lock_guard<std::mutex> lock{buffersMutex};
+        buffers.emplace_back(std::make_unique<Buffer>());
+        local = buffers.back().get();
+        local->threadId = buffers.size();
+        return *local;
+    }
+
+    void drain(Buffer& mBuffer)
+    {
+        auto tail(mBuffer.tail.load(std::memory_order_relaxed));
+        auto head(mBuffer.head.load(std::memory_order_acquire));
+
+        for(; tail != head; ++tail)
+        {
+            const auto& e(mBuffer.events[tail % Buffer::capacity]);
+
+            file << (firstEvent ? "\n" : ",\n") << R"({"name":")" << e.name
+                 << R"(","ph":"X","pid":1,"tid":)" << mBuffer.threadId
+                 << R"(,"ts":)" << e.begin / 1000.0 << R"(,"dur":)"
+                 << (e.end - e.begin) / 1000.0 << "}";
+            firstEvent = false;
+        }
+
+        mBuffer.tail.store(tail, std::memory_order_release);
+    }
+
+    void drainAll()
+    {
+        std::lock_guard<std::mutex> lockFile{fileMutex};
+        std::lock_guard<std::mutex> lockBuffers{buffersMutex};
+
+        if(!file.is_open()) return;
+        for(auto& b : buffers) drain(*b);
+    }
+
+    void writerLoop()
+    {
+        while(writerRunning)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            drainAll();
+        }
+    }
+
+public:
+    ~Tracer() { stop(); }
+
+    static Tracer& get()
+    {
+        static Tracer instance;
+        return instance;
+    }
+
+    bool isEnabled() const noexcept
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    std::int64_t now() const noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - epoch)
+            .count();
+    }
+
+    void record(const char* mName, std::int64_t mBegin, std::int64_t mEnd)
+    {
+        auto& b(getLocalBuffer());
+        auto head(b.head.load(std::memory_order_relaxed));
+
+        if(head - b.tail.load(std::memory_order_acquire) >= Buffer::capacity)
+        {
+            b.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        b.events[head % Buffer::capacity] = {mName, mBegin, mEnd};
+        b.head.store(head + 1, std::memory_order_release);
+    }
+
+    bool start(const std::string& mPath)
+    {
+        stop();
+
+        {
+            std::lock_guard<std::mutex> lock{fileMutex};
+            file.open(mPath);
+            if(!file)
+            {
+                std::cerr << "Cannot open trace file `" << mPath << "`\n";
+                return false;
+            }
+
+            file << R"({"displayTimeUnit":"ms","traceEvents":[)";
+            firstEvent = true;
+        }
+
+        // Gli eventi registrati prima dell'inizio vengono scartati.
+        {
+            std::lock_guard<std::mutex> lock{buffersMutex};
+            for(auto& b : buffers) b->tail.store(b->head.load());
+        }
+
+        writerRunning = true;
+        writer = std::thread{[this]
+            {
+                writerLoop();
+            }};
+
+        enabled = true;
+        return true;
+    }
+
+    // Ferma la registrazione, scrive gli eventi rimanenti e chiude
+    // il file.
+    void stop()
+    {
+        if(!writerRunning) return;
+
+        enabled = false;
+        writerRunning = false;
+        writer.join();
+        drainAll();
+
+        std::size_t dropped{0};
+        {
+            std::lock_guard<std::mutex> lock{buffersMutex};
+            for(auto& b : buffers) dropped += b->dropped.exchange(0);
+        }
+
+        std::lock_guard<std::mutex> lock{fileMutex};
+        file << "\n]}\n";
+        file.close();
+
+        if(dropped > 0)
+            std::cerr << "Trace: " << dropped << " events dropped\n";
+    }
+};
+
+// Registra la durata dello scope corrente, se il tracing è attivo.
+// `mName` deve avere durata statica.
+class TraceScope
+{
+private:
+    const char* name;
+    std::int64_t begin{-1};
+
+public:
+    TraceScope(const char* mName) noexcept : name{mName}
+    {
+        if(Tracer::get().isEnabled()) begin = Tracer::get().now();
+    }
+
+    ~TraceScope()
+    {
+        if(begin >= 0 && Tracer::get().isEnabled())
+            Tracer::get().record(name, begin, Tracer::get().now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define TRACE_CONCAT_IMPL(mA, mB) mA##mB
+#define TRACE_CONCAT(mA, mB) TRACE_CONCAT_IMPL(mA, mB)
+#define TRACE_SCOPE(mName) TraceScope TRACE_CONCAT(traceScope, __LINE__){mName}
+
+// Istogramma di durate in stile "HDR": i bucket sono lineari
+// all'interno di ogni potenza di due, quindi l'errore relativo è
+// costante (circa 3%) da pochi nanosecondi fino a svariati minuti.
+// La memoria occupata è fissa, e `record` non alloca.
+class LatencyHistogram
+{
+private:
+    static constexpr int subBucketBits{5};
+    static constexpr std::uint64_t subBucketCount{1u << subBucketBits};
+    static constexpr int maxBits{42};
+    static constexpr std::size_t bucketCount{
+        (maxBits - subBucketBits + 2) * subBucketCount};
+
+    std::array<std::uint64_t, bucketCount> buckets{};
+    std::uint64_t count{0};
+    std::int64_t min{0}, max{0};
+
+    static std::size_t getIndex(std::uint64_t mValue) noexcept
+    {
+        if(mValue < subBucketCount) return mValue;
+
+        int msb(63 - __builtin_clzll(mValue));
+        int shift((msb < maxBits ? msb : maxBits) - subBucketBits);
+        auto mantissa(std::min(mValue >> shift, 2 * subBucketCount - 1));
+
+        return (shift + 1) * subBucketCount + (mantissa - subBucketCount);
+    }
+
+    // Valore centrale del bucket `mIndex`.
+    static std::int64_t getValue(std::size_t mIndex) noexcept
+    {
+        if(mIndex < subBucketCount) return mIndex;
+
+        auto shift(mIndex / subBucketCount - 1);
+        auto mantissa(mIndex % subBucketCount + subBucketCount);
+
+        return (mantissa << shift) + ((std::uint64_t{1} << shift) >> 1);
+    }
+
+public:
+    void record(std::chrono::nanoseconds mDuration) noexcept
+    {
+        auto value(std::max<std::int64_t>(0, mDuration.count()));
+
+        ++buckets[getIndex(value)];
+        min = count == 0 ? value : std::min(min, value);
+        max = count == 0 ? value : std::max(max, value);
+        ++count;
+    }
+
+    void reset() noexcept
+    {
+        buckets.fill(0);
+        count = 0;
+        min = max = 0;
+    }
+
+    std::uint64_t getCount() const noexcept { return count; }
+    std::chrono::nanoseconds getMin() const noexcept
+    {
+        return std::chrono::nanoseconds{min};
+    }
+    std::chrono::nanoseconds getMax() const noexcept
+    {
+        return std::chrono::nanoseconds{max};
+    }
+
+    // Durata sotto la quale cade la percentuale `mPercentile` dei
+    // campioni (ad esempio `99.9`).
+    std::chrono::nanoseconds getPercentile(double mPercentile) const noexcept
+    {
+        if(count == 0) return std::chrono::nanoseconds{0};
+
+        auto target(static_cast<std::uint64_t>(
+            std::ceil(mPercentile / 100.0 * static_cast<double>(count))));
+        target = std::max<std::uint64_t>(1, std::min(target, count));
+
+        std::uint64_t seen{0};
+        for(std::size_t i{0}; i < bucketCount; ++i)
+        {
+            seen += buckets[i];
+            if(seen >= target)
+                return std::chrono::nanoseconds{
+                    std::min(std::max(getValue(i), min), max)};
+        }
+
+        return std::chrono::nanoseconds{max};
+    }
+
+    // Stampa una riga con i percentili principali, in millisecondi.
+    void print(std::ostream& mStream, const char* mLabel) const
+    {
+        auto ms([](std::chrono::nanoseconds mValue)
+            {
+                return std::chrono::duration<double, std::milli>{mValue}
+                    .count();
+            });
+
+        mStream << mLabel << ": n=" << count << " p50=" << ms(getPercentile(50))
+                << " p90=" << ms(getPercentile(90))
+                << " p99=" << ms(getPercentile(99))
+                << " p99.9=" << ms(getPercentile(99.9))
+                << " max=" << ms(getMax()) << " ms\n";
+    }
+};
+
+// Contatori hardware della CPU, letti tramite `perf_event_open` su
+// Linux. Ogni thread apre i propri contatori la prima volta che li
+// usa; se il sistema non li supporta, `enable` restituisce `false` e
+// tutte le misure diventano delle operazioni vuote.
+class PerfCounters
+{
+public:
+    enum Counter : std::size_t
+    {
+        Cycles,
+        Instructions,
+        CacheMisses,
+        BranchMisses,
+        CounterCount
+    };
+
+    using Values = std::array<std::uint64_t, CounterCount>;
+
+    // Somma dei valori misurati da più thread.
+    struct Accumulator
+    {
+        std::array<std::atomic<std::uint64_t>, CounterCount> values{};
+
+        void add(const Values& mValues) noexcept
+        {
+            for(std::size_t i{0}; i < CounterCount; ++i)
+                values[i].fetch_add(mValues[i], std::memory_order_relaxed);
+        }
+
+        Values get() const noexcept
+        {
+            Values result;
+            for(std::size_t i{0}; i < CounterCount; ++i)
+                result[i] = values[i].load(std::memory_order_relaxed);
+            return result;
+        }
+    };
+
+private:
+    // I contatori di un thread formano un gruppo: vengono letti
+    // insieme con una sola chiamata a `read`.
+    struct ThreadGroup
+    {
+        std::array<int, CounterCount> fds;
+        bool valid{false};
+
+        ThreadGroup()
+        {
+            fds.fill(-1);
+
+#ifdef __linux__
+            const std::uint64_t configs[]{PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+                PERF_COUNT_HW_BRANCH_MISSES};
+
+            for(std::size_t i{0}; i < CounterCount; ++i)
+            {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = configs[i];
+                attr.read_format = PERF_FORMAT_GROUP;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+
+                fds[i] = static_cast<int>(syscall(
+                    SYS_perf_event_open, &attr, 0, -1, fds[0], 0));
+                if(fds[i] == -1) return;
+            }
+
+            valid = true;
+#endif
+        }
+
+        ~ThreadGroup()
+        {
+            for(auto fd : fds)
+                if(fd != -1) close(fd);
+        }
+
+        bool read(Values& mValues) const noexcept
+        {
+            if(!valid) return false;
+
+            // Con `PERF_FORMAT_GROUP`: numero di contatori, seguito
+            // dai valori nell'ordine di apertura.
+            std::uint64_t buffer[1 + CounterCount];
+            auto size(static_cast<ssize_t>(sizeof(buffer)));
+            if(::read(fds[0], buffer, sizeof(buffer)) != size) return false;
+
+            std::copy(buffer + 1, buffer + 1 + CounterCount, mValues.begin());
+            return true;
+        }
+    };
+
+    static std::atomic<bool>& getEnabledFlag() noexcept
+    {
+        static std::atomic<bool> enabled{false};
+        return enabled;
+    }
+
+    static const ThreadGroup& getLocalGroup()
+    {
+        thread_local ThreadGroup group;
+        return group;
+    }
+
+public:
+    // Prova ad aprire i contatori sul thread corrente, e attiva le
+    // misure solo se ci riesce.
+    static bool enable()
+    {
+        Values values;
+        if(!getLocalGroup().read(values)) return false;
+
+        getEnabledFlag() = true;
+        return true;
+    }
+
+    static bool isEnabled() noexcept
+    {
+        return getEnabledFlag().load(std::memory_order_relaxed);
+    }
+
+    static bool read(Values& mValues) { return getLocalGroup().read(mValues); }
+};
+
+// Misura i contatori hardware dello scope corrente, e li aggiunge a
+// un `Accumulator`. Gli scope annidati con un accumulatore diverso
+// vengono sottratti dallo scope esterno, così ogni evento viene
+// contato una sola volta; quelli con lo stesso accumulatore non
+// fanno nulla.
+class PerfScope
+{
+private:
+    static thread_local PerfScope* current;
+
+    PerfCounters::Accumulator* target{nullptr};
+    PerfScope* parent{nullptr};
+    PerfCounters::Values begin, nested{};
+
+public:
+    PerfScope(PerfCounters::Accumulator* mTarget)
+    {
+        if(mTarget == nullptr || !PerfCounters::isEnabled() ||
+            getCurrentTarget() == mTarget || !PerfCounters::read(begin))
+            return;
+
+        target = mTarget;
+        parent = current;
+        current = this;
+    }
+
+    ~PerfScope()
+    {
+        if(target == nullptr) return;
+        current = parent;
+
+        PerfCounters::Values end, delta;
+        if(!PerfCounters::read(end)) return;
+
+        for(std::size_t i{0}; i < PerfCounters::CounterCount; ++i)
+        {
+            delta[i] = end[i] - begin[i];
+            if(parent != nullptr) parent->nested[i] += delta[i];
+            delta[i] -= nested[i];
+        }
+
+        target->add(delta);
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+    // Accumulatore dello scope attivo sul thread corrente: i job
+    // lanciati da `parallelFor` lo usano per continuare la misura.
+    static PerfCounters::Accumulator* getCurrentTarget() noexcept
+    {
+        return current != nullptr ? current->target : nullptr;
+    }
+};
+
+thread_local PerfScope* PerfScope::current{nullptr};
+
+// Un semplice thread pool "work stealing": ogni worker ha la sua
+// coda di job, da cui preleva in ordine LIFO. Un worker senza lavoro
+// "ruba" dalla testa delle code degli altri worker.
+class ThreadPool
+{
+public:
+    // Un job è un riferimento non proprietario ad un oggetto
+    // invocabile: chi lo accoda deve mantenere in vita l'oggetto
+    // finché il job non è stato eseguito. In questo modo accodare un
+    // job non alloca memoria.
+    struct Job
+    {
+        void (*func)(void*);
+        void* context;
+
+        void operator()() const { func(context); }
+    };
+
+    template <typename T>
+    static Job makeJob(T& mCallable) noexcept
+    {
+        return {[](void* mContext)
+            {
+                (*static_cast<T*>(mContext))();
+            },
+            &mCallable};
+    }
+
+private:
+    // Le code hanno una capacità fissa, allocata una volta sola: se
+    // una coda è piena, `submit` esegue il job immediatamente.
+    static constexpr std::size_t queueCapacity{1024};
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::array<Job, queueCapacity> jobs;
+        std::size_t head{0}, count{0};
+    };
+
+    // Stato condiviso dai job di una chiamata a `parallelFor`: ogni
+    // job prende il primo blocco non ancora assegnato. Vive sullo
+    // stack del chiamante, che ne attende il completamento.
+    template <typename TFunc>
+    struct ForContext
+    {
+        TFunc& func;
+        std::size_t count, grain;
+        PerfCounters::Accumulator* perfTarget;
+
+        std::atomic<std::size_t> next{0}, remaining;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        ForContext(TFunc& mFunc, std::size_t mCount, std::size_t mGrain,
+            std::size_t mChunkCount)
+            : func{mFunc}, count{mCount}, grain{mGrain},
+              perfTarget{PerfScope::getCurrentTarget()},
+              remaining{mChunkCount}
+        {
+        }
+
+        void operator()()
+        {
+            auto begin(next++ * grain);
+            auto end(std::min(count, begin + grain));
+
+            try
+            {
+                PerfScope perf{perfTarget};
+                func(begin, end);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock{errorMutex};
+                if(!error) error = std::current_exception();
+            }
+
+            // Dopo il decremento il chiamante può distruggere il
+            // contesto: non va più toccato.
+            --remaining;
+        }
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::atomic<bool> running{true};
+    std::atomic<std::size_t> pending{0}, nextQueue{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+
+    // Ogni thread sa se è un worker, e di quale pool.
+    static thread_local ThreadPool* currentPool;
+    static thread_local std::size_t currentIdx;
+
+    bool tryPop(std::size_t mIdx, Job& mJob, bool mFromBack)
+    {
+        auto& queue(*queues[mIdx]);
+        std::lock_guard<std::mutex> lock{queue.mutex};
+
+        if(queue.count == 0) return false;
+
+        if(mFromBack)
+            mJob = queue.jobs[(queue.head + queue.count - 1) % queueCapacity];
+        else
+        {
+            mJob = queue.jobs[queue.head];
+            queue.head = (queue.head + 1) % queueCapacity;
+        }
+
+        --queue.count;
+        --pending;
+        return true;
+    }
+
+    void workerLoop(std::size_t mIdx)
+    {
+        currentPool = this;
+        currentIdx = mIdx;
+
+        while(running)
+        {
+            if(runOne()) continue;
+
+            std::unique_lock<std::mutex> lock{sleepMutex};
+            sleepCv.wait(lock, [this]
+                {
+                    return !running || pending > 0;
+                });
+        }
+    }
+
+public:
+    ThreadPool(std::size_t mThreadCount = std::max(
+                   1u, std::thread::hardware_concurrency()) - 1)
+    {
+        // Anche i thread esterni possono accodare job: usiamo almeno
+        // una coda anche se non ci sono worker.
+        auto queueCount(std::max<std::size_t>(1, mThreadCount));
+        for(std::size_t i{0}; i < queueCount; ++i)
+            queues.emplace_back(std::make_unique<Queue>());
+
+        for(std::size_t i{0}; i < mThreadCount; ++i)
+            threads.emplace_back([this, i]
+                {
+                    workerLoop(i);
+                });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{sleepMutex};
+            running = false;
+        }
+
+        sleepCv.notify_all();
+        for(auto& t : threads) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    auto getThreadCount() const noexcept { return threads.size(); }
+
+    // I job che lanciano eccezioni terminano il programma: usare
+    // `parallelFor` per propagarle al chiamante.
+    void submit(Job mJob)
+    {
+        auto idx(currentPool == this ? currentIdx
+                                     : nextQueue++ % queues.size());
+
+        {
+            auto& queue(*queues[idx]);
+            std::unique_lock<std::mutex> lock{queue.mutex};
+            if(queue.count == queueCapacity)
+            {
+                lock.unlock();
+                mJob();
+                return;
+            }
+
+            queue.jobs[(queue.head + queue.count) % queueCapacity] = mJob;
+            ++queue.count;
+            ++pending;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{sleepMutex};
+        }
+        sleepCv.notify_one();
+    }
+
+    // Esegue un job disponibile, se c'è: prima dalla coda del thread
+    // corrente, poi rubandolo dalle altre code.
+    bool runOne()
+    {
+        Job job;
+        auto own(currentPool == this);
+        auto start(own ? currentIdx : 0);
+
+        if(own && tryPop(start, job, true))
+        {
+            job();
+            return true;
+        }
+
+        for(std::size_t i{0}; i < queues.size(); ++i)
+        {
+            auto idx((start + i) % queues.size());
+            if((own && idx == start) || !tryPop(idx, job, false)) continue;
+
+            job();
+            return true;
+        }
+
+        return false;
+    }
+
+    // Divide `[0, mCount)` in blocchi di `mGrain` elementi e chiama
+    // `mFunc(begin, end)` su ognuno. Il thread chiamante partecipa
+    // al lavoro finché tutti i blocchi non sono completati.
+    template <typename TFunc>
+    void parallelFor(std::size_t mCount, std::size_t mGrain, TFunc&& mFunc)
+    {
+        mGrain = std::max<std::size_t>(1, mGrain);
+        auto chunkCount((mCount + mGrain - 1) / mGrain);
+
+        if(chunkCount <= 1 || threads.empty())
+        {
+            if(mCount > 0) mFunc(std::size_t(0), mCount);
+            return;
+        }
+
+        // I blocchi vengono contati nella stessa fase del chiamante.
+        ForContext<std::remove_reference_t<TFunc>> context{
+            mFunc, mCount, mGrain, chunkCount};
+
+        auto job(makeJob(context));
+        for(std::size_t i{0}; i < chunkCount; ++i) submit(job);
+
+        while(context.remaining > 0)
+            if(!runOne()) std::this_thread::yield();
+
+        if(context.error) std::rethrow_exception(context.error);
+    }
+};
+
+thread_local ThreadPool* ThreadPool::currentPool{nullptr};
+thread_local std::size_t ThreadPool::currentIdx{0};
+
+// Un `TaskGraph` descrive il lavoro di un frame come un insieme di
+// task con dipendenze. Ogni task ha un contatore delle dipendenze
+// non ancora completate: quando arriva a zero, il task viene
+// accodato sul thread pool. I task marcati "main thread" (ad esempio
+// il rendering) vengono eseguiti solo dal thread che chiama `run`.
+class TaskGraph
+{
+public:
+    using TaskId = std::size_t;
+
+private:
+    // Oggetto invocabile accodato sul thread pool quando un task è
+    // pronto: vive nel task, quindi accodarlo non alloca memoria.
+    struct Launcher
+    {
+        TaskGraph* graph;
+        TaskId id;
+
+        void operator()() const { graph->execute(*graph->pool, id); }
+    };
+
+    // Ogni task possiede il suo oggetto invocabile, e lo esegue
+    // tramite un `ThreadPool::Job` che vi punta.
+    struct Task
+    {
+        const char* name;
+        ThreadPool::Job job;
+        bool mainThread;
+        Launcher launcher;
+
+        // Durata dell'ultima esecuzione del task, e contatori
+        // hardware accumulati in tutte le esecuzioni.
+        std::chrono::nanoseconds duration{0};
+        PerfCounters::Accumulator perf;
+
+        std::vector<TaskId> dependents;
+        std::size_t dependencyCount{0};
+        std::atomic<std::size_t> remaining{0};
+
+        virtual ~Task() {}
+    };
+
+    template <typename TFunc>
+    struct CallableTask : Task
+    {
+        TFunc func;
+
+        CallableTask(TFunc mFunc) : func{std::move(mFunc)} {}
+    };
+
+    std::vector<std::unique_ptr<Task>> tasks;
+
+    // Stato di un'esecuzione di `run`.
+    ThreadPool* pool{nullptr};
+    std::atomic<std::size_t> unfinished{0};
+    std::mutex mainMutex;
+    std::vector<TaskId> mainReady;
+    std::exception_ptr error;
+
+    void schedule(ThreadPool& mPool, TaskId mId)
+    {
+        if(tasks[mId]->mainThread)
+        {
+            std::lock_guard<std::mutex> lock{mainMutex};
+            mainReady.emplace_back(mId);
+            return;
+        }
+
+        mPool.submit(ThreadPool::makeJob(tasks[mId]->launcher));
+    }
+
+    void execute(ThreadPool& mPool, TaskId mId)
+    {
+        auto& task(*tasks[mId]);
+        auto start(std::chrono::steady_clock::now());
+
+        try
+        {
+            TRACE_SCOPE(task.name);
+            PerfScope perf{&task.perf};
+            task.job();
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock{mainMutex};
+            if(!error) error = std::current_exception();
+        }
+
+        task.duration = std::chrono::steady_clock::now() - start;
+
+        for(auto d : task.dependents)
+            if(--tasks[d]->remaining == 0) schedule(mPool, d);
+
+        --unfinished;
+    }
+
+    bool runMainThreadTask(ThreadPool& mPool)
+    {
+        TaskId id;
+
+        {
+            std::lock_guard<std::mutex> lock{mainMutex};
+            if(mainReady.empty()) return false;
+
+            id = mainReady.back();
+            mainReady.pop_back();
+        }
+
+        execute(mPool, id);
+        return true;
+    }
+
+public:
+    template <typename TFunc>
+    TaskId add(const char* mName, TFunc&& mFunc, bool mMainThread = false)
+    {
+        auto task(std::make_unique<CallableTask<std::decay_t<TFunc>>>(
+            std::forward<TFunc>(mFunc)));
+        task->name = mName;
+        task->job = ThreadPool::makeJob(task->func);
+        task->mainThread = mMainThread;
+        task->launcher = {this, tasks.size()};
+        tasks.emplace_back(std::move(task));
+
+        // Al più tutti i task possono essere pronti insieme: `run`
+        // non alloca mai.
+        mainReady.reserve(tasks.size());
+
+        return tasks.size() - 1;
+    }
+
+    // `mBefore` deve essere completato prima di iniziare `mAfter`.
+    void precede(TaskId mBefore, TaskId mAfter)
+    {
+        tasks[mBefore]->dependents.emplace_back(mAfter);
+        ++tasks[mAfter]->dependencyCount;
+    }
+
+    const char* getName(TaskId mId) const noexcept
+    {
+        return tasks[mId]->name;
+    }
+
+    std::size_t getTaskCount() const noexcept { return tasks.size(); }
+
+    // Durata di `mId` durante l'ultima chiamata a `run`.
+    std::chrono::nanoseconds getDuration(TaskId mId) const noexcept
+    {
+        return tasks[mId]->duration;
+    }
+
+    // Contatori hardware accumulati da `mId`, se abilitati.
+    PerfCounters::Values getPerf(TaskId mId) const noexcept
+    {
+        return tasks[mId]->perf.get();
+    }
+
+    // Stampa, per ogni task, IPC e miss per entità. `mEntityCount` è
+    // la somma, su tutte le esecuzioni, delle entità simulate.
+    void printPerf(std::ostream& mStream, std::uint64_t mEntityCount) const
+    {
+        if(!PerfCounters::isEnabled()) return;
+
+        auto entities(
+            static_cast<double>(std::max<std::uint64_t>(1, mEntityCount)));
+        auto perEntity([entities](std::uint64_t mValue)
+            {
+                return static_cast<double>(mValue) / entities;
+            });
+
+        for(const auto& t : tasks)
+        {
+            auto v(t->perf.get());
+            auto ipc(static_cast<double>(v[PerfCounters::Instructions]) /
+                     static_cast<double>(
+                         std::max<std::uint64_t>(1, v[PerfCounters::Cycles])));
+
+            mStream << t->name << ": cycles=" << v[PerfCounters::Cycles]
+                    << " instructions=" << v[PerfCounters::Instructions]
+                    << " IPC=" << ipc << " cache-misses/entity="
+                    << perEntity(v[PerfCounters::CacheMisses])
+                    << " branch-misses/entity="
+                    << perEntity(v[PerfCounters::BranchMisses]) << "\n";
+        }
+    }
+
+    // Esegue tutti i task rispettando le dipendenze. Il thread
+    // chiamante esegue i task "main thread" e aiuta il pool finché
+    // il grafo non è completato.
+    void run(ThreadPool& mPool)
+    {
+        pool = &mPool;
+        unfinished = tasks.size();
+        error = nullptr;
+
+        for(auto& t : tasks) t->remaining = t->dependencyCount;
+
+        for(TaskId i{0}; i < tasks.size(); ++i)
+            if(tasks[i]->dependencyCount == 0) schedule(mPool, i);
+
+        while(unfinished > 0)
+            if(!runMainThreadTask(mPool) && !mPool.runOne())
+                std::this_thread::yield();
+
+        if(error) std::rethrow_exception(error);
+    }
+};
+
+// Un tipo di entità può dichiarare che il suo `update` non ha
+// effetti su altre entità definendo `static constexpr bool
+// isolatedUpdate{true}`. Solo questi tipi vengono aggiornati in
+// parallelo dal `Manager`.
+template <typename T, typename = void>
+struct HasIsolatedUpdate : std::false_type
+{
+};
+
+template <typename T>
+struct HasIsolatedUpdate<T, std::enable_if_t<T::isolatedUpdate>>
+    : std::true_type
+{
+};
+
+class Entity
+{
+private:
+    friend class Manager;
+    bool parallelUpdate{false};
+
+public:
+    bool destroyed{false};
+
+    virtual ~Entity() {}
+    virtual void update() {}
+    virtual void draw(sf::RenderWindow& mTarget) {}
+};
+
+// Un `EntitySpan` è una "finestra" contigua su un gruppo di entità
+// dello stesso tipo. Non possiede la memoria: è valido finché il
+// gruppo non viene modificato (`create`, `refresh` o `clear`).
+template <typename T>
+class EntitySpan
+{
+private:
+    Entity* const* ptrs{nullptr};
+    std::size_t count{0};
+
+public:
+    EntitySpan() = default;
+    EntitySpan(const std::vector<Entity*>& mGroup) noexcept
+        : ptrs{mGroup.data()}, count{mGroup.size()}
+    {
+    }
+
+    auto size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+
+    T& operator[](std::size_t mI) const noexcept
+    {
+        return *static_cast<T*>(ptrs[mI]);
+    }
+};
+
+// Una `View` raggruppa due span, ottenuti una sola volta, e permette
+// di iterare su tutte le coppie `(TA, TB)`. Opzionalmente si può
+// fornire una "broadphase" che scarta a priori le coppie che non
+// possono sovrapporsi.
+template <typename TA, typename TB>
+class View
+{
+private:
+    EntitySpan<TA> spanA;
+    EntitySpan<TB> spanB;
+
+public:
+    View(EntitySpan<TA> mA, EntitySpan<TB> mB) noexcept
+        : spanA{mA}, spanB{mB}
+    {
+    }
+
+    const auto& first() const noexcept { return spanA; }
+    const auto& second() const noexcept { return spanB; }
+
+    template <typename TFunc>
+    void forEachPair(TFunc mFunc) const
+    {
+        for(std::size_t iA{0}; iA < spanA.size(); ++iA)
+            for(std::size_t iB{0}; iB < spanB.size(); ++iB)
+                mFunc(spanA[iA], spanB[iB]);
+    }
+
+    // La broadphase deve essere già stata costruita su `second()`.
+    template <typename TBroadphase, typename TFunc>
+    void forEachPair(const TBroadphase& mBroadphase, TFunc mFunc) const
+    {
+        for(std::size_t iA{0}; iA < spanA.size(); ++iA)
+        {
+            auto& a(spanA[iA]);
+            mBroadphase.query(a, [&a, &mFunc](TB& mB)
+                {
+                    mFunc(a, mB);
+                });
+        }
+    }
+};
+
+// Broadphase "sweep and prune" su un singolo asse: le entità vengono
+// ordinate per `left()`, e una query visita solo quelle il cui
+// intervallo orizzontale può intersecare quello dell'entità data.
+template <typename T>
+class SweepBroadphase
+{
+private:
+    std::vector<T*> sorted;
+    Scalar maxWidth{0};
+
+public:
+    // Con abbastanza spazio riservato, `build` non alloca.
+    void reserve(std::size_t mCount) { sorted.reserve(mCount); }
+
+    void build(const EntitySpan<T>& mSpan)
+    {
+        sorted.clear();
+        maxWidth = Scalar(0);
+
+        for(std::size_t i{0}; i < mSpan.size(); ++i)
+        {
+            auto& e(mSpan[i]);
+            sorted.emplace_back(&e);
+            maxWidth = std::max(maxWidth, e.right() - e.left());
+        }
+
+        std::sort(std::begin(sorted), std::end(sorted), [](auto mA, auto mB)
+            {
+                return mA->left() < mB->left();
+            });
+    }
+
+    template <typename TOther, typename TFunc>
+    void query(const TOther& mOther, TFunc mFunc) const
+    {
+        auto itr(std::lower_bound(std::begin(sorted), std::end(sorted),
+            mOther.left() - maxWidth, [](auto mPtr, Scalar mX)
+            {
+                return mPtr->left() < mX;
+            }));
+
+        for(; itr != std::end(sorted) && (*itr)->left() <= mOther.right();
+            ++itr)
+            if(isIntersecting(**itr, mOther)) mFunc(**itr);
+    }
+};
+
+class Manager
+{
+private:
+    std::vector<std::unique_ptr<Entity>> entities;
+    std::map<std::size_t, std::vector<Entity*>> groupedEntities;
+
+    // Le entità distrutte non vengono deallocate: finiscono in un
+    // "pool" in base al loro tipo dinamico, e `create` ne riutilizza
+    // la memoria ricostruendo l'oggetto "in-place". In questo modo
+    // restart ripetuti non allocano nuova memoria.
+    std::map<std::size_t, std::vector<std::unique_ptr<Entity>>> pools;
+
+    // Gruppi i cui elementi possono essere aggiornati in parallelo.
+    // I valori di una `std::map` hanno indirizzi stabili.
+    std::set<std::vector<Entity*>*> isolatedGroups;
+
+    // Nome del tipo di ogni gruppo, e numero di entità rimosse
+    // dall'ultimo `refresh`: servono solo per la diagnostica.
+    std::map<std::size_t, const char*> groupNames;
+    std::size_t lastDestroyedCount{0};
+
+    // Somma delle entità preparate da `reserve` per tutti i tipi.
+    std::size_t reservedCount{0};
+
+    // Le strutture diagnostiche vengono aggiornate solo per i gruppi
+    // nuovi: inserire nelle mappe allocherebbe ad ogni `create`.
+    template <typename T>
+    void registerGroup(std::vector<Entity*>& mGroup)
+    {
+        auto id(typeid(T).hash_code());
+        if(groupNames.find(id) != std::end(groupNames)) return;
+
+        groupNames.emplace(id, typeid(T).name());
+        if(HasIsolatedUpdate<T>{}) isolatedGroups.emplace(&mGroup);
+    }
+
+    void recycle(std::unique_ptr<Entity>& mUPtr)
+    {
+        pools[typeid(*mUPtr).hash_code()].emplace_back(std::move(mUPtr));
+    }
+
+    template <typename T, typename... TArgs>
+    auto acquire(TArgs&&... mArgs)
+    {
+        auto& pool(pools[typeid(T).hash_code()]);
+        if(pool.empty())
+            return std::unique_ptr<Entity>{
+                std::make_unique<T>(std::forward<TArgs>(mArgs)...)};
+
+        auto uPtr(std::move(pool.back()));
+        pool.pop_back();
+
+        // Il pool contiene solo oggetti di tipo `T`: possiamo
+        // distruggerli e ricostruirli nella stessa memoria.
+        auto ptr(static_cast<T*>(uPtr.get()));
+        ptr->~T();
+
+        try
+        {
+            new(ptr) T(std::forward<TArgs>(mArgs)...);
+        }
+        catch(...)
+        {
+            // L'oggetto è già stato distrutto: liberiamo solo la
+            // memoria, senza chiamare di nuovo il distruttore.
+            uPtr.release();
+            ::operator delete(ptr);
+            throw;
+        }
+
+        return uPtr;
+    }
+
+public:
+    template <typename T, typename... TArgs>
+    T& create(TArgs&&... mArgs)
+    {
+        static_assert(
+            std::is_base_of<Entity, T>(), "`T` must derive from `Entity`");
+
+        auto uPtr(acquire<T>(std::forward<TArgs>(mArgs)...));
+
+        auto ptr(static_cast<T*>(uPtr.get()));
+        ptr->parallelUpdate = HasIsolatedUpdate<T>{};
+
+        auto& group(groupedEntities[typeid(T).hash_code()]);
+        group.emplace_back(ptr);
+        registerGroup<T>(group);
+
+        entities.emplace_back(std::move(uPtr));
+
+        return *ptr;
+    }
+
+    // Prepara `mCount` entità di tipo `T` nel pool, costruite con
+    // `mArgs`, e la capacità dei vettori necessaria: finché non ci
+    // sono più di `mCount` entità `T` attive, `create<T>` non alloca.
+    // Va chiamata una volta per tipo: `entities` viene dimensionato
+    // per la somma di tutte le riserve.
+    template <typename T, typename... TArgs>
+    void reserve(std::size_t mCount, const TArgs&... mArgs)
+    {
+        auto& pool(pools[typeid(T).hash_code()]);
+        pool.reserve(mCount);
+        while(pool.size() < mCount)
+            pool.emplace_back(std::make_unique<T>(mArgs...));
+
+        auto& group(getAll<T>());
+        group.reserve(mCount);
+        registerGroup<T>(group);
+
+        reservedCount += mCount;
+        entities.reserve(reservedCount);
+    }
+
+    void refresh()
+    {
+        TRACE_SCOPE("Manager::refresh");
+
+        for(auto& pair : groupedEntities)
+        {
+            auto& vector(pair.second);
+
+            vector.erase(std::remove_if(std::begin(vector), std::end(vector),
+                             [](auto mPtr)
+                             {
+                                 return mPtr->destroyed;
+                             }),
+                std::end(vector));
+        }
+
+        lastDestroyedCount = 0;
+        for(auto& uPtr : entities)
+            if(uPtr->destroyed)
+            {
+                recycle(uPtr);
+                ++lastDestroyedCount;
+            }
+
+        entities.erase(
+            std::remove(std::begin(entities), std::end(entities), nullptr),
+            std::end(entities));
+    }
+
+    // Anche `clear` restituisce le entità ai pool, e mantiene la
+    // capacità dei vettori.
+    void clear()
+    {
+        for(auto& pair : groupedEntities) pair.second.clear();
+
+        for(auto& uPtr : entities) recycle(uPtr);
+        entities.clear();
+    }
+
+    // Chiama `mFunc(nome, numero di entità)` per ogni gruppo.
+    template <typename TFunc>
+    void forEachGroup(TFunc mFunc) const
+    {
+        for(const auto& pair : groupedEntities)
+            mFunc(groupNames.at(pair.first), pair.second.size());
+    }
+
+    std::size_t getLastDestroyedCount() const noexcept
+    {
+        return lastDestroyedCount;
+    }
+
+    template <typename T>
+    auto& getAll()
+    {
+        return groupedEntities[typeid(T).hash_code()];
+    }
+
+    // La versione `const` non crea il gruppo se non esiste ancora.
+    template <typename T>
+    const std::vector<Entity*>& getAll() const
+    {
+        static const std::vector<Entity*> empty;
+
+        auto itr(groupedEntities.find(typeid(T).hash_code()));
+        return itr != std::end(groupedEntities) ? itr->second : empty;
+    }
+
+    template <typename T, typename TFunc>
+    void forEach(TFunc mFunc)
+    {
+        for(auto ptr : getAll<T>()) mFunc(*static_cast<T*>(ptr));
+    }
+
+    template <typename TA, typename TB>
+    auto view()
+    {
+        // Otteniamo entrambi i gruppi prima di costruire gli span:
+        // `getAll` può inserire nuove chiavi nella mappa.
+        auto& groupA(getAll<TA>());
+        auto& groupB(getAll<TB>());
+
+        return View<TA, TB>{groupA, groupB};
+    }
+
+    template <typename TA, typename TB, typename TFunc>
+    void forEachPair(TFunc mFunc)
+    {
+        view<TA, TB>().forEachPair(mFunc);
+    }
+
+    void update()
+    {
+        for(auto& e : entities) e->update();
+    }
+
+    // Versione parallela di `update`: le entità "non isolate" vengono
+    // aggiornate in ordine sul thread corrente, poi ogni gruppo
+    // isolato viene diviso in blocchi eseguiti sul thread pool.
+    void update(ThreadPool& mPool, std::size_t mGrain = 1024)
+    {
+        TRACE_SCOPE("Manager::update");
+
+        for(auto& e : entities)
+            if(!e->parallelUpdate) e->update();
+
+        for(auto group : isolatedGroups)
+            mPool.parallelFor(group->size(), mGrain,
+                [group](std::size_t mBegin, std::size_t mEnd)
+                {
+                    TRACE_SCOPE("Manager::update chunk");
+                    for(auto i(mBegin); i < mEnd; ++i) (*group)[i]->update();
+                });
+    }
+    void draw(sf::RenderWindow& mTarget)
+    {
+        TRACE_SCOPE("Manager::draw");
+        for(auto& e : entities) e->draw(mTarget);
+    }
+};
+
+// La posizione usata dalla simulazione è `position`, in `Scalar`: la
+// forma SFML viene aggiornata solo prima di essere disegnata.
+// Dimensioni e raggio sono costanti, e restano nella forma.
+struct Rectangle
+{
+    sf::RectangleShape shape;
+    Vec2 position;
+
+    Scalar x() const noexcept { return position.x; }
+    Scalar y() const noexcept { return position.y; }
+    Scalar width() const noexcept { return Scalar(shape.getSize().x); }
+    Scalar height() const noexcept { return Scalar(shape.getSize().y); }
+    Scalar left() const noexcept { return x() - width() / Scalar(2); }
+    Scalar right() const noexcept { return x() + width() / Scalar(2); }
+    Scalar top() const noexcept { return y() - height() / Scalar(2); }
+    Scalar bottom() const noexcept { return y() + height() / Scalar(2); }
+
+    void syncShape() { shape.setPosition(sf::Vector2f(position)); }
+};
+
+struct Circle
+{
+    sf::CircleShape shape;
+    Vec2 position;
+
+    Scalar x() const noexcept { return position.x; }
+    Scalar y() const noexcept { return position.y; }
+    Scalar radius() const noexcept { return Scalar(shape.getRadius()); }
+    Scalar left() const noexcept { return x() - radius(); }
+    Scalar right() const noexcept { return x() + radius(); }
+    Scalar top() const noexcept { return y() - radius(); }
+    Scalar bottom() const noexcept { return y() + radius(); }
+
+    void syncShape() { shape.setPosition(sf::Vector2f(position)); }
+};
+
+class Ball : public Entity, public Circle
+{
+public:
+    static const sf::Color defColor;
+    static constexpr float defRadius{10.f}, defVelocity{8.f};
+
+    // `update` modifica solo la pallina stessa.
+    static constexpr bool isolatedUpdate{true};
+
+    Vec2 velocity{-Scalar(defVelocity), -Scalar(defVelocity)};
+
+    // Giocatore che ha toccato la pallina per ultimo: i mattoncini
+    // che distrugge contano per il suo punteggio.
+    int owner{0};
+
+    // Rallentata dal power-up `SlowBall`: la velocità viene
+    // raddoppiata quando l'effetto scade.
+    bool slowed{false};
+
+    Ball(float mX, float mY)
+    {
+        position = {Scalar(mX), Scalar(mY)};
+        shape.setRadius(defRadius);
+        shape.setFillColor(defColor);
+        shape.setOrigin(defRadius, defRadius);
+    }
+
+    void update() override
+    {
+        position += velocity;
+        solveBoundCollisions();
+    }
+
+    void draw(sf::RenderWindow& mTarget) override
+    {
+        syncShape();
+        mTarget.draw(shape);
+    }
+
+private:
+    void solveBoundCollisions() noexcept
+    {
+        if(left() < Scalar(0) || right() > Scalar(wndWidth))
+            velocity.x = -velocity.x;
+
+        if(top() < Scalar(0)) velocity.y = -velocity.y;
+
+        // Se la pallina ha lasciato la finestra in basso, deve
+        // essere distrutta.
+        else if(bottom() > Scalar(wndHeight))
+            destroyed = true;
+    }
+};
+
+const sf::Color Ball::defColor{sf::Color::Red};
+
+class Paddle : public Entity, public Rectangle
+{
+public:
+    static const sf::Color defColor;
+    static constexpr float defWidth{75.f}, defHeight{20.f};
+    static constexpr float defVelocity{8.f};
+
+    // `update` legge solo l'input e modifica solo il paddle stesso.
+    static constexpr bool isolatedUpdate{true};
+
+    Vec2 velocity;
+
+    // L'input viene letto una volta per frame, nella fase "input"
+    // del game loop, e copiato qui prima dell'`update`.
+    struct Input
+    {
+        bool left{false}, right{false};
+    };
+
+    Input input;
+
+    // Indice del giocatore che controlla il paddle.
+    int player{0};
+
+    // Il paddle non esce dalla sua corsia orizzontale. In "versus"
+    // ogni giocatore ha la sua metà dello schermo: i paddle non si
+    // sovrappongono mai, e nessuno dei due ha la precedenza sulle
+    // palline.
+    Scalar laneLeft{0}, laneRight{Scalar(wndWidth)};
+
+    Paddle(float mX, float mY)
+    {
+        position = {Scalar(mX), Scalar(mY)};
+        shape.setFillColor(defColor);
+        setWide(false);
+    }
+
+    // Il power-up `WidePaddle` allarga il paddle del 50%.
+    void setWide(bool mWide)
+    {
+        auto width(mWide ? defWidth * 1.5f : defWidth);
+        shape.setSize({width, defHeight});
+        shape.setOrigin(width / 2.f, defHeight / 2.f);
+    }
+
+    bool isWide() const noexcept { return shape.getSize().x > defWidth; }
+
+    void update() override
+    {
+        processPlayerInput();
+        position += velocity;
+
+        auto halfWidth(width() / Scalar(2));
+        position.x = std::max(laneLeft + halfWidth,
+            std::min(position.x, laneRight - halfWidth));
+    }
+
+    void draw(sf::RenderWindow& mTarget) override
+    {
+        syncShape();
+        mTarget.draw(shape);
+    }
+
+private:
+    void processPlayerInput()
+    {
+        if(input.left && left() > laneLeft)
+            velocity.x = -Scalar(defVelocity);
+        else if(input.right && right() < laneRight)
+            velocity.x = Scalar(defVelocity);
+        else
+            velocity.x = Scalar(0);
+    }
+};
+
+const sf::Color Paddle::defColor{sf::Color::Red};
+
+// Un power-up cade da un mattoncino distrutto, e ha effetto quando
+// tocca un paddle. I power-up sono entità come le altre, ma il loro
+// numero è limitato e il `World` le prealloca con
+// `Manager::reserve`: crearle durante la partita non alloca.
+class PowerUp : public Entity, public Rectangle
+{
+public:
+    enum class Type : std::uint8_t
+    {
+        // Due palline aggiuntive, copiate dalla prima.
+        MultiBall,
+
+        // Paddle più largo per `wideDuration` tick.
+        WidePaddle,
+
+        // Palline a metà velocità per `slowDuration` tick.
+        SlowBall,
+
+        Count
+    };
+
+    static constexpr float defWidth{24.f}, defHeight{12.f};
+    static constexpr float defVelocity{3.f};
+    static constexpr std::size_t maxActive{16};
+    static constexpr std::uint64_t wideDuration{600}, slowDuration{480};
+
+    static constexpr bool isolatedUpdate{true};
+
+    Type type;
+
+    PowerUp(float mX, float mY, Type mType) : type{mType}
+    {
+        position = {Scalar(mX), Scalar(mY)};
+        shape.setSize({defWidth, defHeight});
+        shape.setOrigin(defWidth / 2.f, defHeight / 2.f);
+        shape.setFillColor(getColor(mType));
+    }
+
+    void update() override
+    {
+        position.y += Scalar(defVelocity);
+        if(top() > Scalar(wndHeight)) destroyed = true;
+    }
+
+    void draw(sf::RenderWindow& mTarget) override
+    {
+        syncShape();
+        mTarget.draw(shape);
+    }
+
+    static sf::Color getColor(Type mType) noexcept
+    {
+        switch(mType)
+        {
+            case Type::MultiBall: return sf::Color::Green;
+            case Type::WidePaddle: return sf::Color::Cyan;
+            default: return sf::Color::Magenta;
+        }
+    }
+};
+
+void solvePaddleBallCollision(const Paddle& mPaddle, Ball& mBall) noexcept
+{
+    if(!isIntersecting(mPaddle, mBall)) return;
+
+    mBall.owner = mPaddle.player;
+
+    mBall.position.y = mPaddle.top() - mBall.radius() * Scalar(2);
+
+    auto paddleBallDiff(mBall.x() - mPaddle.x());
+    auto posFactor(paddleBallDiff / mPaddle.width());
+    auto velFactor(mPaddle.velocity.x * Scalar(0.05f));
+
+    Vec2 collisionVec{posFactor + velFactor, Scalar(-2)};
+
+    mBall.velocity = getReflected(mBall.velocity, getNormalized(collisionVec));
+}
+
+// I livelli vengono salvati in un formato binario compatto e
+// versionato, pensato per essere letto direttamente dalla memoria
+// (mappata con `mmap`) senza alcun parsing. Il layout è:
+// * un `LevelHeader`;
+// * `spawnCount` strutture `LevelSpawn`;
+// * `width * height` byte, uno per cella, riga per riga.
+// I valori sono salvati nell'ordine dei byte della macchina.
+struct LevelHeader
+{
+    static constexpr char defMagic[4]{'A', 'R', 'K', 'L'};
+    static constexpr std::uint16_t defVersion{1};
+
+    char magic[4];
+    std::uint16_t version;
+    std::uint16_t spawnCount;
+    std::uint32_t width, height;
+
+    // Dimensioni di una cella, spaziatura tra le celle e centro
+    // della prima cella.
+    float cellWidth, cellHeight, spacing;
+    float originX, originY;
+};
+
+constexpr char LevelHeader::defMagic[4];
+
+struct LevelSpawn
+{
+    enum Type : std::uint32_t
+    {
+        Ball = 0,
+        Paddle = 1
+    };
+
+    std::uint32_t type;
+    float x, y;
+};
+
+static_assert(std::is_trivially_copyable<LevelHeader>() &&
+                  std::is_trivially_copyable<LevelSpawn>(),
+    "Level structures must be trivially copyable");
+
+// In ogni cella, i due bit meno significativi contengono i colpi
+// richiesti (0 = cella vuota). Gli altri bit sono riservati al tipo
+// di mattoncino.
+constexpr std::uint8_t levelCellHitsMask{0x3};
+
+// Una `LevelView` non possiede la memoria del livello: punta
+// direttamente ai dati validati.
+class LevelView
+{
+private:
+    const LevelHeader* header{nullptr};
+    const LevelSpawn* spawns{nullptr};
+    const std::uint8_t* cells{nullptr};
+
+public:
+    static bool fromMemory(
+        const void* mData, std::size_t mSize, LevelView& mView) noexcept
+    {
+        auto bytes(static_cast<const char*>(mData));
+        if(mSize < sizeof(LevelHeader)) return false;
+
+        auto h(reinterpret_cast<const LevelHeader*>(bytes));
+        if(std::memcmp(h->magic, LevelHeader::defMagic, 4) != 0 ||
+            h->version != LevelHeader::defVersion)
+            return false;
+
+        // La geometria deve essere sensata: `BrickField` e il
+        // ray-cast dividono per il passo delle celle, e gli indici delle
+        // celle sono a 32 bit.
+        auto cellCount(std::uint64_t(h->width) * h->height);
+        if(cellCount == 0 ||
+            cellCount > std::numeric_limits<std::uint32_t>::max())
+            return false;
+
+        if(!(h->cellWidth > 0.f) || !(h->cellHeight > 0.f) ||
+            !(h->spacing >= 0.f) || !std::isfinite(h->cellWidth) ||
+            !std::isfinite(h->cellHeight) || !std::isfinite(h->spacing) ||
+            !std::isfinite(h->originX) || !std::isfinite(h->originY))
+            return false;
+
+        auto required(sizeof(LevelHeader) +
+                      sizeof(LevelSpawn) * h->spawnCount + cellCount);
+        if(mSize < required) return false;
+
+        mView.header = h;
+        mView.spawns =
+            reinterpret_cast<const LevelSpawn*>(bytes + sizeof(LevelHeader));
+        mView.cells = reinterpret_cast<const std::uint8_t*>(
+            bytes + sizeof(LevelHeader) + sizeof(LevelSpawn) * h->spawnCount);
+
+        return true;
+    }
+
+    bool isValid() const noexcept { return header != nullptr; }
+    const LevelHeader& getHeader() const noexcept { return *header; }
+
+    auto getSpawnCount() const noexcept { return header->spawnCount; }
+    const auto& getSpawn(std::size_t mI) const noexcept
+    {
+        return spawns[mI];
+    }
+
+    int getHits(std::size_t mX, std::size_t mY) const noexcept
+    {
+        return cells[mY * header->width + mX] & levelCellHitsMask;
+    }
+
+    // Centro della cella `(mX, mY)` in coordinate del mondo.
+    sf::Vector2f getCellCenter(std::size_t mX, std::size_t mY) const noexcept
+    {
+        return {header->originX + mX * (header->cellWidth + header->spacing),
+            header->originY + mY * (header->cellHeight + header->spacing)};
+    }
+};
+
+// Un file mappato in memoria in sola lettura.
+class MappedFile
+{
+private:
+    void* data{nullptr};
+    std::size_t size{0};
+
+    void unmap() noexcept
+    {
+        if(data != nullptr) ::munmap(data, size);
+        data = nullptr;
+        size = 0;
+    }
+
+public:
+    MappedFile() = default;
+    ~MappedFile() { unmap(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& mPath)
+    {
+        unmap();
+
+        auto fd(::open(mPath.c_str(), O_RDONLY));
+        if(fd < 0) return false;
+
+        struct stat st;
+        if(::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            auto ptr(
+                ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+            if(ptr != MAP_FAILED)
+            {
+                data = ptr;
+                size = st.st_size;
+            }
+        }
+
+        // Il mapping resta valido anche dopo la chiusura del file.
+        ::close(fd);
+        return data != nullptr;
+    }
+
+    void swap(MappedFile& mOther) noexcept
+    {
+        std::swap(data, mOther.data);
+        std::swap(size, mOther.size);
+    }
+
+    const void* getData() const noexcept { return data; }
+    auto getSize() const noexcept { return size; }
+};
+
+// Costruisce un livello in memoria, nello stesso formato dei file.
+std::vector<char> buildLevel(LevelHeader mHeader,
+    const std::vector<LevelSpawn>& mSpawns,
+    const std::vector<std::uint8_t>& mCells)
+{
+    std::memcpy(mHeader.magic, LevelHeader::defMagic, 4);
+    mHeader.version = LevelHeader::defVersion;
+    mHeader.spawnCount = mSpawns.size();
+
+    std::vector<char> result(sizeof(LevelHeader) +
+                             sizeof(LevelSpawn) * mSpawns.size() +
+                             mCells.size());
+
+    auto ptr(result.data());
+    std::memcpy(ptr, &mHeader, sizeof(LevelHeader));
+    ptr += sizeof(LevelHeader);
+
+    if(!mSpawns.empty())
+        std::memcpy(ptr, mSpawns.data(), sizeof(LevelSpawn) * mSpawns.size());
+    ptr += sizeof(LevelSpawn) * mSpawns.size();
+
+    if(!mCells.empty()) std::memcpy(ptr, mCells.data(), mCells.size());
+    return result;
+}
+
+// Rettangolo allineato agli assi, con la stessa interfaccia di
+// `Rectangle`, usato per le celle della griglia di mattoncini. La
+// simulazione usa `ScalarBox`, il rendering e i ray-cast `Box`.
+template <typename T>
+struct BasicBox
+{
+    T l, t, r, b;
+
+    T x() const noexcept { return (l + r) / T(2); }
+    T y() const noexcept { return (t + b) / T(2); }
+    T left() const noexcept { return l; }
+    T right() const noexcept { return r; }
+    T top() const noexcept { return t; }
+    T bottom() const noexcept { return b; }
+};
+
+using Box = BasicBox<float>;
+using ScalarBox = BasicBox<Scalar>;
+
+// Risultato di un ray-cast: punto di impatto, normale della
+// superficie colpita e distanza dall'origine. `cell` è la cella del
+// mattoncino colpito, o `noCell` se il raggio ha colpito un bordo.
+struct RayHit
+{
+    static constexpr std::uint32_t noCell{
+        std::numeric_limits<std::uint32_t>::max()};
+
+    sf::Vector2f point, normal;
+    float distance{0.f};
+    std::uint32_t cell{noCell};
+};
+
+// Restringe `[mT0, mT1]` alla parte del raggio `mO + mD * t` interna a
+// `mBox` (metodo "slab"). Se il raggio entra nel box dopo `mT0`,
+// `mNormal` diventa la normale della faccia di ingresso.
+bool clipRayToBox(const Box& mBox, sf::Vector2f mO, sf::Vector2f mD,
+    float& mT0, float& mT1, sf::Vector2f& mNormal) noexcept
+{
+    const float o[]{mO.x, mO.y}, d[]{mD.x, mD.y};
+    const float lo[]{mBox.l, mBox.t}, hi[]{mBox.r, mBox.b};
+
+    for(int a{0}; a < 2; ++a)
+    {
+        if(d[a] == 0.f)
+        {
+            if(o[a] < lo[a] || o[a] > hi[a]) return false;
+            continue;
+        }
+
+        auto tNear((lo[a] - o[a]) / d[a]), tFar((hi[a] - o[a]) / d[a]);
+        auto sign(-1.f);
+        if(tNear > tFar)
+        {
+            std::swap(tNear, tFar);
+            sign = 1.f;
+        }
+
+        if(tNear > mT0)
+        {
+            mT0 = tNear;
+            mNormal = a == 0 ? sf::Vector2f{sign, 0.f}
+                             : sf::Vector2f{0.f, sign};
+        }
+
+        mT1 = std::min(mT1, tFar);
+        if(mT0 > mT1) return false;
+    }
+
+    return true;
+}
+
+// Un mattoncino è definito solo dalla sua cella (che implica la
+// posizione) e dai colpi richiesti (da 1 a 3). Invece di creare
+// un'entità per ogni mattoncino, il `BrickField` li conserva in una
+// griglia compatta:
+// * 2 bit per cella con i colpi richiesti;
+// * una bitset per riga con le celle occupate, che permette di
+//   contare e visitare velocemente i mattoncini rimasti.
+class BrickField
+{
+public:
+    static const sf::Color defClHits1;
+    static const sf::Color defClHits2;
+    static const sf::Color defClHits3;
+    static constexpr float defWidth{60.f}, defHeight{20.f};
+
+private:
+    static constexpr std::uint32_t cellsPerHitWord{32};
+
+    std::uint32_t width{0}, height{0}, wordsPerRow{0};
+    float cellWidth{defWidth}, cellHeight{defHeight};
+    float pitchX{defWidth}, pitchY{defHeight};
+
+    // Angolo in alto a sinistra della cella `(0, 0)`.
+    float gridLeft{0.f}, gridTop{0.f};
+
+    std::vector<std::uint64_t> hitWords;
+    std::vector<std::uint64_t> rowBits;
+
+    // Celle modificate dall'ultima chiamata a `clearChanges`, e un
+    // contatore incrementato ad ogni `assign`. Servono al rendering.
+    std::vector<std::uint32_t> changedCells;
+    std::uint64_t generation{0};
+
+    void setHits(std::uint32_t mCell, int mHits) noexcept
+    {
+        auto& word(hitWords[mCell / cellsPerHitWord]);
+        auto shift((mCell % cellsPerHitWord) * 2);
+        word = (word & ~(std::uint64_t(3) << shift)) |
+               (std::uint64_t(mHits) << shift);
+
+        auto x(mCell % width), y(mCell / width);
+        auto& bits(rowBits[y * wordsPerRow + x / 64]);
+        auto mask(std::uint64_t(1) << (x % 64));
+        bits = mHits > 0 ? (bits | mask) : (bits & ~mask);
+    }
+
+    bool isLive(std::uint32_t mX, std::uint32_t mY) const noexcept
+    {
+        return (rowBits[mY * wordsPerRow + mX / 64] >> (mX % 64)) & 1;
+    }
+
+    // Visita le celle occupate della riga `mY` con `mX0 <= x <= mX1`.
+    template <typename TFunc>
+    void forEachLiveInRow(std::uint32_t mY, std::uint32_t mX0,
+        std::uint32_t mX1, TFunc&& mFunc) const
+    {
+        const auto* row(&rowBits[mY * wordsPerRow]);
+
+        for(auto w(mX0 / 64); w <= mX1 / 64; ++w)
+        {
+            auto bits(row[w]);
+
+            // Mascheriamo i bit fuori dall'intervallo richiesto.
+            if(w == mX0 / 64) bits &= ~std::uint64_t(0) << (mX0 % 64);
+            if(w == mX1 / 64 && mX1 % 64 != 63)
+                bits &= (std::uint64_t(1) << (mX1 % 64 + 1)) - 1;
+
+            while(bits != 0)
+            {
+                auto x(w * 64 + __builtin_ctzll(bits));
+                mFunc(mY * width + x);
+                bits &= bits - 1;
+            }
+        }
+    }
+
+public:
+    void assign(const LevelView& mLevel)
+    {
+        const auto& h(mLevel.getHeader());
+
+        width = h.width;
+        height = h.height;
+        wordsPerRow = (width + 63) / 64;
+        cellWidth = h.cellWidth;
+        cellHeight = h.cellHeight;
+        pitchX = h.cellWidth + h.spacing;
+        pitchY = h.cellHeight + h.spacing;
+        gridLeft = h.originX - cellWidth / 2.f;
+        gridTop = h.originY - cellHeight / 2.f;
+
+        auto cellCount(std::size_t(width) * height);
+        hitWords.assign((cellCount + cellsPerHitWord - 1) / cellsPerHitWord, 0);
+        rowBits.assign(std::size_t(wordsPerRow) * height, 0);
+
+        for(std::uint32_t iY{0}; iY < height; ++iY)
+            for(std::uint32_t iX{0}; iX < width; ++iX)
+                setHits(iY * width + iX, mLevel.getHits(iX, iY));
+
+        changedCells.clear();
+        ++generation;
+    }
+
+    auto getWidth() const noexcept { return width; }
+    auto getHeight() const noexcept { return height; }
+
+    int getHits(std::uint32_t mCell) const noexcept
+    {
+        auto shift((mCell % cellsPerHitWord) * 2);
+        return (hitWords[mCell / cellsPerHitWord] >> shift) & 3;
+    }
+
+    Box getCellBox(std::uint32_t mCell) const noexcept
+    {
+        auto l(gridLeft + (mCell % width) * pitchX);
+        auto t(gridTop + (mCell / width) * pitchY);
+        return {l, t, l + cellWidth, t + cellHeight};
+    }
+
+    // Come `getCellBox`, ma calcolato in `Scalar` per la simulazione.
+    ScalarBox getCellBounds(std::uint32_t mCell) const noexcept
+    {
+        auto l(Scalar(gridLeft) + Scalar(mCell % width) * Scalar(pitchX));
+        auto t(Scalar(gridTop) + Scalar(mCell / width) * Scalar(pitchY));
+        return {l, t, l + Scalar(cellWidth), t + Scalar(cellHeight)};
+    }
+
+    // Trova in O(1) la cella che contiene `mPos`. Restituisce `false`
+    // se il punto è fuori dalla griglia o nello spazio tra le celle.
+    bool getCellAt(sf::Vector2f mPos, std::uint32_t& mCell) const noexcept
+    {
+        auto fx((mPos.x - gridLeft) / pitchX);
+        auto fy((mPos.y - gridTop) / pitchY);
+        if(fx < 0.f || fy < 0.f || fx >= width || fy >= height) return false;
+
+        auto x(static_cast<std::uint32_t>(fx));
+        auto y(static_cast<std::uint32_t>(fy));
+        if((fx - x) * pitchX > cellWidth || (fy - y) * pitchY > cellHeight)
+            return false;
+
+        mCell = y * width + x;
+        return true;
+    }
+
+    // Numero di mattoncini rimasti, contando i bit delle righe.
+    std::size_t countLive() const noexcept
+    {
+        std::size_t result{0};
+        for(auto bits : rowBits) result += __builtin_popcountll(bits);
+        return result;
+    }
+
+    template <typename TFunc>
+    void forEachLive(TFunc&& mFunc) const
+    {
+        if(width == 0) return;
+        for(std::uint32_t iY{0}; iY < height; ++iY)
+            forEachLiveInRow(iY, 0, width - 1, mFunc);
+    }
+
+    // Visita le celle occupate che possono intersecare `mBox`.
+    template <typename T, typename TFunc>
+    void forEachLiveNear(const T& mBox, TFunc&& mFunc) const
+    {
+        auto toCell([](float mV, float mPitch, std::uint32_t mCount)
+            {
+                return static_cast<std::int64_t>(std::min(
+                    std::max(std::floor(mV / mPitch), -1.f), float(mCount)));
+            });
+
+        auto x0(toCell(float(mBox.left()) - gridLeft, pitchX, width));
+        auto x1(toCell(float(mBox.right()) - gridLeft, pitchX, width));
+        auto y0(toCell(float(mBox.top()) - gridTop, pitchY, height));
+        auto y1(toCell(float(mBox.bottom()) - gridTop, pitchY, height));
+
+        x0 = std::max<std::int64_t>(x0, 0);
+        y0 = std::max<std::int64_t>(y0, 0);
+        x1 = std::min<std::int64_t>(x1, std::int64_t(width) - 1);
+        y1 = std::min<std::int64_t>(y1, std::int64_t(height) - 1);
+        if(x0 > x1 || y0 > y1) return;
+
+        for(auto iY(y0); iY <= y1; ++iY)
+            forEachLiveInRow(iY, x0, x1, mFunc);
+    }
+
+    // Trova il primo mattoncino colpito da un cerchio di raggio
+    // `mRadius` che si muove da `mOrigin` lungo `mDir` (normalizzata)
+    // per al massimo `mMaxDistance`. Le celle vengono visitate in
+    // ordine lungo il raggio (DDA): la ricerca si ferma alla prima
+    // cella che contiene un impatto. Con un raggio positivo vengono
+    // controllate anche le celle vicine, fino a `mRadius` di distanza
+    // su ogni asse.
+    bool raycast(sf::Vector2f mOrigin, sf::Vector2f mDir, float mRadius,
+        float mMaxDistance, RayHit& mHit) const noexcept
+    {
+        if(width == 0 || height == 0) return false;
+
+        const Box bounds{gridLeft - mRadius, gridTop - mRadius,
+            gridLeft + width * pitchX + mRadius,
+            gridTop + height * pitchY + mRadius};
+
+        float t{0.f}, tExit{mMaxDistance};
+        sf::Vector2f unused;
+        if(!clipRayToBox(bounds, mOrigin, mDir, t, tExit, unused))
+            return false;
+
+        // Numero di celle vicine da controllare su ogni asse: con un
+        // passo più piccolo del raggio, il cerchio può toccare
+        // mattoncini a più celle di distanza dal suo centro.
+        auto reachX(static_cast<int>(std::ceil(mRadius / pitchX)));
+        auto reachY(static_cast<int>(std::ceil(mRadius / pitchY)));
+
+        // Le celle fuori dalla griglia sono vuote, ma servono per
+        // avvicinarsi ai bordi: il centro del cerchio può trovarsi
+        // fino a `reach` celle oltre la griglia.
+        auto toCell([](float mV, float mPitch, std::uint32_t mCount,
+                        int mReach)
+            {
+                return static_cast<int>(
+                    std::min(std::max(std::floor(mV / mPitch), -1.f - mReach),
+                        float(mCount + mReach)));
+            });
+
+        auto start(mOrigin + mDir * t);
+        auto iX(toCell(start.x - gridLeft, pitchX, width, reachX));
+        auto iY(toCell(start.y - gridTop, pitchY, height, reachY));
+
+        const auto inf(std::numeric_limits<float>::infinity());
+        int stepX(mDir.x > 0.f ? 1 : -1), stepY(mDir.y > 0.f ? 1 : -1);
+
+        auto tMaxX(mDir.x != 0.f ? (gridLeft + (iX + (stepX > 0)) * pitchX -
+                                       mOrigin.x) / mDir.x
+                                 : inf);
+        auto tMaxY(mDir.y != 0.f ? (gridTop + (iY + (stepY > 0)) * pitchY -
+                                       mOrigin.y) / mDir.y
+                                 : inf);
+        auto tDeltaX(mDir.x != 0.f ? pitchX / std::abs(mDir.x) : inf);
+        auto tDeltaY(mDir.y != 0.f ? pitchY / std::abs(mDir.y) : inf);
+
+        auto found(false);
+        mHit.distance = tExit;
+
+        while(true)
+        {
+            auto x0(std::max(iX - reachX, 0));
+            auto x1(std::min(iX + reachX, int(width) - 1));
+            auto y0(std::max(iY - reachY, 0));
+            auto y1(std::min(iY + reachY, int(height) - 1));
+
+            for(auto cY(y0); cY <= y1; ++cY)
+                for(auto cX(x0); cX <= x1; ++cX)
+                {
+                    if(!isLive(cX, cY)) continue;
+
+                    auto cell(std::uint32_t(cY) * width + cX);
+                    auto box(getCellBox(cell));
+                    box = {box.l - mRadius, box.t - mRadius,
+                        box.r + mRadius, box.b + mRadius};
+
+                    // Ignoriamo i mattoncini che contengono già
+                    // l'origine: la normale resta nulla.
+                    float t0{0.f}, t1{mHit.distance};
+                    sf::Vector2f normal;
+                    if(!clipRayToBox(box, mOrigin, mDir, t0, t1, normal) ||
+                        normal == sf::Vector2f{} || t0 >= mHit.distance)
+                        continue;
+
+                    mHit.distance = t0;
+                    mHit.normal = normal;
+                    mHit.cell = cell;
+                    found = true;
+                }
+
+            // Gli impatti successivi sono tutti più lontani.
+            auto tNext(std::min({tMaxX, tMaxY, tExit}));
+            if(tNext >= mHit.distance || tNext >= tExit) break;
+
+            if(tMaxX < tMaxY)
+            {
+                iX += stepX;
+                tMaxX += tDeltaX;
+            }
+            else
+            {
+                iY += stepY;
+                tMaxY += tDeltaY;
+            }
+
+            if(iX < -1 - reachX || iY < -1 - reachY ||
+                iX > int(width) + reachX || iY > int(height) + reachY)
+                break;
+        }
+
+        if(found) mHit.point = mOrigin + mDir * mHit.distance;
+        return found;
+    }
+
+    // Toglie un colpo al mattoncino. Restituisce `true` se è stato
+    // distrutto.
+    bool damage(std::uint32_t mCell)
+    {
+        auto hits(getHits(mCell));
+        if(hits == 0) return false;
+
+        setHits(mCell, hits - 1);
+        changedCells.emplace_back(mCell);
+        return hits == 1;
+    }
+
+    const auto& getChangedCells() const noexcept { return changedCells; }
+    void clearChanges() noexcept { changedCells.clear(); }
+
+    // Prepara spazio per `mCount` modifiche tra due `clearChanges`.
+    void reserveChanges(std::size_t mCount) { changedCells.reserve(mCount); }
+
+    // Numero massimo di celle visitate da `forEachLiveNear` per un
+    // rettangolo di dimensioni `mWidth` x `mHeight`.
+    std::size_t getMaxCellsNear(float mWidth, float mHeight) const noexcept
+    {
+        auto count([](float mSize, float mPitch, std::uint32_t mCells)
+            {
+                return std::min<std::size_t>(
+                    static_cast<std::size_t>(mSize / mPitch) + 2, mCells);
+            });
+
+        return count(mWidth, pitchX, width) * count(mHeight, pitchY, height);
+    }
+
+    // Lo stato dinamico del campo sono i colpi e i bit delle righe:
+    // vengono copiati così come sono. Le dimensioni devono
+    // corrispondere a quelle del livello corrente.
+    std::size_t getStateSize() const noexcept
+    {
+        return (hitWords.size() + rowBits.size()) * sizeof(std::uint64_t);
+    }
+
+    void saveState(char* mOut) const noexcept
+    {
+        auto hitBytes(hitWords.size() * sizeof(std::uint64_t));
+        std::memcpy(mOut, hitWords.data(), hitBytes);
+        std::memcpy(mOut + hitBytes, rowBits.data(),
+            rowBits.size() * sizeof(std::uint64_t));
+    }
+
+    // Parole da 64 bit con i colpi di 32 celle ciascuna: usate per
+    // trasmettere il campo in rete.
+    const std::vector<std::uint64_t>& getHitWords() const noexcept
+    {
+        return hitWords;
+    }
+
+    // Sostituisce i colpi di tutte le celle. Solo le celle cambiate
+    // vengono aggiornate e segnalate al renderer. Le parole arrivano
+    // dalla rete: i bit dell'ultima parola oltre l'ultima cella
+    // vengono ignorati.
+    void assignHitWords(const std::uint64_t* mWords)
+    {
+        auto cellCount(std::size_t(width) * height);
+        auto tailBits((cellCount % cellsPerHitWord) * 2);
+
+        for(std::size_t w{0}; w < hitWords.size(); ++w)
+        {
+            auto word(mWords[w]);
+            if(w + 1 == hitWords.size() && tailBits != 0)
+                word &= (std::uint64_t(1) << tailBits) - 1;
+
+            auto diff(hitWords[w] ^ word);
+
+            while(diff != 0)
+            {
+                auto bit(__builtin_ctzll(diff));
+                auto cell(std::uint32_t(w * cellsPerHitWord + bit / 2));
+                auto hits(int((word >> (bit / 2 * 2)) & 3));
+
+                setHits(cell, hits);
+                changedCells.emplace_back(cell);
+                diff &= ~(std::uint64_t(3) << (bit / 2 * 2));
+            }
+        }
+    }
+
+    void loadState(const char* mIn) noexcept
+    {
+        auto hitBytes(hitWords.size() * sizeof(std::uint64_t));
+        std::memcpy(hitWords.data(), mIn, hitBytes);
+        std::memcpy(rowBits.data(), mIn + hitBytes,
+            rowBits.size() * sizeof(std::uint64_t));
+
+        // Il renderer deve ricostruire tutti i colori.
+        changedCells.clear();
+        ++generation;
+    }
+    auto getGeneration() const noexcept { return generation; }
+
+    static const sf::Color& getColor(int mHits) noexcept
+    {
+        if(mHits == 1) return defClHits1;
+        if(mHits == 2) return defClHits2;
+        return defClHits3;
+    }
+};
+
+const sf::Color BrickField::defClHits1{255, 255, 0, 80};
+const sf::Color BrickField::defClHits2{255, 255, 0, 170};
+const sf::Color BrickField::defClHits3{255, 255, 0, 255};
+
+// Come `BrickField::raycast`, ma considera anche i bordi sinistro,
+// destro e superiore della finestra. Dal bordo inferiore il raggio
+// esce senza colpire nulla.
+bool castRay(const BrickField& mBricks, sf::Vector2f mOrigin,
+    sf::Vector2f mDir, float mRadius, float mMaxDistance, RayHit& mHit)
+{
+    RayHit wall;
+    wall.distance = mMaxDistance;
+    auto hitWall(false);
+
+    auto tryWall([&](float mT, sf::Vector2f mNormal)
+        {
+            if(mT < 0.f || mT >= wall.distance) return;
+
+            wall.distance = mT;
+            wall.normal = mNormal;
+            hitWall = true;
+        });
+
+    if(mDir.y > 0.f)
+        wall.distance = std::min(wall.distance,
+            std::max(0.f, (wndHeight + mRadius - mOrigin.y) / mDir.y));
+
+    if(mDir.x < 0.f) tryWall((mRadius - mOrigin.x) / mDir.x, {1.f, 0.f});
+    if(mDir.x > 0.f)
+        tryWall((wndWidth - mRadius - mOrigin.x) / mDir.x, {-1.f, 0.f});
+    if(mDir.y < 0.f) tryWall((mRadius - mOrigin.y) / mDir.y, {0.f, 1.f});
+
+    if(mBricks.raycast(mOrigin, mDir, mRadius, wall.distance, mHit))
+        return true;
+
+    if(!hitWall) return false;
+
+    wall.point = mOrigin + mDir * wall.distance;
+    mHit = wall;
+    return true;
+}
+
+// Segue il raggio attraverso al massimo `mMaxBounces` rimbalzi,
+// finché non ha percorso `mMaxDistance`. Scrive gli impatti in
+// `mHits` e restituisce quanti sono.
+std::size_t castBouncingRay(const BrickField& mBricks, sf::Vector2f mOrigin,
+    sf::Vector2f mDir, float mRadius, float mMaxDistance, RayHit* mHits,
+    std::size_t mMaxBounces)
+{
+    std::size_t count{0};
+
+    for(; count < mMaxBounces; ++count)
+    {
+        auto& hit(mHits[count]);
+        if(!castRay(mBricks, mOrigin, mDir, mRadius, mMaxDistance, hit))
+            break;
+
+        mMaxDistance -= hit.distance;
+
+        // Ripartiamo leggermente staccati dalla superficie, per non
+        // colpirla di nuovo.
+        mOrigin = hit.point + hit.normal * 1e-3f;
+        mDir = getReflected(mDir, hit.normal);
+    }
+
+    return count;
+}
+
+// Disegna un `BrickField` come un singolo `sf::VertexArray`. I
+// vertici vengono ricostruiti solo quando cambia il livello; ad ogni
+// frame vengono aggiornati solo i colori delle celle modificate.
+class BrickFieldRenderer
+{
+private:
+    sf::VertexArray quads{sf::Quads};
+    std::vector<std::uint32_t> cellIds;
+    std::uint64_t generation{0};
+
+    void setColor(std::size_t mQuad, sf::Color mColor) noexcept
+    {
+        for(std::size_t i{0}; i < 4; ++i) quads[mQuad * 4 + i].color = mColor;
+    }
+
+public:
+    void sync(const BrickField& mField)
+    {
+        if(generation != mField.getGeneration())
+        {
+            generation = mField.getGeneration();
+            quads.clear();
+            cellIds.clear();
+
+            mField.forEachLive([&](std::uint32_t mCell)
+                {
+                    auto box(mField.getCellBox(mCell));
+                    const auto& color(
+                        BrickField::getColor(mField.getHits(mCell)));
+
+                    quads.append({{box.l, box.t}, color});
+                    quads.append({{box.r, box.t}, color});
+                    quads.append({{box.r, box.b}, color});
+                    quads.append({{box.l, box.b}, color});
+                    cellIds.emplace_back(mCell);
+                });
+
+            return;
+        }
+
+        // `cellIds` è ordinato: troviamo il quad di ogni cella
+        // modificata con una ricerca binaria.
+        for(auto cell : mField.getChangedCells())
+        {
+            auto itr(std::lower_bound(
+                std::begin(cellIds), std::end(cellIds), cell));
+            if(itr == std::end(cellIds) || *itr != cell) continue;
+
+            auto hits(mField.getHits(cell));
+            setColor(itr - std::begin(cellIds),
+                hits > 0 ? BrickField::getColor(hits) : sf::Color::Transparent);
+        }
+    }
+
+    void draw(sf::RenderWindow& mTarget) const { mTarget.draw(quads); }
+};
+
+// Sistema di particelle per gli effetti visivi (detriti e scintille).
+// Le particelle non sono entità: ogni attributo è un array separato
+// ("structure of arrays"), e l'integrazione è un ciclo senza salti
+// che il compilatore può vettorizzare. Gli array hanno capacità
+// fissa e sono usati come buffer circolare: quando è pieno, le
+// particelle più vecchie vengono sovrascritte. Tutte le particelle
+// sono disegnate con una sola chiamata a `draw`, da un unico array
+// di vertici.
+//
+// Le particelle non fanno parte della simulazione: non vengono
+// salvate nei savestate e usano un proprio generatore casuale.
+class ParticleSystem
+{
+public:
+    static constexpr std::size_t capacity{4096};
+    static constexpr float gravity{0.15f};
+
+private:
+    std::vector<float> x, y, vx, vy, life, invMaxLife, size;
+    std::vector<sf::Color> colors;
+
+    // Le particelle attive sono le `count` che precedono `head`.
+    std::size_t head{0}, count{0};
+
+    // Particelle che possono essere create in un frame: un'esplosione
+    // di mattoncini non può far crescere il costo del frame oltre
+    // questo limite.
+    std::size_t frameBudget, frameSpawned{0};
+    std::uint64_t spawned{0}, overBudget{0};
+
+    Rng rng{0, RngStream::Effects};
+    std::vector<sf::Vertex> vertices;
+
+    float getRandom(float mMin, float mMax) noexcept
+    {
+        return mMin + (mMax - mMin) * rng.getUnit();
+    }
+
+    void spawn(float mX, float mY, float mSpeed, float mLife, float mSize,
+        sf::Color mColor) noexcept
+    {
+        if(frameSpawned >= frameBudget)
+        {
+            ++overBudget;
+            return;
+        }
+
+        auto angle(getRandom(0.f, 6.2831853f));
+        auto speed(getRandom(0.3f, 1.f) * mSpeed);
+        auto i(head);
+
+        x[i] = mX;
+        y[i] = mY;
+        vx[i] = std::cos(angle) * speed;
+        vy[i] = std::sin(angle) * speed;
+        life[i] = getRandom(0.5f, 1.f) * mLife;
+        invMaxLife[i] = 1.f / life[i];
+        size[i] = mSize;
+        colors[i] = mColor;
+
+        head = (head + 1) % capacity;
+        if(count < capacity) ++count;
+        ++frameSpawned;
+        ++spawned;
+    }
+
+    // Integra le particelle in `[mBegin, mEnd)`.
+    void integrate(std::size_t mBegin, std::size_t mEnd) noexcept
+    {
+        for(auto i(mBegin); i < mEnd; ++i)
+        {
+            vy[i] += gravity;
+            x[i] += vx[i];
+            y[i] += vy[i];
+            life[i] -= 1.f;
+        }
+    }
+
+    std::size_t getTail() const noexcept
+    {
+        return (head + capacity - count) % capacity;
+    }
+
+public:
+    ParticleSystem(std::size_t mFrameBudget = 512)
+        : x(capacity), y(capacity), vx(capacity), vy(capacity),
+          life(capacity), invMaxLife(capacity), size(capacity),
+          colors(capacity), frameBudget{mFrameBudget},
+          vertices(capacity * 4)
+    {
+    }
+
+    // Crea detriti per ogni mattoncino distrutto nell'ultimo tick, e
+    // qualche scintilla per ogni mattoncino colpito.
+    void emit(const BrickField& mField)
+    {
+        for(auto cell : mField.getChangedCells())
+        {
+            auto box(mField.getCellBox(cell));
+            auto hits(mField.getHits(cell));
+
+            auto emitBox([&](std::size_t mCount, float mSpeed, float mLife,
+                             float mSize, sf::Color mColor)
+                {
+                    for(std::size_t i{0}; i < mCount; ++i)
+                        spawn(getRandom(box.l, box.r),
+                            getRandom(box.t, box.b), mSpeed, mLife, mSize,
+                            mColor);
+                });
+
+            if(hits == 0)
+                emitBox(16, 3.f, 50.f, 3.f, BrickField::getColor(1));
+
+            emitBox(6, 6.f, 20.f, 1.5f, sf::Color::Yellow);
+        }
+    }
+
+    // Avanza di un tick. Le particelle morte in coda vengono
+    // liberate; quelle morte tra particelle vive restano nel buffer
+    // fino a quando la coda le raggiunge, ma non vengono disegnate.
+    void update() noexcept
+    {
+        TRACE_SCOPE("ParticleSystem::update");
+
+        auto tail(getTail());
+        if(tail + count <= capacity)
+            integrate(tail, tail + count);
+        else
+        {
+            integrate(tail, capacity);
+            integrate(0, head);
+        }
+
+        while(count > 0 && life[getTail()] <= 0.f) --count;
+        frameSpawned = 0;
+    }
+
+    void draw(sf::RenderWindow& mTarget)
+    {
+        TRACE_SCOPE("ParticleSystem::draw");
+
+        std::size_t vertex{0};
+        for(std::size_t n{0}, i(getTail()); n < count;
+            ++n, i = (i + 1) % capacity)
+        {
+            if(life[i] <= 0.f) continue;
+
+            auto color(colors[i]);
+            color.a = static_cast<sf::Uint8>(
+                255.f * std::min(1.f, life[i] * invMaxLife[i]));
+
+            auto h(size[i] / 2.f);
+            vertices[vertex++] = {{x[i] - h, y[i] - h}, color};
+            vertices[vertex++] = {{x[i] + h, y[i] - h}, color};
+            vertices[vertex++] = {{x[i] + h, y[i] + h}, color};
+            vertices[vertex++] = {{x[i] - h, y[i] + h}, color};
+        }
+
+        if(vertex > 0) mTarget.draw(vertices.data(), vertex, sf::Quads);
+    }
+
+    void clear() noexcept { head = count = 0; }
+
+    std::size_t getCount() const noexcept { return count; }
+
+    void printStats(std::ostream& mStream) const
+    {
+        mStream << "Particles: " << spawned << " spawned, " << overBudget
+                << " over budget\n";
+    }
+};
+
+// Invece di risolvere immediatamente ogni collisione, la fase di
+// "narrowphase" produce una lista di contatti. In questo modo la
+// rilevazione può avvenire in parallelo, e la risoluzione non
+// dipende dall'ordine in cui i mattoncini sono stati visitati.
+struct BrickContact
+{
+    std::uint32_t cell;
+
+    // Normale uscente dal mattoncino verso la pallina, lungo l'asse
+    // di minima compenetrazione.
+    Vec2 normal;
+    Scalar penetration;
+};
+
+bool findBrickBallContact(std::uint32_t mCell, const ScalarBox& mBrick,
+    const Ball& mBall, BrickContact& mContact) noexcept
+{
+    using std::abs;
+    if(!isIntersecting(mBrick, mBall)) return false;
+
+    auto overlapLeft(mBall.right() - mBrick.left());
+    auto overlapRight(mBrick.right() - mBall.left());
+    auto overlapTop(mBall.bottom() - mBrick.top());
+    auto overlapBottom(mBrick.bottom() - mBall.top());
+
+    auto bFromLeft(abs(overlapLeft) < abs(overlapRight));
+    auto bFromTop(abs(overlapTop) < abs(overlapBottom));
+
+    auto minOverlapX(abs(bFromLeft ? overlapLeft : overlapRight));
+    auto minOverlapY(abs(bFromTop ? overlapTop : overlapBottom));
+
+    mContact.cell = mCell;
+
+    if(minOverlapX < minOverlapY)
+    {
+        mContact.normal = {Scalar(bFromLeft ? -1 : 1), Scalar(0)};
+        mContact.penetration = minOverlapX;
+    }
+    else
+    {
+        mContact.normal = {Scalar(0), Scalar(bFromTop ? -1 : 1)};
+        mContact.penetration = minOverlapY;
+    }
+
+    return true;
+}
+
+// Risolve tutti i contatti di una pallina in un solo passo: i
+// contatti vengono ordinati con un criterio che dipende solo dalla
+// geometria, e per ogni asse viene usata la normale del contatto più
+// profondo. Due mattoncini adiacenti colpiti nello stesso frame
+// riflettono quindi la velocità una sola volta.
+void resolveBallContacts(Ball& mBall, std::vector<BrickContact>& mContacts)
+{
+    if(mContacts.empty()) return;
+    TRACE_SCOPE("resolveBallContacts");
+
+    std::sort(std::begin(mContacts), std::end(mContacts),
+        [](const auto& mA, const auto& mB)
+        {
+            if(mA.penetration != mB.penetration)
+                return mA.penetration > mB.penetration;
+
+            return mA.cell < mB.cell;
+        });
+
+    using std::abs;
+    bool resolvedX{false}, resolvedY{false};
+
+    for(const auto& c : mContacts)
+    {
+        if(c.normal.x != Scalar(0) && !resolvedX)
+        {
+            mBall.velocity.x = abs(mBall.velocity.x) * c.normal.x;
+            resolvedX = true;
+        }
+        else if(c.normal.y != Scalar(0) && !resolvedY)
+        {
+            mBall.velocity.y = abs(mBall.velocity.y) * c.normal.y;
+            resolvedY = true;
+        }
+    }
+}
+
+// Ogni mattoncino toccato perde un colpo per ogni pallina che lo ha
+// toccato, indipendentemente da quanti thread hanno prodotto i
+// contatti. Restituisce il numero di mattoncini distrutti, e chiama
+// `mOnDestroyed(cella)` per ognuno.
+template <typename TFunc>
+int applyBrickDamage(BrickField& mField,
+    const std::vector<BrickContact>& mContacts, TFunc&& mOnDestroyed)
+{
+    int destroyedCount{0};
+    for(const auto& c : mContacts)
+        if(mField.damage(c.cell))
+        {
+            ++destroyedCount;
+            mOnDestroyed(c.cell);
+        }
+
+    return destroyedCount;
+}
+
+// Il livello originale: 11x4 mattoncini, con un numero di colpi
+// richiesti che segue un pattern periodico.
+// Il livello "versus" ha gli stessi mattoncini, ma due palline e
+// due paddle, uno per giocatore.
+std::vector<char> buildDefaultLevel(bool mVersus = false)
+{
+    constexpr int brkCountX{11}, brkCountY{4};
+    constexpr int brkStartCol{1}, brkStartRow{2};
+    constexpr float brkSpacing{3.f}, brkOffsetX{22.f};
+
+    LevelHeader h;
+    h.width = brkCountX;
+    h.height = brkCountY;
+    h.cellWidth = BrickField::defWidth;
+    h.cellHeight = BrickField::defHeight;
+    h.spacing = brkSpacing;
+    h.originX = brkOffsetX + brkStartCol * (BrickField::defWidth + brkSpacing);
+    h.originY = brkStartRow * (BrickField::defHeight + brkSpacing);
+
+    std::vector<std::uint8_t> cells(brkCountX * brkCountY);
+    for(int iX{0}; iX < brkCountX; ++iX)
+        for(int iY{0}; iY < brkCountY; ++iY)
+            cells[iY * brkCountX + iX] = 1 + ((iX * iY) % 3);
+
+    if(mVersus)
+        return buildLevel(h,
+            {{LevelSpawn::Ball, wndWidth / 3.f, wndHeight / 2.f},
+                {LevelSpawn::Ball, wndWidth * 2.f / 3.f, wndHeight / 2.f},
+                {LevelSpawn::Paddle, wndWidth / 4.f, wndHeight - 50.f},
+                {LevelSpawn::Paddle, wndWidth * 3.f / 4.f, wndHeight - 50.f}},
+            cells);
+
+    return buildLevel(h,
+        {{LevelSpawn::Ball, wndWidth / 2.f, wndHeight / 2.f},
+            {LevelSpawn::Paddle, wndWidth / 2.f, wndHeight - 50.f}},
+        cells);
+}
+
+// Parametri per la generazione procedurale di un livello. A parità
+// di parametri (seed compreso) il livello generato è identico.
+struct LevelGenParams
+{
+    enum class Pattern
+    {
+        Solid,
+        Checker,
+        Stripes,
+        Diamond,
+        Random
+    };
+
+    std::uint64_t seed{0};
+    Pattern pattern{Pattern::Random};
+    std::uint32_t width{11}, height{4};
+
+    // Probabilità che una cella prevista dal pattern sia occupata.
+    float density{1.f};
+
+    // Pesi relativi dei mattoncini da 1, 2 e 3 colpi.
+    std::array<float, 3> hitWeights{{0.5f, 0.3f, 0.2f}};
+};
+
+bool parsePattern(const std::string& mName, LevelGenParams::Pattern& mOut)
+{
+    using P = LevelGenParams::Pattern;
+    static const std::map<std::string, P> names{{"solid", P::Solid},
+        {"checker", P::Checker}, {"stripes", P::Stripes},
+        {"diamond", P::Diamond}, {"random", P::Random}};
+
+    auto itr(names.find(mName));
+    if(itr == std::end(names)) return false;
+
+    mOut = itr->second;
+    return true;
+}
+
+// Genera un livello procedurale. Le celle vengono ridimensionate
+// (fino a `BrickField::defWidth` x `BrickField::defHeight`) in modo che la
+// griglia occupi la metà superiore della finestra: con griglie
+// enormi i mattoncini diventano più piccoli di un pixel.
+std::vector<char> generateLevel(const LevelGenParams& mParams)
+{
+    using P = LevelGenParams::Pattern;
+
+    Rng rng{mParams.seed, RngStream::Level};
+    auto unit([&rng] { return rng.getUnit(); });
+
+    constexpr float margin{20.f}, top{40.f};
+    auto pitchX(std::min(BrickField::defWidth * 1.05f,
+        (wndWidth - 2.f * margin) / std::max(1u, mParams.width)));
+    auto pitchY(std::min(BrickField::defHeight * 1.15f,
+        (wndHeight * 0.5f - top) / std::max(1u, mParams.height)));
+
+    LevelHeader h;
+    h.width = mParams.width;
+    h.height = mParams.height;
+    h.cellWidth = pitchX * 0.95f;
+    h.cellHeight = pitchY * 0.87f;
+    h.spacing = std::min(pitchX - h.cellWidth, pitchY - h.cellHeight);
+    h.originX = (wndWidth - h.width * pitchX) / 2.f + pitchX / 2.f;
+    h.originY = top + pitchY / 2.f;
+
+    // La spaziatura è la stessa sui due assi: ricalcoliamo le
+    // dimensioni delle celle di conseguenza.
+    h.cellWidth = pitchX - h.spacing;
+    h.cellHeight = pitchY - h.spacing;
+
+    auto weightSum(mParams.hitWeights[0] + mParams.hitWeights[1] +
+                   mParams.hitWeights[2]);
+
+    auto inPattern([&mParams](std::uint32_t mX, std::uint32_t mY)
+        {
+            auto cx((mParams.width - 1) / 2.f), cy((mParams.height - 1) / 2.f);
+
+            switch(mParams.pattern)
+            {
+                case P::Checker: return (mX + mY) % 2 == 0;
+                case P::Stripes: return mY % 2 == 0;
+                case P::Diamond:
+                    return std::abs(mX - cx) / std::max(cx, 1.f) +
+                               std::abs(mY - cy) / std::max(cy, 1.f) <=
+                           1.f;
+                default: return true;
+            }
+        });
+
+    std::vector<std::uint8_t> cells(std::size_t(h.width) * h.height, 0);
+    for(std::uint32_t iY{0}; iY < h.height; ++iY)
+        for(std::uint32_t iX{0}; iX < h.width; ++iX)
+        {
+            if(!inPattern(iX, iY) || unit() >= mParams.density) continue;
+
+            auto r(unit() * weightSum);
+            std::uint8_t hits{3};
+            if(r < mParams.hitWeights[0])
+                hits = 1;
+            else if(r < mParams.hitWeights[0] + mParams.hitWeights[1])
+                hits = 2;
+
+            cells[std::size_t(iY) * h.width + iX] = hits;
+        }
+
+    return buildLevel(h,
+        {{LevelSpawn::Ball, wndWidth / 2.f, wndHeight * 0.75f},
+            {LevelSpawn::Paddle, wndWidth / 2.f, wndHeight - 50.f}},
+        cells);
+}
+
+// Converte un livello dal formato testuale a quello binario. Il
+// formato testuale è:
+//
+//     # commento
+//     grid <larghezza> <altezza>
+//     cell <larghezza> <altezza> <spaziatura>
+//     origin <x> <y>
+//     spawn ball|paddle <x> <y>
+//     rows
+//     <una riga per ogni riga della griglia: '.' per le celle
+//      vuote, '1'-'3' per i colpi richiesti>
+//
+// `grid` deve precedere `rows`, e ogni riga della griglia deve avere
+// esattamente `<larghezza>` celle.
+bool convertLevel(const std::string& mTextPath, const std::string& mBinPath)
+{
+    std::ifstream in{mTextPath};
+    if(!in)
+    {
+        std::cerr << "Cannot open `" << mTextPath << "`\n";
+        return false;
+    }
+
+    LevelHeader h{};
+    h.cellWidth = BrickField::defWidth;
+    h.cellHeight = BrickField::defHeight;
+    std::vector<LevelSpawn> spawns;
+    std::vector<std::uint8_t> cells;
+
+    // Gli errori riportano la riga del file testuale che li causa.
+    std::size_t lineNumber{0};
+    auto fail([&](const std::string& mError)
+        {
+            std::cerr << mTextPath << ":" << lineNumber << ": " << mError
+                      << "\n";
+            return false;
+        });
+
+    bool hasGrid{false}, hasRows{false};
+
+    std::string line;
+    while(std::getline(in, line))
+    {
+        ++lineNumber;
+
+        std::istringstream ss{line};
+        std::string key;
+        if(!(ss >> key) || key[0] == '#') continue;
+
+        if(key == "grid")
+        {
+            // Le dimensioni servono per leggere le righe: non possono
+            // cambiare dopo `rows`.
+            if(hasRows) return fail("`grid` after `rows`");
+            if(!(ss >> h.width >> h.height))
+                return fail("malformed line `" + line + "`");
+
+            if(h.width == 0 || h.height == 0 ||
+                std::uint64_t(h.width) * h.height >
+                    std::numeric_limits<std::uint32_t>::max())
+                return fail("invalid grid size");
+
+            hasGrid = true;
+        }
+        else if(key == "cell")
+        {
+            ss >> h.cellWidth >> h.cellHeight >> h.spacing;
+            if(!ss.fail() &&
+                (!std::isfinite(h.cellWidth) || !std::isfinite(h.cellHeight) ||
+                    !std::isfinite(h.spacing) || !(h.cellWidth > 0.f) ||
+                    !(h.cellHeight > 0.f) || !(h.spacing >= 0.f)))
+                return fail("invalid cell size or spacing");
+        }
+        else if(key == "origin")
+        {
+            ss >> h.originX >> h.originY;
+            if(!ss.fail() &&
+                (!std::isfinite(h.originX) || !std::isfinite(h.originY)))
+                return fail("invalid origin");
+        }
+        else if(key == "spawn")
+        {
+            std::string type;
+            LevelSpawn spawn;
+            ss >> type >> spawn.x >> spawn.y;
+
+            if(type == "ball")
+                spawn.type = LevelSpawn::Ball;
+            else if(type == "paddle")
+                spawn.type = LevelSpawn::Paddle;
+            else
+                return fail("unknown spawn type `" + type + "`");
+
+            spawns.emplace_back(spawn);
+        }
+        else if(key == "rows")
+        {
+            if(!hasGrid) return fail("`rows` before `grid`");
+            if(hasRows) return fail("duplicate `rows` section");
+            hasRows = true;
+
+            cells.reserve(std::size_t(h.width) * h.height);
+
+            for(std::uint32_t iY{0}; iY < h.height; ++iY)
+            {
+                if(!std::getline(in, line))
+                    return fail("missing grid rows: expected " +
+                                std::to_string(h.height));
+                ++lineNumber;
+
+                // Tolleriamo i file con terminatori di riga Windows.
+                if(!line.empty() && line.back() == '\r') line.pop_back();
+
+                if(line.size() != h.width)
+                    return fail("grid row has " +
+                                std::to_string(line.size()) +
+                                " cells, expected " +
+                                std::to_string(h.width));
+
+                for(auto c : line)
+                {
+                    if(c == '.')
+                        cells.emplace_back(0);
+                    else if(c >= '1' && c <= '3')
+                        cells.emplace_back(c - '0');
+                    else
+                        return fail("invalid cell `" + std::string(1, c) + "`");
+                }
+            }
+        }
+        else
+            return fail("unknown key `" + key + "`");
+
+        if(ss.fail()) return fail("malformed line `" + line + "`");
+    }
+
+    if(!hasRows) return fail("missing `rows` section");
+
+    auto blob(buildLevel(h, spawns, cells));
+
+    std::ofstream out{mBinPath, std::ios::binary};
+    out.write(blob.data(), blob.size());
+    if(!out)
+    {
+        std::cerr << "Cannot write `" << mBinPath << "`\n";
+        return false;
+    }
+
+    return true;
+}
+
+// Compilando con `-DARKANOID_EMBEDDED_FONT='"font.inc"'` viene
+// incluso un font di riserva. Il file deve definire
+// `embeddedFontData` e `embeddedFontSize`, ad esempio partendo
+// dall'output di `xxd -i`.
+#ifdef ARKANOID_EMBEDDED_FONT
+#include ARKANOID_EMBEDDED_FONT
+#endif
+
+// Un `AssetManager` carica le risorse (font, e in futuro texture,
+// suoni e livelli) su un thread dedicato, per non bloccare l'avvio
+// della finestra. Le richieste per lo stesso file vengono
+// de-duplicate, e i file vengono cercati in una lista di percorsi.
+class AssetManager
+{
+private:
+    struct AssetBase
+    {
+        enum class Status
+        {
+            Loading,
+            Loaded,
+            Failed
+        };
+
+        std::atomic<Status> status{Status::Loading};
+        virtual ~AssetBase() {}
+    };
+
+public:
+    template <typename T>
+    class Asset : public AssetBase
+    {
+    private:
+        friend class AssetManager;
+        T resource;
+
+    public:
+        // Pronto quando il caricamento è terminato, anche se fallito.
+        bool isReady() const noexcept { return status != Status::Loading; }
+        bool isLoaded() const noexcept { return status == Status::Loaded; }
+
+        // Usabile solo dopo che `isLoaded` ha restituito `true`.
+        // Prima, il `T` può essere passato solo per riferimento
+        // (ad esempio a `sf::Text::setFont`).
+        const T& get() const noexcept { return resource; }
+    };
+
+private:
+    std::vector<std::string> searchPaths;
+    std::map<std::pair<std::size_t, std::string>, std::unique_ptr<AssetBase>>
+        assets;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> jobs;
+    bool running{true};
+    std::thread loader;
+
+    static bool loadFromFile(sf::Font& mFont, const std::string& mPath)
+    {
+        return mFont.loadFromFile(mPath);
+    }
+
+    // Se nessun percorso contiene il font, usiamo quello incluso
+    // nell'eseguibile tramite `-DARKANOID_EMBEDDED_FONT`.
+    static bool loadFallback(sf::Font& mFont)
+    {
+#ifdef ARKANOID_EMBEDDED_FONT
+        return mFont.loadFromMemory(embeddedFontData, embeddedFontSize);
+#else
+        (void)mFont;
+        return false;
+#endif
+    }
+
+    template <typename T>
+    void load(Asset<T>& mAsset, const std::string& mName)
+    {
+        auto loaded(false);
+
+        if(!mName.empty() && mName.front() == '/')
+            loaded = loadFromFile(mAsset.resource, mName);
+
+        for(const auto& p : searchPaths)
+        {
+            if(loaded) break;
+            loaded = loadFromFile(mAsset.resource, p + "/" + mName);
+        }
+
+        if(!loaded)
+        {
+            loaded = loadFallback(mAsset.resource);
+            std::cerr << "Asset `" << mName << "` not found"
+                      << (loaded ? ", using fallback\n" : "\n");
+        }
+
+        mAsset.status =
+            loaded ? AssetBase::Status::Loaded : AssetBase::Status::Failed;
+    }
+
+    void loaderLoop()
+    {
+        while(true)
+        {
+            std::function<void()> job;
+
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                cv.wait(lock, [this]
+                    {
+                        return !running || !jobs.empty();
+                    });
+
+                if(!running) return;
+
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            job();
+        }
+    }
+
+public:
+    AssetManager(std::vector<std::string> mSearchPaths)
+        : searchPaths{std::move(mSearchPaths)}, loader{[this]
+              {
+                  loaderLoop();
+              }}
+    {
+    }
+
+    ~AssetManager()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            running = false;
+        }
+
+        cv.notify_all();
+        loader.join();
+    }
+
+    // Restituisce subito l'asset, che verrà caricato in background.
+    // Richieste successive per lo stesso nome restituiscono lo
+    // stesso asset.
+    template <typename T>
+    const Asset<T>& request(const std::string& mName)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        auto& slot(assets[{typeid(T).hash_code(), mName}]);
+        if(slot != nullptr) return static_cast<Asset<T>&>(*slot);
+
+        auto asset(std::make_unique<Asset<T>>());
+        auto ptr(asset.get());
+        slot = std::move(asset);
+
+        jobs.emplace_back([this, ptr, mName]
+            {
+                load(*ptr, mName);
+            });
+        cv.notify_one();
+
+        return *ptr;
+    }
+
+    // Vero se tutte le risorse richieste finora sono pronte.
+    bool isIdle()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        for(const auto& pair : assets)
+            if(pair.second->status == AssetBase::Status::Loading)
+                return false;
+
+        return true;
+    }
+};
+
+// Un `HudText` è un testo dell'interfaccia legato ad un valore.
+// `refresh` confronta il valore con quello mostrato e rigenera la
+// stringa (e quindi la geometria dei glifi di `sf::Text`) solo se è
+// cambiato. I numeri vengono formattati in un buffer fisso, senza
+// allocazioni.
+class HudText
+{
+private:
+    sf::Text text;
+    std::array<char, 64> buffer;
+
+    const char* prefix{""};
+    const int* boundValue{nullptr};
+
+    // Come un `ThreadPool::Job`: una funzione e il contesto con cui
+    // chiamarla.
+    const char* (*labelFunc)(const void*){nullptr};
+    const void* labelContext{nullptr};
+
+    int lastValue{0};
+    const char* lastLabel{nullptr};
+    bool dirty{true};
+
+    // Tutti i caratteri che il testo può mostrare.
+    unsigned int characterSize;
+    std::string glyphSet;
+
+    void formatValue(int mValue) noexcept
+    {
+        auto prefixLen(std::min(std::strlen(prefix), buffer.size() - 16));
+        std::memcpy(buffer.data(), prefix, prefixLen);
+
+        // Scriviamo le cifre al contrario in un buffer temporaneo.
+        std::array<char, 12> digits;
+        std::size_t count{0};
+        auto negative(mValue < 0);
+        auto abs(negative ? -static_cast<long>(mValue) : mValue);
+
+        do
+        {
+            digits[count++] = '0' + abs % 10;
+            abs /= 10;
+        } while(abs > 0);
+
+        auto pos(prefixLen);
+        if(negative) buffer[pos++] = '-';
+        while(count > 0) buffer[pos++] = digits[--count];
+        buffer[pos] = '\0';
+    }
+
+public:
+    HudText(const sf::Font& mFont, unsigned int mSize, float mX, float mY)
+        : characterSize{mSize}
+    {
+        text.setFont(mFont);
+        text.setPosition(mX, mY);
+        text.setCharacterSize(mSize);
+        text.setColor(sf::Color::White);
+    }
+
+    // Lega il testo ad un intero, mostrato dopo `mPrefix`. Entrambi
+    // devono sopravvivere al widget.
+    void bind(const char* mPrefix, const int& mValue)
+    {
+        prefix = mPrefix;
+        boundValue = &mValue;
+        dirty = true;
+
+        glyphSet = std::string{mPrefix} + "-0123456789";
+    }
+
+    // Lega il testo ad una funzione che restituisce stringhe con
+    // durata statica: basta confrontare i puntatori. La funzione
+    // riceve `mContext`, che deve sopravvivere al widget. `mLabels`
+    // elenca tutte le stringhe che la funzione può restituire.
+    void bind(const char* (*mLabel)(const void*), const void* mContext,
+        std::initializer_list<const char*> mLabels)
+    {
+        labelFunc = mLabel;
+        labelContext = mContext;
+        dirty = true;
+
+        glyphSet.clear();
+        for(auto l : mLabels) glyphSet += l;
+    }
+
+    // Rasterizza in anticipo nella texture del font tutti i glifi
+    // che il testo può mostrare, per evitare rallentamenti al primo
+    // utilizzo. Deve essere chiamato dal thread di rendering.
+    void prewarm(const sf::Font& mFont) const
+    {
+        for(auto c : glyphSet)
+            mFont.getGlyph(static_cast<unsigned char>(c), characterSize, false);
+    }
+
+    auto getCharacterSize() const noexcept { return characterSize; }
+
+    void refresh()
+    {
+        if(boundValue != nullptr && (dirty || *boundValue != lastValue))
+        {
+            lastValue = *boundValue;
+            formatValue(lastValue);
+            text.setString(buffer.data());
+        }
+        else if(labelFunc != nullptr)
+        {
+            auto label(labelFunc(labelContext));
+            if(!dirty && label == lastLabel) return;
+
+            lastLabel = label;
+            text.setString(label);
+        }
+
+        dirty = false;
+    }
+
+    void draw(sf::RenderWindow& mTarget) const { mTarget.draw(text); }
+};
+
+// Un controller decide l'input di un paddle ad ogni tick, leggendo
+// lo stato della simulazione. Viene chiamato durante la fase
+// "input", eventualmente da un thread del pool.
+class PaddleController
+{
+public:
+    virtual ~PaddleController() = default;
+
+    virtual Paddle::Input getInput(const Manager& mManager,
+        const BrickField& mBricks, const Paddle& mPaddle) = 0;
+};
+
+// Bot che muove il paddle verso il punto in cui la pallina
+// attraverserà la sua altezza. La traiettoria viene seguita con dei
+// ray-cast, rimbalzando sui bordi della finestra e sui mattoncini
+// (considerati indistruttibili).
+class BotController : public PaddleController
+{
+private:
+    // Numero massimo di rimbalzi seguiti per ogni previsione.
+    std::size_t maxBounces;
+
+    // Previsione per una pallina: `mTicks` è il numero di tick prima
+    // che raggiunga l'altezza `mY`.
+    bool predict(const Ball& mBall, const BrickField& mBricks, float mY,
+        float& mX, std::size_t& mTicks) const noexcept
+    {
+        auto speed(static_cast<float>(getLength(mBall.velocity)));
+        if(speed == 0.f) return false;
+
+        // Le previsioni usano sempre `float`.
+        sf::Vector2f pos(mBall.position);
+        auto dir(sf::Vector2f(mBall.velocity) / speed);
+        auto r(static_cast<float>(mBall.radius()));
+        auto targetY(mY - r);
+        auto travelled(0.f);
+
+        for(std::size_t i{0}; i <= maxBounces; ++i)
+        {
+            RayHit hit;
+            auto hasHit(castRay(mBricks, pos, dir, r, 1e4f, hit));
+
+            // Il segmento attraversa l'altezza del paddle?
+            auto endY(hasHit ? hit.point.y : wndHeight + r);
+            if(dir.y > 0.f && pos.y <= targetY && endY >= targetY)
+            {
+                auto t((targetY - pos.y) / dir.y);
+                mX = pos.x + dir.x * t;
+                mTicks = static_cast<std::size_t>((travelled + t) / speed);
+                return true;
+            }
+
+            if(!hasHit) return false;
+
+            travelled += hit.distance;
+            pos = hit.point + hit.normal * 1e-3f;
+            dir = getReflected(dir, hit.normal);
+        }
+
+        return false;
+    }
+
+public:
+    BotController(std::size_t mMaxBounces = 32) noexcept
+        : maxBounces{mMaxBounces}
+    {
+    }
+
+    Paddle::Input getInput(const Manager& mManager,
+        const BrickField& mBricks, const Paddle& mPaddle) override
+    {
+        // Insegue la pallina che arriverà per prima; se nessuna
+        // previsione riesce, la posizione attuale della prima.
+        auto& balls(mManager.getAll<Ball>());
+        if(balls.empty()) return {};
+
+        auto targetX(
+            static_cast<float>(static_cast<const Ball*>(balls.front())->x()));
+        auto bestTicks(std::numeric_limits<std::size_t>::max());
+
+        for(auto e : balls)
+        {
+            float x{0.f};
+            std::size_t ticks{0};
+
+            if(predict(*static_cast<const Ball*>(e), mBricks,
+                   static_cast<float>(mPaddle.top()), x, ticks) &&
+                ticks < bestTicks)
+            {
+                targetX = x;
+                bestTicks = ticks;
+            }
+        }
+
+        Paddle::Input input;
+        auto dx(targetX - static_cast<float>(mPaddle.x()));
+        input.left = dx < -Paddle::defVelocity;
+        input.right = dx > Paddle::defVelocity;
+        return input;
+    }
+};
+
+// "Timer wheel" gerarchica: i timer vengono inseriti in uno slot in
+// base alla loro scadenza, e ogni tick visita un solo slot invece di
+// tutti i timer. Il primo livello ha uno slot per tick; gli slot dei
+// livelli superiori coprono `slotCount` volte più tick, e il loro
+// contenuto viene ridistribuito ("cascade") nei livelli inferiori
+// quando il tempo li raggiunge. Inserimento e cancellazione sono
+// O(1), e i nodi vengono da un pool di capacità fissa.
+class TimerWheel
+{
+public:
+    using TimerId = std::uint32_t;
+    static constexpr TimerId noTimer{std::numeric_limits<TimerId>::max()};
+
+    static constexpr int levelCount{3}, slotBits{6};
+    static constexpr std::uint64_t slotCount{1 << slotBits};
+    static constexpr std::uint64_t maxDelay{
+        (std::uint64_t(1) << (slotBits * levelCount)) - 1};
+
+private:
+    // I nodi di uno slot formano una lista doppiamente concatenata,
+    // così un timer può essere cancellato senza cercarlo.
+    struct Node
+    {
+        std::uint64_t expiry;
+        std::uint32_t payload;
+        TimerId prev, next;
+        std::uint32_t slot;
+        bool active;
+    };
+
+    std::vector<Node> nodes;
+    std::array<TimerId, levelCount * slotCount> heads;
+    TimerId freeList{noTimer};
+    std::uint64_t now{0};
+    std::size_t activeCount{0};
+
+    void link(TimerId mId)
+    {
+        auto& n(nodes[mId]);
+        auto delta(n.expiry - now);
+
+        int level{0};
+        while(level < levelCount - 1 &&
+              delta >= (std::uint64_t(1) << (slotBits * (level + 1))))
+            ++level;
+
+        auto index((n.expiry >> (slotBits * level)) & (slotCount - 1));
+        n.slot = static_cast<std::uint32_t>(level * slotCount + index);
+        n.prev = noTimer;
+        n.next = heads[n.slot];
+        if(n.next != noTimer) nodes[n.next].prev = mId;
+        heads[n.slot] = mId;
+    }
+
+    void unlink(TimerId mId) noexcept
+    {
+        auto& n(nodes[mId]);
+        if(n.prev != noTimer)
+            nodes[n.prev].next = n.next;
+        else
+            heads[n.slot] = n.next;
+
+        if(n.next != noTimer) nodes[n.next].prev = n.prev;
+    }
+
+    void release(TimerId mId) noexcept
+    {
+        nodes[mId].active = false;
+        nodes[mId].next = freeList;
+        freeList = mId;
+        --activeCount;
+    }
+
+    // Ridistribuisce i nodi di uno slot di un livello superiore.
+    void cascade(int mLevel)
+    {
+        auto index((now >> (slotBits * mLevel)) & (slotCount - 1));
+        auto& head(heads[mLevel * slotCount + index]);
+
+        auto id(head);
+        head = noTimer;
+
+        while(id != noTimer)
+        {
+            auto next(nodes[id].next);
+            link(id);
+            id = next;
+        }
+    }
+
+public:
+    TimerWheel(std::size_t mCapacity) : nodes(mCapacity) { clear(); }
+
+    void clear() noexcept
+    {
+        heads.fill(noTimer);
+        freeList = noTimer;
+        for(auto i(nodes.size()); i-- > 0;)
+        {
+            nodes[i].active = false;
+            nodes[i].next = freeList;
+            freeList = static_cast<TimerId>(i);
+        }
+
+        activeCount = 0;
+    }
+
+    // Il timer scade dopo `mDelay` tick (almeno uno, al massimo
+    // `maxDelay`). Restituisce `noTimer` se il pool è esaurito.
+    TimerId schedule(std::uint64_t mDelay, std::uint32_t mPayload)
+    {
+        if(freeList == noTimer) return noTimer;
+
+        auto id(freeList);
+        freeList = nodes[id].next;
+        ++activeCount;
+
+        auto& n(nodes[id]);
+        auto delay(std::min(mDelay, std::uint64_t{maxDelay}));
+        n.expiry = now + std::max(delay, std::uint64_t{1});
+        n.payload = mPayload;
+        n.active = true;
+        link(id);
+
+        return id;
+    }
+
+    bool cancel(TimerId mId) noexcept
+    {
+        if(mId >= nodes.size() || !nodes[mId].active) return false;
+
+        unlink(mId);
+        release(mId);
+        return true;
+    }
+
+    // Avanza di un tick, chiamando `mOnExpired(payload)` per ogni
+    // timer scaduto. La callback può creare nuovi timer.
+    template <typename TFunc>
+    void advance(TFunc&& mOnExpired)
+    {
+        ++now;
+
+        // I livelli alti vanno ridistribuiti prima di quelli bassi.
+        for(int level{levelCount - 1}; level > 0; --level)
+            if((now & ((std::uint64_t(1) << (slotBits * level)) - 1)) == 0)
+                cascade(level);
+
+        // I nodi vengono staccati uno alla volta dalla testa: la
+        // lista resta valida anche se la callback cancella un timer
+        // dello stesso slot.
+        auto& head(heads[now & (slotCount - 1)]);
+        while(head != noTimer)
+        {
+            auto id(head);
+            unlink(id);
+
+            auto payload(nodes[id].payload);
+            release(id);
+            mOnExpired(payload);
+        }
+    }
+
+    // Chiama `mFunc(payload, tick rimanenti)` per ogni timer attivo,
+    // in ordine di indice.
+    template <typename TFunc>
+    void forEachActive(TFunc&& mFunc) const
+    {
+        for(const auto& n : nodes)
+            if(n.active) mFunc(n.payload, n.expiry - now);
+    }
+
+    std::size_t getActiveCount() const noexcept { return activeCount; }
+    std::uint64_t getTick() const noexcept { return now; }
+};
+
+constexpr TimerWheel::TimerId TimerWheel::noTimer;
+
+// Un savestate è un blob contiguo: un `SavestateHeader`, seguito
+// dagli array di `BallState` e `PaddleState` e dallo stato del
+// `BrickField`. Il livello non viene salvato: il savestate va
+// ripristinato su un `World` con lo stesso livello.
+struct SavestateHeader
+{
+    static constexpr char defMagic[4]{'A', 'R', 'K', 'S'};
+    static constexpr std::uint16_t defVersion{5};
+
+    // Posizioni e velocità vengono salvate come `Scalar`: un
+    // savestate vale solo per build con lo stesso tipo numerico.
+    static constexpr std::uint32_t defScalarFormat{
+        std::is_same<Scalar, Fixed>{} ? Fixed::fractionBits : 0};
+
+    char magic[4];
+    std::uint16_t version;
+    std::uint16_t state;
+    std::uint32_t ballCount, paddleCount;
+    std::uint32_t brickWidth, brickHeight, brickStateSize;
+    std::int32_t remainingLives, score;
+    std::int32_t playerScores[2];
+    std::uint32_t scalarFormat;
+    float ballSpawnX, ballSpawnY;
+
+    // Seme e stato dei flussi casuali. I campi a 64 bit iniziano a
+    // un offset multiplo di 8: la struttura non ha padding, e il
+    // checksum di un savestate non dipende da byte non inizializzati.
+    std::uint64_t seed;
+    Rng::State serveRng, dropRng;
+
+    // Power-up in caduta ed effetti a tempo attivi.
+    std::uint32_t powerUpCount, effectCount;
+};
+
+constexpr char SavestateHeader::defMagic[4];
+
+struct BallState
+{
+    Scalar x, y, vx, vy;
+    std::int32_t owner, slowed;
+};
+
+struct PaddleState
+{
+    Scalar x, y, vx;
+    std::uint8_t left, right, player, wide;
+};
+
+struct PowerUpState
+{
+    Scalar x, y;
+    std::uint32_t type;
+};
+
+// Un effetto viene salvato con i tick che mancano alla scadenza: la
+// timer wheel viene ricostruita al caricamento.
+struct EffectState
+{
+    std::uint32_t payload, remaining;
+};
+
+static_assert(std::is_trivially_copyable<SavestateHeader>() &&
+                  std::is_trivially_copyable<BallState>() &&
+                  std::is_trivially_copyable<PaddleState>() &&
+                  std::is_trivially_copyable<PowerUpState>() &&
+                  std::is_trivially_copyable<EffectState>(),
+    "Savestate structures must be trivially copyable");
+
+// Il `World` contiene lo stato della simulazione, separato dalla
+// finestra e dall'interfaccia: può essere eseguito anche senza
+// rendering ("headless"), ad esempio per stress test.
+class World
+{
+public:
+    // Aggiungiamo due stati aggiuntivi: `GameOver` e `Victory`.
+    enum class State
+    {
+        Paused,
+        GameOver,
+        InProgress,
+        Victory
+    };
+
+    // Le fasi della simulazione aggiunte ad un `TaskGraph`: `first`
+    // precede tutte le altre, `last` le segue.
+    struct Tasks
+    {
+        TaskGraph::TaskId first, last;
+    };
+
+    // Limiti sul numero di palline e di paddle (uno per giocatore):
+    // le entità vengono preallocate, e i savestate che li superano
+    // vengono rifiutati. `restart` ignora gli spawn in più.
+    static constexpr std::size_t maxBalls{8}, maxPlayers{2};
+
+    Manager manager;
+    BrickField bricks;
+    State state{State::GameOver};
+
+    // Teniamo traccia delle vite del player nel `World`.
+    int remainingLives{0};
+
+    // Il punteggio aumenta di uno per ogni mattoncino distrutto.
+    // Nella modalità "versus" ogni giocatore ha anche il proprio.
+    int score{0};
+    std::array<int, maxPlayers> playerScores{};
+
+    // Input applicato ai paddle di ogni giocatore durante la fase
+    // "input", se non è stato impostato un controller. Il controller
+    // non è posseduto dal `World`.
+    std::array<Paddle::Input, maxPlayers> paddleInputs{};
+    PaddleController* controller{nullptr};
+
+private:
+    ThreadPool& threadPool;
+
+    // I flussi casuali vengono reinizializzati dal seme ad ogni
+    // `restart`: a parità di seme e di input, la partita è identica.
+    std::uint64_t seed{0};
+    Rng serveRng, dropRng;
+
+    // Effetti a tempo dei power-up. Ogni effetto ha al più un timer
+    // attivo, identificato da tipo e bersaglio (il giocatore per
+    // `WidePaddle`): raccoglierlo di nuovo ne fa ripartire la durata.
+    static constexpr std::size_t maxEffects{8};
+    TimerWheel effectTimers{maxEffects};
+    std::array<TimerWheel::TimerId, maxPlayers> wideTimers;
+    TimerWheel::TimerId slowTimer;
+
+    // Contatti prodotti dalla narrowphase, uno slot per pallina.
+    std::vector<std::vector<BrickContact>> ballContacts;
+
+    // Broadphase sui paddle, ricostruita dai task che la usano:
+    // palline e power-up visitano solo i paddle che possono toccare.
+    SweepBroadphase<Paddle> paddleBroadphase;
+
+    // Il livello non è posseduto dal `World`: chi lo fornisce deve
+    // mantenerlo valido.
+    LevelView level;
+    sf::Vector2f ballSpawn{wndWidth / 2.f, wndHeight / 2.f};
+
+    // Grafo usato da `step` quando non c'è rendering.
+    TaskGraph stepGraph;
+
+public:
+    World(ThreadPool& mThreadPool) : threadPool(mThreadPool)
+    {
+        addTasks(stepGraph);
+        clearEffects();
+        ballContacts.resize(maxBalls);
+
+        // Tutte le entità del mondo vengono create dai pool del
+        // `Manager`, preparati qui: né la partita né `restart` o
+        // `loadState` (usato dal rollback) allocano nuove entità.
+        manager.reserve<Ball>(maxBalls, 0.f, 0.f);
+        manager.reserve<Paddle>(maxPlayers, 0.f, 0.f);
+        manager.reserve<PowerUp>(
+            PowerUp::maxActive, 0.f, 0.f, PowerUp::Type::MultiBall);
+        paddleBroadphase.reserve(maxPlayers);
+    }
+
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    Tasks addTasks(TaskGraph& mGraph)
+    {
+        auto& g(mGraph);
+
+        // Se non ci sono più palline sullo schermo, decrementiamo il
+        // numero di vite e creiamo una nuova pallina. Controlliamo
+        // anche le condizioni di vittoria e sconfitta.
+        auto rules(g.add("rules", [this]
+            {
+                bricks.clearChanges();
+
+                if(manager.getAll<Ball>().empty())
+                {
+                    serve(manager.create<Ball>(ballSpawn.x, ballSpawn.y));
+                    --remainingLives;
+                }
+
+                if(bricks.countLive() == 0) state = State::Victory;
+                if(remainingLives <= 0) state = State::GameOver;
+            }));
+
+        auto input(g.add("input", [this]
+            {
+                manager.forEach<Paddle>([this](auto& mPaddle)
+                    {
+                        mPaddle.input =
+                            controller != nullptr
+                                ? controller->getInput(manager, bricks, mPaddle)
+                                : paddleInputs[mPaddle.player];
+                    });
+            }));
+
+        auto update(g.add("update", [this]
+            {
+                manager.update(threadPool);
+            }));
+
+        // Ogni pallina scrive solo nel proprio slot di contatti: la
+        // narrowphase può essere eseguita in parallelo. Le celle
+        // vicine ad ogni pallina si trovano direttamente nella
+        // griglia, senza bisogno di una broadphase.
+        auto narrowphase(g.add("narrowphase", [this]
+            {
+                // Gli slot non vengono mai rimossi, per non perderne
+                // la memoria quando il numero di palline diminuisce.
+                EntitySpan<Ball> balls{manager.getAll<Ball>()};
+                if(ballContacts.size() < balls.size())
+                    ballContacts.resize(balls.size());
+
+                threadPool.parallelFor(balls.size(), 1,
+                    [this, &balls](std::size_t mBegin, std::size_t mEnd)
+                    {
+                        TRACE_SCOPE("findBrickBallContacts");
+
+                        for(auto i(mBegin); i < mEnd; ++i)
+                        {
+                            auto& contacts(ballContacts[i]);
+                            contacts.clear();
+
+                            BrickContact c;
+                            bricks.forEachLiveNear(
+                                balls[i], [&](std::uint32_t mCell)
+                                {
+                                    if(findBrickBallContact(mCell,
+                                           bricks.getCellBounds(mCell),
+                                           balls[i], c))
+                                        contacts.emplace_back(c);
+                                });
+                        }
+                    });
+            }));
+
+        // La risoluzione è sequenziale e segue l'ordine delle
+        // palline: il risultato non dipende dal numero di thread.
+        auto resolve(g.add("resolve", [this]
+            {
+                EntitySpan<Ball> balls{manager.getAll<Ball>()};
+
+                for(std::size_t i{0}; i < balls.size(); ++i)
+                    resolveBallContacts(balls[i], ballContacts[i]);
+
+                for(std::size_t i{0}; i < balls.size(); ++i)
+                {
+                    auto destroyed(applyBrickDamage(bricks, ballContacts[i],
+                        [this](std::uint32_t mCell)
+                        {
+                            dropPowerUp(mCell);
+                        }));
+                    score += destroyed;
+                    playerScores[balls[i].owner] += destroyed;
+                }
+
+                auto view(manager.view<Ball, Paddle>());
+                paddleBroadphase.build(view.second());
+                view.forEachPair(
+                    paddleBroadphase, [](auto& mBall, auto& mPaddle)
+                    {
+                        solvePaddleBallCollision(mPaddle, mBall);
+                    });
+            }));
+
+        // I power-up raccolti hanno effetto subito; gli effetti a
+        // tempo scadono quando la timer wheel raggiunge il loro slot.
+        auto powerUps(g.add("powerups", [this]
+            {
+                auto view(manager.view<PowerUp, Paddle>());
+                paddleBroadphase.build(view.second());
+
+                // Gli effetti vengono applicati dopo la ricerca:
+                // `WidePaddle` cambia la larghezza dei paddle su cui è
+                // costruita la broadphase.
+                std::array<std::pair<PowerUp*, Paddle*>, PowerUp::maxActive>
+                    caught;
+                std::size_t caughtCount{0};
+
+                view.forEachPair(paddleBroadphase,
+                    [&caught, &caughtCount](auto& mPowerUp, auto& mPaddle)
+                    {
+                        if(mPowerUp.destroyed) return;
+
+                        mPowerUp.destroyed = true;
+                        caught[caughtCount++] = {&mPowerUp, &mPaddle};
+                    });
+
+                for(std::size_t i{0}; i < caughtCount; ++i)
+                    applyPowerUp(caught[i].first->type, *caught[i].second);
+
+                effectTimers.advance([this](std::uint32_t mPayload)
+                    {
+                        expireEffect(mPayload);
+                    });
+            }));
+
+        auto refresh(g.add("refresh", [this]
+            {
+                manager.refresh();
+            }));
+
+        g.precede(rules, input);
+        g.precede(input, update);
+        g.precede(update, narrowphase);
+        g.precede(narrowphase, resolve);
+        g.precede(resolve, powerUps);
+        g.precede(powerUps, refresh);
+
+        return {rules, refresh};
+    }
+
+    void setLevel(const LevelView& mLevel) noexcept { level = mLevel; }
+
+    // Il seme viene usato dal prossimo `restart`.
+    void setSeed(std::uint64_t mSeed) noexcept { seed = mSeed; }
+    std::uint64_t getSeed() const noexcept { return seed; }
+
+    // Lancia la pallina verso l'alto, con una componente orizzontale
+    // casuale scelta tra pochi valori interi: la velocità è quindi
+    // esatta anche in virgola fissa.
+    void serve(Ball& mBall) noexcept
+    {
+        auto choice(static_cast<int>(serveRng.getBelow(6)));
+        auto vx(4 + (choice % 3) * 2);
+
+        mBall.velocity = {Scalar(choice < 3 ? -vx : vx),
+            -Scalar(Ball::defVelocity)};
+    }
+
+private:
+    // Divide lo schermo in una corsia per giocatore: con un solo
+    // paddle la corsia è l'intera larghezza.
+    void assignLanes()
+    {
+        int players{0};
+        manager.forEach<Paddle>([&players](auto& mPaddle)
+            {
+                players = std::max(players, mPaddle.player + 1);
+            });
+
+        manager.forEach<Paddle>([players](auto& mPaddle)
+            {
+                auto laneWidth(Scalar(wndWidth) / Scalar(players));
+                mPaddle.laneLeft = laneWidth * Scalar(mPaddle.player);
+                mPaddle.laneRight = mPaddle.laneLeft + laneWidth;
+            });
+    }
+
+    // Un mattoncino distrutto su sei lascia cadere un power-up, se
+    // non ce ne sono già troppi in gioco.
+    void dropPowerUp(std::uint32_t mCell)
+    {
+        if(dropRng.getBelow(6) != 0) return;
+
+        auto typeCount(static_cast<std::uint32_t>(PowerUp::Type::Count));
+        auto type(static_cast<PowerUp::Type>(dropRng.getBelow(typeCount)));
+        if(manager.getAll<PowerUp>().size() >= PowerUp::maxActive) return;
+
+        auto bounds(bricks.getCellBounds(mCell));
+        manager.create<PowerUp>(0.f, 0.f, type).position = {
+            bounds.x(), bounds.y()};
+    }
+
+    static std::uint32_t getEffectPayload(
+        PowerUp::Type mType, int mTarget) noexcept
+    {
+        return (static_cast<std::uint32_t>(mType) << 8) |
+               static_cast<std::uint32_t>(mTarget);
+    }
+
+    TimerWheel::TimerId& getEffectTimer(
+        PowerUp::Type mType, int mTarget) noexcept
+    {
+        return mType == PowerUp::Type::WidePaddle ? wideTimers[mTarget]
+                                                  : slowTimer;
+    }
+
+    void startEffect(PowerUp::Type mType, int mTarget, std::uint64_t mTicks)
+    {
+        auto& timer(getEffectTimer(mType, mTarget));
+        effectTimers.cancel(timer);
+        timer = effectTimers.schedule(mTicks, getEffectPayload(mType, mTarget));
+    }
+
+    void clearEffects() noexcept
+    {
+        effectTimers.clear();
+        wideTimers.fill(TimerWheel::noTimer);
+        slowTimer = TimerWheel::noTimer;
+    }
+
+    // Due palline in più, copiate dalla prima e con la velocità
+    // specchiata su uno dei due assi.
+    void spawnExtraBalls()
+    {
+        const Ball* source{nullptr};
+        for(auto e : manager.getAll<Ball>())
+            if(!e->destroyed)
+            {
+                source = static_cast<const Ball*>(e);
+                break;
+            }
+
+        if(source == nullptr) return;
+
+        // `create` può riallocare il gruppo: copiamo prima i dati.
+        auto position(source->position);
+        auto v(source->velocity);
+        auto owner(source->owner);
+        auto slowed(source->slowed);
+
+        for(auto velocity : {Vec2{-v.x, v.y}, Vec2{v.x, -v.y}})
+        {
+            if(manager.getAll<Ball>().size() >= maxBalls) return;
+
+            auto& b(manager.create<Ball>(0.f, 0.f));
+            b.position = position;
+            b.velocity = velocity;
+            b.owner = owner;
+            b.slowed = slowed;
+        }
+    }
+
+    void applyPowerUp(PowerUp::Type mType, Paddle& mPaddle)
+    {
+        switch(mType)
+        {
+            case PowerUp::Type::MultiBall: spawnExtraBalls(); break;
+
+            case PowerUp::Type::WidePaddle:
+                mPaddle.setWide(true);
+                startEffect(mType, mPaddle.player, PowerUp::wideDuration);
+                break;
+
+            default:
+                manager.forEach<Ball>([](auto& mBall)
+                    {
+                        if(mBall.slowed) return;
+                        mBall.velocity = mBall.velocity / Scalar(2);
+                        mBall.slowed = true;
+                    });
+                startEffect(mType, 0, PowerUp::slowDuration);
+                break;
+        }
+    }
+
+    void expireEffect(std::uint32_t mPayload)
+    {
+        auto type(static_cast<PowerUp::Type>(mPayload >> 8));
+        auto target(static_cast<int>(mPayload & 0xff));
+        getEffectTimer(type, target) = TimerWheel::noTimer;
+
+        if(type == PowerUp::Type::WidePaddle)
+            manager.forEach<Paddle>([target](auto& mPaddle)
+                {
+                    if(mPaddle.player == target) mPaddle.setWide(false);
+                });
+        else
+            manager.forEach<Ball>([](auto& mBall)
+                {
+                    if(!mBall.slowed) return;
+                    mBall.velocity = mBall.velocity * Scalar(2);
+                    mBall.slowed = false;
+                });
+    }
+
+public:
+    void restart()
+    {
+        // Ricordiamoci di settare le vite all'inizio di `restart`.
+        remainingLives = 3;
+        score = 0;
+        playerScores.fill(0);
+        serveRng = Rng{seed, RngStream::Serve};
+        dropRng = Rng{seed, RngStream::Drops};
+        clearEffects();
+
+        state = State::Paused;
+        manager.clear();
+
+        bricks.assign(level);
+
+        // Contatti e celle modificate in un tick sono limitati dalle
+        // celle vicine ad ogni pallina: riservando la memoria subito,
+        // i tick (anche quelli risimulati dal rollback) non allocano.
+        auto near(bricks.getMaxCellsNear(
+            Ball::defRadius * 2.f, Ball::defRadius * 2.f));
+        for(auto& c : ballContacts) c.reserve(near);
+        bricks.reserveChanges(near * maxBalls);
+
+        // I paddle vengono assegnati ai giocatori nell'ordine in cui
+        // compaiono nel livello.
+        std::size_t balls{0}, players{0};
+
+        for(std::size_t i{0}; i < level.getSpawnCount(); ++i)
+        {
+            const auto& spawn(level.getSpawn(i));
+
+            if(spawn.type == LevelSpawn::Ball && balls < maxBalls)
+            {
+                ++balls;
+                ballSpawn = {spawn.x, spawn.y};
+                serve(manager.create<Ball>(spawn.x, spawn.y));
+            }
+            else if(spawn.type == LevelSpawn::Paddle && players < maxPlayers)
+                manager.create<Paddle>(spawn.x, spawn.y).player = players++;
+        }
+
+        assignLanes();
+    }
+
+    // Esegue un singolo tick della simulazione.
+    void step() { stepGraph.run(threadPool); }
+
+    const TaskGraph& getStepGraph() const noexcept { return stepGraph; }
+
+    // Dimensione massima di un savestate con il livello corrente:
+    // riservandola, i salvataggi non allocano mai.
+    std::size_t getMaxStateSize() const noexcept
+    {
+        return sizeof(SavestateHeader) + sizeof(BallState) * maxBalls +
+               sizeof(PaddleState) * maxPlayers +
+               sizeof(PowerUpState) * PowerUp::maxActive +
+               sizeof(EffectState) * maxEffects + bricks.getStateSize();
+    }
+
+    // Scrive un savestate in `mOut`. Riutilizzando lo stesso vettore
+    // non viene allocata memoria.
+    void saveState(std::vector<char>& mOut) const
+    {
+        const auto& balls(manager.getAll<Ball>());
+        const auto& paddles(manager.getAll<Paddle>());
+        const auto& powerUps(manager.getAll<PowerUp>());
+
+        // Gli effetti vengono inseriti in ordine di tipo e bersaglio: il
+        // blob non dipende dai nodi della timer wheel in cui si trovano.
+        // Sono al massimo `maxEffects`, basta un insertion sort.
+        std::array<EffectState, maxEffects> effects;
+        std::size_t effectCount{0};
+        effectTimers.forEachActive(
+            [&](std::uint32_t mPayload, std::uint64_t mRemaining)
+            {
+                auto i(effectCount++);
+                for(; i > 0 && effects[i - 1].payload > mPayload; --i)
+                    effects[i] = effects[i - 1];
+
+                effects[i] = {
+                    mPayload, static_cast<std::uint32_t>(mRemaining)};
+            });
+
+        SavestateHeader h;
+        std::memcpy(h.magic, SavestateHeader::defMagic, 4);
+        h.version = SavestateHeader::defVersion;
+        h.scalarFormat = SavestateHeader::defScalarFormat;
+        h.state = static_cast<std::uint16_t>(state);
+        h.ballCount = balls.size();
+        h.paddleCount = paddles.size();
+        h.brickWidth = bricks.getWidth();
+        h.brickHeight = bricks.getHeight();
+        h.brickStateSize = bricks.getStateSize();
+        h.remainingLives = remainingLives;
+        h.score = score;
+        std::copy(std::begin(playerScores), std::end(playerScores),
+            h.playerScores);
+        h.ballSpawnX = ballSpawn.x;
+        h.ballSpawnY = ballSpawn.y;
+        h.seed = seed;
+        h.serveRng = serveRng.getState();
+        h.dropRng = dropRng.getState();
+        h.powerUpCount = powerUps.size();
+        h.effectCount = effectCount;
+
+        mOut.resize(sizeof(h) + sizeof(BallState) * h.ballCount +
+                    sizeof(PaddleState) * h.paddleCount +
+                    sizeof(PowerUpState) * h.powerUpCount +
+                    sizeof(EffectState) * h.effectCount + h.brickStateSize);
+
+        auto out(mOut.data());
+        std::memcpy(out, &h, sizeof(h));
+        out += sizeof(h);
+
+        for(auto e : balls)
+        {
+            const auto& b(*static_cast<const Ball*>(e));
+            BallState bs{b.x(), b.y(), b.velocity.x, b.velocity.y, b.owner,
+                b.slowed};
+            std::memcpy(out, &bs, sizeof(bs));
+            out += sizeof(bs);
+        }
+
+        for(auto e : paddles)
+        {
+            const auto& p(*static_cast<const Paddle*>(e));
+            PaddleState ps{p.x(), p.y(), p.velocity.x, p.input.left,
+                p.input.right, static_cast<std::uint8_t>(p.player),
+                p.isWide()};
+            std::memcpy(out, &ps, sizeof(ps));
+            out += sizeof(ps);
+        }
+
+        for(auto e : powerUps)
+        {
+            const auto& u(*static_cast<const PowerUp*>(e));
+            PowerUpState us{u.x(), u.y(), static_cast<std::uint32_t>(u.type)};
+            std::memcpy(out, &us, sizeof(us));
+            out += sizeof(us);
+        }
+
+        std::memcpy(out, effects.data(), sizeof(EffectState) * effectCount);
+        out += sizeof(EffectState) * effectCount;
+
+        bricks.saveState(out);
+    }
+
+    // Ripristina un savestate. Restituisce `false`, senza modificare
+    // il `World`, se il blob non è valido o non corrisponde al
+    // livello corrente.
+    bool loadState(const char* mData, std::size_t mSize)
+    {
+        SavestateHeader h;
+        if(mSize < sizeof(h)) return false;
+        std::memcpy(&h, mData, sizeof(h));
+
+        if(std::memcmp(h.magic, SavestateHeader::defMagic, 4) != 0 ||
+            h.version != SavestateHeader::defVersion ||
+            h.scalarFormat != SavestateHeader::defScalarFormat ||
+            h.brickWidth != bricks.getWidth() ||
+            h.brickHeight != bricks.getHeight() ||
+            h.brickStateSize != bricks.getStateSize() ||
+            h.state > static_cast<std::uint16_t>(State::Victory) ||
+            h.ballCount > maxBalls || h.paddleCount > maxPlayers ||
+            h.powerUpCount > PowerUp::maxActive || h.effectCount > maxEffects)
+            return false;
+
+        auto required(sizeof(h) + sizeof(BallState) * h.ballCount +
+                      sizeof(PaddleState) * h.paddleCount +
+                      sizeof(PowerUpState) * h.powerUpCount +
+                      sizeof(EffectState) * h.effectCount + h.brickStateSize);
+        if(mSize != required) return false;
+
+        auto in(mData + sizeof(h));
+        auto powerUpData(in + sizeof(BallState) * h.ballCount +
+                         sizeof(PaddleState) * h.paddleCount);
+        auto effectData(powerUpData + sizeof(PowerUpState) * h.powerUpCount);
+
+        // Tipi e bersagli vengono controllati prima di modificare il
+        // `World`.
+        for(std::uint32_t i{0}; i < h.powerUpCount; ++i)
+        {
+            PowerUpState us;
+            std::memcpy(&us, powerUpData + sizeof(us) * i, sizeof(us));
+            if(us.type >= static_cast<std::uint32_t>(PowerUp::Type::Count))
+                return false;
+        }
+
+        for(std::uint32_t i{0}; i < h.effectCount; ++i)
+        {
+            EffectState es;
+            std::memcpy(&es, effectData + sizeof(es) * i, sizeof(es));
+
+            auto type(static_cast<PowerUp::Type>(es.payload >> 8));
+            if((type != PowerUp::Type::WidePaddle &&
+                   type != PowerUp::Type::SlowBall) ||
+                (es.payload & 0xff) >= maxPlayers)
+                return false;
+        }
+
+        // Le entità vengono ricreate dai pool del `Manager`, nello
+        // stesso ordine in cui erano state salvate.
+        manager.clear();
+
+        for(std::uint32_t i{0}; i < h.ballCount; ++i)
+        {
+            BallState bs;
+            std::memcpy(&bs, in, sizeof(bs));
+            in += sizeof(bs);
+
+            auto& b(manager.create<Ball>(0.f, 0.f));
+            b.position = {bs.x, bs.y};
+            b.velocity = {bs.vx, bs.vy};
+            b.owner = std::min<int>(std::max(bs.owner, 0), maxPlayers - 1);
+            b.slowed = bs.slowed != 0;
+        }
+
+        for(std::uint32_t i{0}; i < h.paddleCount; ++i)
+        {
+            PaddleState ps;
+            std::memcpy(&ps, in, sizeof(ps));
+            in += sizeof(ps);
+
+            auto& p(manager.create<Paddle>(0.f, 0.f));
+            p.position = {ps.x, ps.y};
+            p.velocity.x = ps.vx;
+            p.input.left = ps.left != 0;
+            p.input.right = ps.right != 0;
+            p.player = std::min<int>(ps.player, maxPlayers - 1);
+            p.setWide(ps.wide != 0);
+        }
+
+        assignLanes();
+
+        for(std::uint32_t i{0}; i < h.powerUpCount; ++i)
+        {
+            PowerUpState us;
+            std::memcpy(&us, in, sizeof(us));
+            in += sizeof(us);
+
+            manager.create<PowerUp>(0.f, 0.f,
+                       static_cast<PowerUp::Type>(us.type))
+                .position = {us.x, us.y};
+        }
+
+        clearEffects();
+        for(std::uint32_t i{0}; i < h.effectCount; ++i)
+        {
+            EffectState es;
+            std::memcpy(&es, in, sizeof(es));
+            in += sizeof(es);
+
+            startEffect(static_cast<PowerUp::Type>(es.payload >> 8),
+                es.payload & 0xff, es.remaining);
+        }
+
+        bricks.loadState(in);
+
+        state = static_cast<State>(h.state);
+        remainingLives = h.remainingLives;
+        score = h.score;
+        std::copy(std::begin(h.playerScores), std::end(h.playerScores),
+            std::begin(playerScores));
+        ballSpawn = {h.ballSpawnX, h.ballSpawnY};
+        seed = h.seed;
+        serveRng.setState(h.serveRng);
+        dropRng.setState(h.dropRng);
+        return true;
+    }
+
+    // Entità attive più mattoncini vivi: usato per normalizzare i
+    // contatori hardware.
+    std::size_t countEntities() const
+    {
+        std::size_t result{bricks.countLive()};
+        manager.forEachGroup([&result](const char*, std::size_t mCount)
+            {
+                result += mCount;
+            });
+        return result;
+    }
+};
+
+constexpr std::size_t World::maxBalls;
+constexpr std::size_t World::maxPlayers;
+
+// Socket UDP non bloccante, legato a una porta di `localhost`.
+class UdpSocket
+{
+private:
+    int fd{-1};
+
+    static sockaddr_in getAddress(std::uint16_t mPort) noexcept
+    {
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(mPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return address;
+    }
+
+public:
+    UdpSocket() = default;
+    ~UdpSocket()
+    {
+        if(fd != -1) close(fd);
+    }
+
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+
+    bool open(std::uint16_t mPort)
+    {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if(fd == -1) return false;
+
+        auto address(getAddress(mPort));
+        if(bind(fd, reinterpret_cast<const sockaddr*>(&address),
+               sizeof(address)) != 0 ||
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+        {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+
+        return true;
+    }
+
+    void sendTo(std::uint16_t mPort, const void* mData, std::size_t mSize)
+    {
+        auto address(getAddress(mPort));
+        sendto(fd, mData, mSize, 0,
+            reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    }
+
+    // Restituisce la dimensione del pacchetto ricevuto, o `-1` se non
+    // ce ne sono. Se `mPort` è presente, vi scrive la porta del
+    // mittente.
+    long receive(void* mData, std::size_t mSize, std::uint16_t* mPort = nullptr)
+    {
+        sockaddr_in address;
+        socklen_t length(sizeof(address));
+
+        auto result(recvfrom(fd, mData, mSize, 0,
+            reinterpret_cast<sockaddr*>(&address), &length));
+        if(result >= 0 && mPort != nullptr) *mPort = ntohs(address.sin_port);
+
+        return result;
+    }
+};
+
+// Sessione "versus" con rollback: ogni processo simula lo stesso
+// `World` e controlla uno dei due paddle. Gli input locali vengono
+// inviati all'altro processo ad ogni tick; l'input remoto non ancora
+// ricevuto viene previsto ripetendo l'ultimo noto. Quando arriva un
+// input diverso da quello previsto, il mondo viene ripristinato dal
+// savestate di quel tick e i tick successivi vengono risimulati.
+//
+// La simulazione è deterministica, quindi i due processi arrivano
+// allo stesso stato una volta ricevuti tutti gli input.
+class RollbackSession
+{
+public:
+    // Numero massimo di tick che la simulazione locale può anticipare
+    // rispetto all'ultimo input remoto confermato.
+    static constexpr std::uint32_t maxRollback{16};
+
+    struct Stats
+    {
+        std::size_t rollbacks{0}, resimulatedTicks{0}, maxDepth{0};
+        std::size_t stalls{0};
+        std::chrono::nanoseconds resimulationTime{0};
+    };
+
+private:
+    // Ogni pacchetto contiene tutti gli input locali non ancora
+    // confermati dall'altro processo: i pacchetti persi non fanno
+    // perdere input.
+    static constexpr std::uint32_t historySize{64};
+    static constexpr char defMagic[4]{'A', 'R', 'K', 'I'};
+
+    struct InputPacket
+    {
+        char magic[4];
+        std::uint32_t firstFrame, count;
+
+        // Tick per cui chi invia ha ricevuto tutti gli input remoti.
+        std::uint32_t ackFrame;
+        std::uint8_t inputs[historySize];
+    };
+
+    // Pacchetto in uscita, trattenuto per simulare la latenza.
+    struct DelayedPacket
+    {
+        std::chrono::steady_clock::time_point sendTime;
+        InputPacket packet;
+    };
+
+    World& world;
+    int localPlayer;
+    UdpSocket socket;
+    std::uint16_t remotePort;
+    std::chrono::milliseconds latency;
+
+    // `frame` è il prossimo tick da simulare. Gli input remoti sono
+    // noti per i tick `< remoteConfirmed`, e l'altro processo conosce
+    // i nostri per i tick `< remoteAcked`.
+    std::uint32_t frame{0}, remoteConfirmed{0}, remoteAcked{0};
+    std::uint32_t rollbackFrom{std::numeric_limits<std::uint32_t>::max()};
+
+    // Storico circolare, indicizzato con `tick % historySize`. Lo
+    // stato `i` è quello precedente alla simulazione del tick `i`.
+    std::array<std::uint8_t, historySize> localInputs{}, remoteInputs{};
+    std::array<std::uint8_t, historySize> usedRemoteInputs{};
+    std::array<std::vector<char>, historySize> states;
+
+    std::array<DelayedPacket, historySize> outgoing;
+    std::size_t outgoingBegin{0}, outgoingEnd{0};
+
+    Stats stats;
+
+    static std::uint8_t encode(Paddle::Input mInput) noexcept
+    {
+        return (mInput.left ? 1 : 0) | (mInput.right ? 2 : 0);
+    }
+
+    static Paddle::Input decode(std::uint8_t mBits) noexcept
+    {
+        Paddle::Input input;
+        input.left = (mBits & 1) != 0;
+        input.right = (mBits & 2) != 0;
+        return input;
+    }
+
+    void simulate(std::uint32_t mFrame)
+    {
+        auto idx(mFrame % historySize);
+        world.saveState(states[idx]);
+
+        // Previsione: l'ultimo input remoto confermato.
+        auto last((remoteConfirmed + historySize - 1) % historySize);
+        auto remote(mFrame < remoteConfirmed ? remoteInputs[idx]
+                    : remoteConfirmed > 0    ? remoteInputs[last]
+                                             : std::uint8_t{0});
+        usedRemoteInputs[idx] = remote;
+
+        world.paddleInputs[localPlayer] = decode(localInputs[idx]);
+        world.paddleInputs[1 - localPlayer] = decode(remote);
+
+        if(world.state == World::State::InProgress) world.step();
+    }
+
+    void receive()
+    {
+        InputPacket packet;
+        while(socket.receive(&packet, sizeof(packet)) == sizeof(packet))
+        {
+            if(std::memcmp(packet.magic, defMagic, 4) != 0 ||
+                packet.count > historySize)
+                continue;
+
+            remoteAcked = std::max(remoteAcked, packet.ackFrame);
+
+            // Accettiamo solo input contigui a quelli già confermati, e
+            // che non sovrascrivano lo storico ancora necessario.
+            auto end(packet.firstFrame + packet.count);
+            for(auto f(std::max(packet.firstFrame, remoteConfirmed)); f < end;
+                ++f)
+            {
+                if(f != remoteConfirmed ||
+                    f >= frame + historySize - maxRollback)
+                    break;
+
+                auto idx(f % historySize);
+                remoteInputs[idx] = packet.inputs[f - packet.firstFrame];
+                ++remoteConfirmed;
+
+                if(f < frame && remoteInputs[idx] != usedRemoteInputs[idx])
+                    rollbackFrom = std::min(rollbackFrom, f);
+            }
+        }
+    }
+
+    void rollback()
+    {
+        if(rollbackFrom >= frame) return;
+
+        TRACE_SCOPE("rollback");
+        auto start(std::chrono::steady_clock::now());
+
+        world.loadState(states[rollbackFrom % historySize].data(),
+            states[rollbackFrom % historySize].size());
+
+        for(auto f(rollbackFrom); f < frame; ++f) simulate(f);
+
+        ++stats.rollbacks;
+        stats.resimulatedTicks += frame - rollbackFrom;
+        stats.maxDepth =
+            std::max<std::size_t>(stats.maxDepth, frame - rollbackFrom);
+        stats.resimulationTime += std::chrono::steady_clock::now() - start;
+
+        rollbackFrom = std::numeric_limits<std::uint32_t>::max();
+    }
+
+    void send()
+    {
+        auto now(std::chrono::steady_clock::now());
+
+        // Se la coda è piena scartiamo il pacchetto: il successivo
+        // conterrà comunque gli stessi input.
+        if(outgoingEnd - outgoingBegin < historySize)
+        {
+            auto& delayed(outgoing[outgoingEnd++ % historySize]);
+            auto& packet(delayed.packet);
+
+            std::memcpy(packet.magic, defMagic, 4);
+            packet.firstFrame = remoteAcked;
+            packet.count = std::min(frame - remoteAcked, historySize);
+            packet.ackFrame = remoteConfirmed;
+            for(std::uint32_t i{0}; i < packet.count; ++i)
+                packet.inputs[i] =
+                    localInputs[(packet.firstFrame + i) % historySize];
+
+            delayed.sendTime = now + latency;
+        }
+
+        while(outgoingBegin != outgoingEnd &&
+              outgoing[outgoingBegin % historySize].sendTime <= now)
+        {
+            const auto& packet(outgoing[outgoingBegin++ % historySize].packet);
+            socket.sendTo(remotePort, &packet, sizeof(packet));
+        }
+    }
+
+public:
+    RollbackSession(World& mWorld, int mLocalPlayer,
+        std::chrono::milliseconds mLatency = std::chrono::milliseconds{0})
+        : world(mWorld), localPlayer{mLocalPlayer}, latency{mLatency}
+    {
+    }
+
+    bool connect(std::uint16_t mLocalPort, std::uint16_t mRemotePort)
+    {
+        remotePort = mRemotePort;
+        return socket.open(mLocalPort);
+    }
+
+    // Esegue un tick con l'input locale `mInput`, dopo aver applicato
+    // gli input remoti ricevuti. Se la simulazione locale è troppo
+    // avanti rispetto all'altro processo, il tick viene saltato e
+    // restituisce `false`.
+    bool advance(Paddle::Input mInput)
+    {
+        receive();
+        rollback();
+
+        auto advanced(frame < remoteConfirmed + maxRollback);
+        if(advanced)
+        {
+            // Il primo tick salva lo stato iniziale: il livello è
+            // ormai quello della partita, e riserviamo la memoria di
+            // tutti i savestate. Da qui in poi salvataggi e rollback
+            // non allocano.
+            if(frame == 0)
+                for(auto& s : states) s.reserve(world.getMaxStateSize());
+
+            localInputs[frame % historySize] = encode(mInput);
+            simulate(frame++);
+        }
+        else
+            ++stats.stalls;
+
+        send();
+        return advanced;
+    }
+
+    // Riceve e invia senza avanzare: serve a completare la partita
+    // quando la simulazione locale si è fermata.
+    void sync()
+    {
+        receive();
+        rollback();
+        send();
+    }
+
+    // `true` se entrambi i processi conoscono tutti gli input fino al
+    // tick corrente.
+    bool isSettled() const noexcept
+    {
+        return remoteConfirmed >= frame && remoteAcked >= frame &&
+               rollbackFrom == std::numeric_limits<std::uint32_t>::max();
+    }
+
+    std::uint32_t getFrame() const noexcept { return frame; }
+    const Stats& getStats() const noexcept { return stats; }
+
+    void printStats(std::ostream& mStream) const
+    {
+        using Ms = std::chrono::duration<double, std::milli>;
+
+        mStream << "Ticks: " << frame << ", rollbacks: " << stats.rollbacks
+                << ", resimulated ticks: " << stats.resimulatedTicks
+                << ", max depth: " << stats.maxDepth
+                << ", stalls: " << stats.stalls << "\n"
+                << "Resimulation: "
+                << Ms{stats.resimulationTime}.count() /
+                       std::max<std::size_t>(1, stats.rollbacks)
+                << " ms/rollback\n";
+    }
+};
+
+constexpr char RollbackSession::defMagic[4];
+constexpr std::uint32_t RollbackSession::historySize;
+
+// Hash FNV-1a di un savestate: due processi sincronizzati devono
+// ottenere lo stesso valore.
+std::uint64_t getStateChecksum(const World& mWorld)
+{
+    std::vector<char> blob;
+    mWorld.saveState(blob);
+
+    std::uint64_t hash{14695981039346656037ull};
+    for(auto c : blob)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// Protocollo della modalità client/server. Il server simula il
+// `World` e invia ad ogni tick uno snapshot a ogni client; i client
+// rispondono con l'ultimo tick ricevuto ("ack") e, se giocano, con
+// il loro input.
+//
+// Ogni snapshot è compresso rispetto all'ultimo confermato dal
+// client: del campo di mattoncini vengono inviate solo le parole di
+// colpi cambiate (come XOR), e le posizioni sono quantizzate a 1/8 di
+// pixel su 16 bit.
+namespace net
+{
+    constexpr char clientMagic[4]{'A', 'R', 'K', 'C'};
+    constexpr char snapshotMagic[4]{'A', 'R', 'K', 'D'};
+    constexpr std::uint32_t noTick{std::numeric_limits<std::uint32_t>::max()};
+
+    constexpr std::size_t maxPacketSize{1200};
+    constexpr std::size_t historySize{64};
+    constexpr float quantization{8.f};
+
+    struct ClientPacket
+    {
+        char magic[4];
+        std::uint32_t ackTick;
+        std::uint8_t input, play;
+    };
+
+    struct SnapshotHeader
+    {
+        char magic[4];
+        std::uint32_t tick, baselineTick;
+        std::int32_t score, remainingLives;
+        std::uint16_t wordCount, diffCount;
+        std::uint8_t state, ballCount, paddleCount;
+    };
+
+    struct QuantizedPos
+    {
+        std::int16_t x, y;
+    };
+
+    // Spazio rimasto per le differenze nel caso peggiore.
+    constexpr std::size_t maxDiffs{
+        (maxPacketSize - sizeof(SnapshotHeader) -
+            sizeof(QuantizedPos) * (World::maxBalls + World::maxPlayers)) /
+        (sizeof(std::uint16_t) + sizeof(std::uint64_t))};
+
+    inline QuantizedPos quantize(sf::Vector2f mPos) noexcept
+    {
+        auto q([](float mV)
+            {
+                return static_cast<std::int16_t>(std::max(-32768.f,
+                    std::min(32767.f, std::round(mV * quantization))));
+            });
+        return {q(mPos.x), q(mPos.y)};
+    }
+
+    inline sf::Vector2f dequantize(QuantizedPos mPos) noexcept
+    {
+        return {mPos.x / quantization, mPos.y / quantization};
+    }
+
+    // Scrittura e lettura sequenziale di strutture in un buffer.
+    struct Writer
+    {
+        char* data;
+        std::size_t size{0};
+
+        template <typename T>
+        void write(const T& mValue) noexcept
+        {
+            std::memcpy(data + size, &mValue, sizeof(T));
+            size += sizeof(T);
+        }
+    };
+
+    struct Reader
+    {
+        const char* data;
+        std::size_t size, offset{0};
+
+        template <typename T>
+        bool read(T& mValue) noexcept
+        {
+            if(offset + sizeof(T) > size) return false;
+            std::memcpy(&mValue, data + offset, sizeof(T));
+            offset += sizeof(T);
+            return true;
+        }
+    };
+
+    // Contatori di traffico e di tempo, stampati periodicamente.
+    struct Stats
+    {
+        std::uint64_t packets{0}, bytes{0};
+        std::chrono::nanoseconds time{0};
+
+        void print(std::ostream& mStream, const char* mLabel,
+            double mSeconds, std::uint64_t mTicks) const
+        {
+            using Us = std::chrono::duration<double, std::micro>;
+
+            mStream << mLabel << ":";
+            if(packets != 0)
+                mStream << " " << packets << " packets, "
+                        << double(bytes) / packets << " B/packet, "
+                        << bytes / std::max(mSeconds, 1e-9) / 1024.0
+                        << " KiB/s";
+            if(time.count() != 0)
+                mStream << " " << Us{time}.count() /
+                                      std::max<std::uint64_t>(1, mTicks)
+                        << " us/tick";
+            mStream << "\n";
+        }
+    };
+}
+
+// Server autoritativo: l'unico a simulare il `World`. Il paddle è
+// guidato dall'input del primo client che gioca, o dal bot.
+class SnapshotServer
+{
+private:
+    struct Client
+    {
+        std::uint16_t port;
+        std::uint32_t ackTick{net::noTick};
+        std::chrono::steady_clock::time_point lastSeen;
+        net::Stats sent;
+    };
+
+    // Colpi dei mattoncini ad ogni tick recente, usati come base per
+    // le differenze.
+    struct Snapshot
+    {
+        std::uint32_t tick{net::noTick};
+        std::vector<std::uint64_t> hitWords;
+    };
+
+    World& world;
+    UdpSocket socket;
+    BotController bot;
+
+    std::vector<Client> clients;
+    std::array<Snapshot, net::historySize> history;
+    std::uint32_t tick{0};
+
+    // Porta del client che controlla il paddle, se c'è.
+    std::uint16_t playerPort{0};
+    Paddle::Input playerInput;
+
+    net::Stats simulation, encoding;
+    std::array<char, net::maxPacketSize> packet;
+
+    Client& getClient(std::uint16_t mPort)
+    {
+        for(auto& c : clients)
+            if(c.port == mPort) return c;
+
+        clients.emplace_back();
+        clients.back().port = mPort;
+        std::cout << "Client connected on port " << mPort << "\n";
+        return clients.back();
+    }
+
+    void receive()
+    {
+        auto now(std::chrono::steady_clock::now());
+        net::ClientPacket p;
+        std::uint16_t port;
+
+        while(socket.receive(&p, sizeof(p), &port) == sizeof(p))
+        {
+            if(std::memcmp(p.magic, net::clientMagic, 4) != 0) continue;
+
+            auto& client(getClient(port));
+            client.lastSeen = now;
+
+            // Gli ack possono arrivare in disordine.
+            if(p.ackTick != net::noTick &&
+                (client.ackTick == net::noTick || p.ackTick > client.ackTick))
+                client.ackTick = p.ackTick;
+
+            if(p.play != 0 && (playerPort == 0 || playerPort == port))
+            {
+                playerPort = port;
+                playerInput.left = (p.input & 1) != 0;
+                playerInput.right = (p.input & 2) != 0;
+            }
+        }
+
+        // I client silenziosi da qualche secondo vengono rimossi.
+        clients.erase(std::remove_if(std::begin(clients), std::end(clients),
+                          [&](const Client& mClient)
+                          {
+                              auto timeout(now - mClient.lastSeen >
+                                           std::chrono::seconds{3});
+                              if(timeout && mClient.port == playerPort)
+                                  playerPort = 0;
+                              return timeout;
+                          }),
+            std::end(clients));
+    }
+
+    // Lo storico viene dimensionato sul livello servito, ad ogni
+    // `restart`: copiare i colpi ad ogni tick non alloca.
+    void reserveHistory()
+    {
+        auto words(world.bricks.getHitWords().size());
+        for(auto& s : history) s.hitWords.reserve(words);
+    }
+
+    std::size_t encode(const Client& mClient)
+    {
+        const auto& words(world.bricks.getHitWords());
+
+        // La base è l'ultimo snapshot confermato, se è ancora nello
+        // storico; altrimenti tutti i mattoncini vengono inviati.
+        const std::vector<std::uint64_t>* base{nullptr};
+        if(mClient.ackTick != net::noTick && tick - mClient.ackTick <
+            net::historySize)
+        {
+            const auto& s(history[mClient.ackTick % net::historySize]);
+            if(s.tick == mClient.ackTick) base = &s.hitWords;
+        }
+
+        const auto& balls(world.manager.getAll<Ball>());
+        const auto& paddles(world.manager.getAll<Paddle>());
+
+        net::SnapshotHeader h;
+        std::memcpy(h.magic, net::snapshotMagic, 4);
+        h.tick = tick;
+        h.baselineTick = base != nullptr ? mClient.ackTick : net::noTick;
+        h.score = world.score;
+        h.remainingLives = world.remainingLives;
+        h.wordCount = words.size();
+        h.diffCount = 0;
+        h.state = static_cast<std::uint8_t>(world.state);
+        h.ballCount = std::min(balls.size(), World::maxBalls);
+        h.paddleCount = std::min(paddles.size(), World::maxPlayers);
+
+        for(std::size_t w{0}; w < words.size(); ++w)
+            if(words[w] != (base != nullptr ? (*base)[w] : 0)) ++h.diffCount;
+
+        net::Writer out{packet.data()};
+        out.write(h);
+
+        for(std::size_t i{0}; i < h.ballCount; ++i)
+        {
+            const auto& b(*static_cast<const Ball*>(balls[i]));
+            out.write(net::quantize(sf::Vector2f(b.position)));
+        }
+        for(std::size_t i{0}; i < h.paddleCount; ++i)
+        {
+            const auto& p(*static_cast<const Paddle*>(paddles[i]));
+            out.write(net::quantize(sf::Vector2f(p.position)));
+        }
+
+        for(std::size_t w{0}; w < words.size(); ++w)
+        {
+            auto bits(words[w] ^ (base != nullptr ? (*base)[w] : 0));
+            if(bits == 0) continue;
+
+            out.write(static_cast<std::uint16_t>(w));
+            out.write(bits);
+        }
+
+        return out.size;
+    }
+
+public:
+    SnapshotServer(World& mWorld) : world(mWorld) {}
+
+    bool listen(std::uint16_t mPort)
+    {
+        if(world.bricks.getHitWords().size() > net::maxDiffs)
+        {
+            std::cerr << "Level too large for network snapshots\n";
+            return false;
+        }
+
+        reserveHistory();
+        return socket.open(mPort);
+    }
+
+    // Un tick: input dei client, simulazione e invio degli snapshot.
+    void update()
+    {
+        using Clock = std::chrono::steady_clock;
+        receive();
+
+        auto simulationStart(Clock::now());
+
+        // Le partite concluse ricominciano: gli spettatori vedono
+        // sempre una partita in corso.
+        if(world.state != World::State::InProgress)
+        {
+            world.restart();
+            world.state = World::State::InProgress;
+            reserveHistory();
+        }
+
+        world.controller = playerPort != 0 ? nullptr : &bot;
+        world.paddleInputs[0] = playerInput;
+        world.step();
+        ++tick;
+
+        auto& snapshot(history[tick % net::historySize]);
+        snapshot.tick = tick;
+        snapshot.hitWords = world.bricks.getHitWords();
+
+        auto encodingStart(Clock::now());
+        simulation.time += encodingStart - simulationStart;
+
+        for(auto& c : clients)
+        {
+            auto size(encode(c));
+            socket.sendTo(c.port, packet.data(), size);
+
+            ++c.sent.packets;
+            c.sent.bytes += size;
+        }
+
+        encoding.time += Clock::now() - encodingStart;
+    }
+
+    std::uint32_t getTick() const noexcept { return tick; }
+
+    // Hash dei colpi dei mattoncini, per confrontarlo con i client.
+    std::uint64_t getBrickChecksum() const noexcept
+    {
+        std::uint64_t hash{14695981039346656037ull};
+        for(auto w : world.bricks.getHitWords())
+        {
+            hash ^= w;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    void printStats(std::ostream& mStream, double mSeconds) const
+    {
+        simulation.print(mStream, "Simulation", mSeconds, tick);
+        encoding.print(mStream, "Encoding", mSeconds, tick);
+        for(const auto& c : clients)
+        {
+            auto label("Client " + std::to_string(c.port));
+            c.sent.print(mStream, label.c_str(), mSeconds, tick);
+        }
+    }
+};
+
+// Client: riceve gli snapshot, li ricostruisce a partire dalla base
+// indicata dal server, e mostra il mondo interpolando tra due
+// snapshot con un ritardo fisso.
+class SnapshotClient
+{
+private:
+    struct Snapshot
+    {
+        std::uint32_t tick{net::noTick};
+        int score, remainingLives;
+        World::State state;
+        std::vector<sf::Vector2f> balls, paddles;
+        std::vector<std::uint64_t> hitWords;
+    };
+
+    UdpSocket socket;
+    std::uint16_t serverPort;
+
+    std::array<Snapshot, net::historySize> history;
+    std::uint32_t latestTick{net::noTick};
+    std::chrono::steady_clock::time_point latestTime;
+
+    std::array<char, net::maxPacketSize> packet;
+    net::Stats received;
+    std::uint64_t undecodable{0};
+
+    // Ritardo di visualizzazione: copre qualche snapshot perso o in
+    // ritardo senza scatti.
+    static constexpr float interpolationDelay{3.f};
+    static constexpr float tickSeconds{1.f / 60.f};
+
+    bool decode(std::size_t mSize)
+    {
+        net::Reader in{packet.data(), mSize};
+        net::SnapshotHeader h;
+
+        if(!in.read(h) || std::memcmp(h.magic, net::snapshotMagic, 4) != 0 ||
+            h.ballCount > World::maxBalls || h.paddleCount > World::maxPlayers)
+            return false;
+
+        // Snapshot vecchi o duplicati non servono.
+        if(latestTick != net::noTick && h.tick <= latestTick) return true;
+
+        const std::vector<std::uint64_t>* base{nullptr};
+        if(h.baselineTick != net::noTick)
+        {
+            const auto& b(history[h.baselineTick % net::historySize]);
+            if(b.tick != h.baselineTick || b.hitWords.size() != h.wordCount)
+                return false;
+            base = &b.hitWords;
+        }
+
+        auto& s(history[h.tick % net::historySize]);
+        s.tick = net::noTick;
+
+        // Se `base` punta a `s` stesso, la copia non cambia nulla.
+        if(base == nullptr)
+            s.hitWords.assign(h.wordCount, 0);
+        else if(base != &s.hitWords)
+            s.hitWords = *base;
+
+        s.balls.resize(h.ballCount);
+        s.paddles.resize(h.paddleCount);
+
+        net::QuantizedPos q;
+        for(auto& b : s.balls)
+        {
+            if(!in.read(q)) return false;
+            b = net::dequantize(q);
+        }
+        for(auto& p : s.paddles)
+        {
+            if(!in.read(q)) return false;
+            p = net::dequantize(q);
+        }
+
+        for(std::uint16_t i{0}; i < h.diffCount; ++i)
+        {
+            std::uint16_t index;
+            std::uint64_t bits;
+            if(!in.read(index) || !in.read(bits) || index >= h.wordCount)
+                return false;
+            s.hitWords[index] ^= bits;
+        }
+
+        s.tick = h.tick;
+        s.score = h.score;
+        s.remainingLives = h.remainingLives;
+        s.state = static_cast<World::State>(
+            std::min<int>(h.state, int(World::State::Victory)));
+
+        latestTick = h.tick;
+        latestTime = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    const Snapshot* find(std::uint32_t mTick) const noexcept
+    {
+        const auto& s(history[mTick % net::historySize]);
+        return s.tick == mTick ? &s : nullptr;
+    }
+
+    // Porta a `mCount` le entità di tipo `T`, distruggendo quelle in
+    // più: le restanti mantengono la loro memoria.
+    template <typename T>
+    static void resize(Manager& mManager, std::size_t mCount)
+    {
+        const auto& group(mManager.getAll<T>());
+        for(auto i(group.size()); i < mCount; ++i)
+            mManager.create<T>(0.f, 0.f);
+        for(auto i(mCount); i < group.size(); ++i) group[i]->destroyed = true;
+    }
+
+public:
+    SnapshotClient()
+    {
+        for(auto& s : history)
+        {
+            s.balls.reserve(World::maxBalls);
+            s.paddles.reserve(World::maxPlayers);
+        }
+    }
+
+    bool connect(std::uint16_t mLocalPort, std::uint16_t mServerPort)
+    {
+        serverPort = mServerPort;
+        return socket.open(mLocalPort);
+    }
+
+    // Riceve gli snapshot arrivati e risponde al server.
+    void update(bool mPlay, Paddle::Input mInput)
+    {
+        long size;
+        while((size = socket.receive(packet.data(), packet.size())) > 0)
+        {
+            ++received.packets;
+            received.bytes += size;
+            if(!decode(size)) ++undecodable;
+        }
+
+        net::ClientPacket p;
+        std::memcpy(p.magic, net::clientMagic, 4);
+        p.ackTick = latestTick;
+        p.input = (mInput.left ? 1 : 0) | (mInput.right ? 2 : 0);
+        p.play = mPlay ? 1 : 0;
+        socket.sendTo(serverPort, &p, sizeof(p));
+    }
+
+    // Copia nel `World` lo stato interpolato. Il `World` del client
+    // serve solo per il rendering, e non viene mai simulato.
+    void present(World& mWorld)
+    {
+        if(latestTick == net::noTick) return;
+
+        std::chrono::duration<float> elapsed{
+            std::chrono::steady_clock::now() - latestTime};
+        auto renderTick(std::min(float(latestTick),
+            latestTick + elapsed.count() / tickSeconds - interpolationDelay));
+
+        // Cerchiamo lo snapshot più recente non successivo a
+        // `renderTick`, e il primo successivo.
+        auto target(static_cast<std::uint32_t>(std::max(0.f, renderTick)));
+        const Snapshot* a{find(latestTick)};
+        const Snapshot* b{nullptr};
+
+        for(auto t(target); t + net::historySize > latestTick && t != 0; --t)
+            if((a = find(t)) != nullptr) break;
+        if(a == nullptr) a = find(latestTick);
+
+        // Nessuno snapshot utilizzabile: lasciamo lo stato presentato
+        // l'ultima volta.
+        if(a == nullptr) return;
+
+        for(auto t(a->tick + 1); t <= latestTick; ++t)
+            if((b = find(t)) != nullptr) break;
+
+        auto alpha(0.f);
+        if(b != nullptr)
+            alpha = std::max(0.f, std::min(1.f,
+                (renderTick - a->tick) / float(b->tick - a->tick)));
+
+        // Le entità si interpolano solo se il loro numero non cambia.
+        auto lerp([alpha](const std::vector<sf::Vector2f>& mA,
+                      const std::vector<sf::Vector2f>* mB, std::size_t mI)
+            {
+                if(mB == nullptr || mB->size() != mA.size()) return mA[mI];
+                return mA[mI] + ((*mB)[mI] - mA[mI]) * alpha;
+            });
+
+        // Le entità esistenti vengono solo spostate: se ne creano o
+        // distruggono solo quando il loro numero cambia.
+        auto& manager(mWorld.manager);
+        resize<Ball>(manager, a->balls.size());
+        resize<Paddle>(manager, a->paddles.size());
+        manager.refresh();
+
+        EntitySpan<Ball> balls{manager.getAll<Ball>()};
+        for(std::size_t i{0}; i < balls.size(); ++i)
+            balls[i].position =
+                Vec2(lerp(a->balls, b ? &b->balls : nullptr, i));
+
+        EntitySpan<Paddle> paddles{manager.getAll<Paddle>()};
+        for(std::size_t i{0}; i < paddles.size(); ++i)
+            paddles[i].position =
+                Vec2(lerp(a->paddles, b ? &b->paddles : nullptr, i));
+
+        // Le modifiche del frame precedente sono già state disegnate.
+        mWorld.bricks.clearChanges();
+        if(a->hitWords.size() == mWorld.bricks.getHitWords().size())
+            mWorld.bricks.assignHitWords(a->hitWords.data());
+
+        mWorld.score = a->score;
+        mWorld.remainingLives = a->remainingLives;
+        mWorld.state = a->state;
+    }
+
+    std::uint32_t getLatestTick() const noexcept { return latestTick; }
+
+    std::uint64_t getBrickChecksum() const noexcept
+    {
+        std::uint64_t hash{14695981039346656037ull};
+        auto s(find(latestTick));
+        if(s == nullptr) return hash;
+
+        for(auto w : s->hitWords)
+        {
+            hash ^= w;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    void printStats(std::ostream& mStream, double mSeconds) const
+    {
+        received.print(mStream, "Received", mSeconds, latestTick + 1);
+        mStream << "Undecodable snapshots: " << undecodable << "\n";
+    }
+};
+
+class Game
+{
+public:
+    // Da dove proviene il livello usato da `restart`.
+    enum class LevelSource
+    {
+        Default,
+        File,
+        Procedural
+    };
+
+private:
+    using State = World::State;
+
+    sf::RenderWindow window{{wndWidth, wndHeight}, "Arkanoid - 11"};
+    ThreadPool threadPool;
+    World world{threadPool};
+
+    // I livelli disponibili: quello di default, costruito in
+    // memoria, un file mappato in memoria e un livello procedurale.
+    LevelSource levelSource{LevelSource::Default};
+    std::vector<char> defaultLevel{buildDefaultLevel()};
+    std::vector<char> versusLevel{buildDefaultLevel(true)};
+    LevelView versusView;
+
+    // Presente solo nella modalità "versus", avviata con
+    // `startVersus`.
+    std::unique_ptr<RollbackSession> versus;
+
+    // Presente solo quando il gioco è client di un server, avviato
+    // con `startClient`: il `World` locale viene solo disegnato.
+    std::unique_ptr<SnapshotClient> client;
+    bool clientPlays{false};
+    MappedFile levelFile;
+    std::vector<char> generatedLevel;
+    LevelView defaultView, fileView, generatedView;
+
+    // Le fasi di un frame "in progress" sono descritte da un grafo
+    // di task, costruito una sola volta nel costruttore.
+    TaskGraph frameGraph;
+
+    BrickFieldRenderer brickRenderer;
+    ParticleSystem particles;
+
+    bool pausePressedLastFrame{false};
+
+    // Il tasto `B` passa il controllo del paddle al bot e viceversa.
+    BotController bot;
+    bool botPressedLastFrame{false};
+
+    // `F5` salva lo stato del mondo in memoria e in `statePath`, `F9`
+    // ripristina l'ultimo stato salvato.
+    std::vector<char> quickSave;
+    std::string statePath{"arkanoid-state.bin"};
+    bool savePressedLastFrame{false}, loadPressedLastFrame{false};
+
+    // Il tasto `T` avvia e ferma la registrazione di una traccia.
+    bool tracePressedLastFrame{false};
+    std::string tracePath{"arkanoid-trace.json"};
+
+    // Statistiche sui tempi: un istogramma per la durata dei frame e
+    // uno per ogni task del grafo. Un frame che supera `hitchBudget`
+    // viene descritto in `hitchLogPath`.
+    using Ns = std::chrono::nanoseconds;
+    LatencyHistogram frameHistogram;
+    std::vector<LatencyHistogram> phaseHistograms;
+    Ns hitchBudget{std::chrono::microseconds{16600}};
+    std::string hitchLogPath{"arkanoid-hitches.log"};
+    std::ofstream hitchLog;
+    std::size_t frameIndex{0}, hitchCount{0};
+
+    // Somma delle entità simulate nei frame misurati dai contatori.
+    std::uint64_t perfEntityCount{0};
+
+    // Il font viene caricato in background: la finestra si apre
+    // subito, e i testi vengono mostrati appena il font è pronto.
+    AssetManager assets{{".", "assets", "/usr/share/fonts/TTF",
+        "/usr/share/fonts/truetype/liberation", "/usr/share/fonts/liberation"}};
+    const AssetManager::Asset<sf::Font>& liberationSans{
+        assets.request<sf::Font>("LiberationSans-Regular.ttf")};
+
+    // SFML offre delle classi `sf::Font` ed `sf::Text` molto facili
+    // da usare. Le impiegheremo, tramite `HudText`, per mostrare il
+    // numero di vite rimanenti, il punteggio e lo stato del gioco.
+    HudText hudState{liberationSans.get(), 35, 10.f, 10.f};
+    HudText hudLives{liberationSans.get(), 15, 10.f, 10.f};
+    HudText hudScore{liberationSans.get(), 15, 10.f, 30.f};
+
+    bool glyphsPrewarmed{false};
+
+    // Appena il font è disponibile, prepariamo i glifi di tutti i
+    // testi per ogni dimensione usata, così i cambi di stato non
+    // causano rallentamenti.
+    void prewarmGlyphs()
+    {
+        const auto& font(liberationSans.get());
+        const HudText* huds[]{&hudState, &hudLives, &hudScore};
+
+        std::set<unsigned int> characterSizes;
+
+        for(auto h : huds)
+        {
+            h->prewarm(font);
+            characterSizes.emplace(h->getCharacterSize());
+        }
+
+        for(auto cs : characterSizes)
+        {
+            auto size(font.getTexture(cs).getSize());
+            std::cout << "Glyph atlas (size " << cs << "): " << size.x << "x"
+                      << size.y << "\n";
+        }
+
+        glyphsPrewarmed = true;
+    }
+
+    static const char* getStateLabel(State mState) noexcept
+    {
+        switch(mState)
+        {
+            case State::Paused: return "Paused";
+            case State::GameOver: return "Game over!";
+            case State::Victory: return "You won!";
+            default: return "";
+        }
+    }
+
+    static Paddle::Input readKeyboardInput()
+    {
+        Paddle::Input input;
+        input.left = sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Left);
+        input.right = sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Right);
+        return input;
+    }
+
+    // Le particelle seguono i mattoncini colpiti nell'ultimo tick.
+    void updateParticles()
+    {
+        particles.emit(world.bricks);
+        particles.update();
+    }
+
+    void drawWorld()
+    {
+        brickRenderer.sync(world.bricks);
+        brickRenderer.draw(window);
+        particles.draw(window);
+        world.manager.draw(window);
+
+        if(!liberationSans.isLoaded()) return;
+        hudLives.draw(window);
+        hudScore.draw(window);
+    }
+
+    // `true` solo nel frame in cui il tasto viene premuto.
+    static bool isKeyTriggered(sf::Keyboard::Key mKey, bool& mPressedLastFrame)
+    {
+        auto pressed(sf::Keyboard::isKeyPressed(mKey));
+        auto triggered(pressed && !mPressedLastFrame);
+        mPressedLastFrame = pressed;
+        return triggered;
+    }
+
+    void saveQuickState()
+    {
+        world.saveState(quickSave);
+
+        std::ofstream file{statePath, std::ios::binary};
+        file.write(quickSave.data(), quickSave.size());
+        if(!file) std::cerr << "Cannot write state to `" << statePath << "`\n";
+    }
+
+    static double toMs(Ns mValue) noexcept
+    {
+        return std::chrono::duration<double, std::milli>{mValue}.count();
+    }
+
+    // Registra la durata del frame e, se il grafo è stato eseguito,
+    // quella di ogni fase.
+    void recordFrame(Ns mFrameTime, bool mSimulated)
+    {
+        ++frameIndex;
+        frameHistogram.record(mFrameTime);
+
+        if(mSimulated)
+        {
+            for(TaskGraph::TaskId i{0}; i < phaseHistograms.size(); ++i)
+                phaseHistograms[i].record(frameGraph.getDuration(i));
+
+            if(PerfCounters::isEnabled())
+                perfEntityCount += world.countEntities();
+        }
+
+        if(mFrameTime > hitchBudget) reportHitch(mFrameTime, mSimulated);
+    }
+
+    void reportHitch(Ns mFrameTime, bool mSimulated)
+    {
+        ++hitchCount;
+
+        if(!hitchLog.is_open())
+        {
+            hitchLog.open(hitchLogPath, std::ios::app);
+            if(!hitchLog) return;
+        }
+
+        auto& log(hitchLog);
+        log << "Hitch at frame " << frameIndex << ": " << toMs(mFrameTime)
+            << " ms (budget " << toMs(hitchBudget) << " ms)\n"
+            << "  state: " << static_cast<int>(world.state) << "\n"
+            << "  destroyed entities: "
+            << world.manager.getLastDestroyedCount() << "\n"
+            << "  live bricks: " << world.bricks.countLive() << "\n";
+
+        world.manager.forEachGroup(
+            [&log](const char* mName, std::size_t mCount)
+            {
+                log << "  group " << mName << ": " << mCount << "\n";
+            });
+
+        if(mSimulated)
+            for(TaskGraph::TaskId i{0}; i < frameGraph.getTaskCount(); ++i)
+                log << "  phase " << frameGraph.getName(i) << ": "
+                    << toMs(frameGraph.getDuration(i)) << " ms\n";
+
+        log.flush();
+    }
+
+    void printFrameStats() const
+    {
+        frameHistogram.print(std::cout, "frame");
+        for(TaskGraph::TaskId i{0}; i < phaseHistograms.size(); ++i)
+            phaseHistograms[i].print(std::cout, frameGraph.getName(i));
+
+        std::cout << "Hitches: " << hitchCount << "\n";
+        particles.printStats(std::cout);
+        frameGraph.printPerf(std::cout, perfEntityCount);
+    }
+
+public:
+    Game()
+    {
+        window.setFramerateLimit(60);
+        LevelView::fromMemory(
+            defaultLevel.data(), defaultLevel.size(), defaultView);
+        LevelView::fromMemory(
+            versusLevel.data(), versusLevel.size(), versusView);
+
+        hudState.bind(
+            [](const void* mWorld)
+            {
+                return getStateLabel(static_cast<const World*>(mWorld)->state);
+            },
+            &world,
+            {getStateLabel(State::Paused), getStateLabel(State::GameOver),
+                getStateLabel(State::Victory)});
+        hudLives.bind("Lives: ", world.remainingLives);
+        hudScore.bind("Score: ", world.score);
+
+        buildFrameGraph();
+    }
+
+    void buildFrameGraph()
+    {
+        auto& g(frameGraph);
+        auto simulation(world.addTasks(g));
+
+        // Aggiorniamo i testi delle vite rimanenti e del punteggio:
+        // vengono rigenerati solo se i valori sono cambiati. Vite e
+        // punteggio vengono scritti dalla simulazione, quindi i testi
+        // vanno letti solo dopo il suo ultimo task.
+        auto hud(g.add("hud", [this]
+            {
+                hudLives.refresh();
+                hudScore.refresh();
+            }));
+
+        auto effects(g.add("particles", [this]
+            {
+                updateParticles();
+            }));
+
+        // Il rendering deve avvenire sul thread che possiede la
+        // finestra.
+        auto draw(g.add("draw",
+            [this]
+            {
+                drawWorld();
+            },
+            true));
+
+        g.precede(simulation.last, hud);
+        g.precede(simulation.last, effects);
+        g.precede(effects, draw);
+        g.precede(hud, draw);
+
+        phaseHistograms.resize(g.getTaskCount());
+    }
+
+    // Sceglie la sorgente del livello usato dal prossimo `restart`.
+    // Le sorgenti `File` e `Procedural` devono essere state caricate
+    // con `loadLevel` o `generateLevel`.
+    void setLevelSource(LevelSource mSource) noexcept
+    {
+        levelSource = mSource;
+    }
+
+    void restart()
+    {
+        if(levelSource == LevelSource::File && fileView.isValid())
+            world.setLevel(fileView);
+        else if(levelSource == LevelSource::Procedural &&
+                generatedView.isValid())
+            world.setLevel(generatedView);
+        else
+            world.setLevel(defaultView);
+
+        world.restart();
+        particles.clear();
+    }
+
+    // Carica un livello binario. In caso di errore, il livello
+    // corrente non viene modificato.
+    bool loadLevel(const std::string& mPath)
+    {
+        MappedFile file;
+        LevelView view;
+
+        if(!file.open(mPath) ||
+            !LevelView::fromMemory(file.getData(), file.getSize(), view))
+        {
+            std::cerr << "Invalid level file `" << mPath << "`\n";
+            return false;
+        }
+
+        levelFile.swap(file);
+        fileView = view;
+        levelSource = LevelSource::File;
+        return true;
+    }
+
+    void generateLevel(const LevelGenParams& mParams)
+    {
+        generatedLevel = ::generateLevel(mParams);
+        if(!LevelView::fromMemory(
+               generatedLevel.data(), generatedLevel.size(), generatedView))
+            return;
+
+        levelSource = LevelSource::Procedural;
+        world.setSeed(mParams.seed);
+    }
+
+    void run()
+    {
+        auto& state(world.state);
+        auto runStart(std::chrono::steady_clock::now());
+
+        // In rete lo stato non può essere modificato localmente.
+        const auto remote(versus != nullptr || client != nullptr);
+
+        while(true)
+        {
+            TRACE_SCOPE("frame");
+            auto frameStart(std::chrono::steady_clock::now());
+            auto simulated(false);
+
+            window.clear(sf::Color::Black);
+
+            if(!glyphsPrewarmed && liberationSans.isLoaded()) prewarmGlyphs();
+
+            if(sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Escape)) break;
+
+            // Nella modalità "versus" pausa, restart, bot e ripristino
+            // sono disabilitati: i due processi devono restare identici.
+            // Lo stesso vale per un client, che mostra lo stato del
+            // server.
+            if(!remote && sf::Keyboard::isKeyPressed(sf::Keyboard::Key::P))
+            {
+                if(!pausePressedLastFrame)
+                {
+                    if(state == State::Paused)
+                        state = State::InProgress;
+                    else if(state == State::InProgress)
+                        state = State::Paused;
+                }
+                pausePressedLastFrame = true;
+            }
+            else
+                pausePressedLastFrame = false;
+
+            if(!remote && sf::Keyboard::isKeyPressed(sf::Keyboard::Key::R))
+                restart();
+
+            if(!remote &&
+                isKeyTriggered(sf::Keyboard::Key::B, botPressedLastFrame))
+                setBotEnabled(!isBotEnabled());
+
+            if(isKeyTriggered(sf::Keyboard::Key::T, tracePressedLastFrame))
+            {
+                auto& tracer(Tracer::get());
+                if(tracer.isEnabled())
+                    tracer.stop();
+                else
+                    tracer.start(tracePath);
+            }
+
+            if(isKeyTriggered(sf::Keyboard::Key::F5, savePressedLastFrame))
+                saveQuickState();
+
+            if(!remote &&
+                isKeyTriggered(sf::Keyboard::Key::F9, loadPressedLastFrame) &&
+                !quickSave.empty())
+                world.loadState(quickSave.data(), quickSave.size());
+
+            // La sessione "versus" avanza anche a partita finita, per
+            // completare lo scambio degli input. Le particelle vengono
+            // emesse solo se un tick è stato davvero simulato, e le
+            // celle modificate vengono scartate dopo il disegno: un
+            // frame senza tick non ripete le esplosioni.
+            if(versus)
+            {
+                if(versus->advance(readKeyboardInput()))
+                    particles.emit(world.bricks);
+
+                particles.update();
+                hudLives.refresh();
+                hudScore.refresh();
+                drawWorld();
+                world.bricks.clearChanges();
+            }
+            else if(client)
+            {
+                client->update(clientPlays, readKeyboardInput());
+                client->present(world);
+                updateParticles();
+                hudLives.refresh();
+                hudScore.refresh();
+                drawWorld();
+                world.bricks.clearChanges();
+            }
+
+            // Se il gioco non è "in progress", non renderizziamo o
+            // aggiorniamo gli elementi, e mostriamo al player lo
+            // stato corrente con una stringa.
+            if(state != State::InProgress)
+            {
+                hudState.refresh();
+                if(liberationSans.isLoaded()) hudState.draw(window);
+            }
+            else if(!remote)
+            {
+                world.paddleInputs[0] = readKeyboardInput();
+
+                frameGraph.run(threadPool);
+                simulated = true;
+            }
+
+            // Il tempo di `display` non viene misurato: con il limite
+            // di framerate, include l'attesa del frame successivo.
+            recordFrame(
+                std::chrono::steady_clock::now() - frameStart, simulated);
+
+            TRACE_SCOPE("display");
+            window.display();
+        }
+
+        printFrameStats();
+        if(versus) versus->printStats(std::cout);
+        if(client)
+            client->printStats(std::cout,
+                std::chrono::duration<double>{
+                    std::chrono::steady_clock::now() - runStart}
+                    .count());
+    }
+
+    // Si collega a un server avviato con `--server`. Se `mPlay` è
+    // vero, il paddle del server è guidato dalla tastiera.
+    bool startClient(
+        std::uint16_t mLocalPort, std::uint16_t mServerPort, bool mPlay)
+    {
+        world.controller = nullptr;
+        clientPlays = mPlay;
+
+        client = std::make_unique<SnapshotClient>();
+        if(client->connect(mLocalPort, mServerPort)) return true;
+
+        std::cerr << "Cannot open UDP port " << mLocalPort << "\n";
+        client.reset();
+        return false;
+    }
+
+    // Avvia una partita "versus" contro un altro processo, che deve
+    // usare le porte scambiate e l'altro giocatore.
+    bool startVersus(int mPlayer, std::uint16_t mLocalPort,
+        std::uint16_t mRemotePort, std::chrono::milliseconds mLatency)
+    {
+        world.setLevel(versusView);
+        world.restart();
+        world.controller = nullptr;
+        world.state = State::InProgress;
+
+        versus = std::make_unique<RollbackSession>(world, mPlayer, mLatency);
+        if(versus->connect(mLocalPort, mRemotePort)) return true;
+
+        std::cerr << "Cannot open UDP port " << mLocalPort << "\n";
+        versus.reset();
+        return false;
+    }
+
+    void setTracePath(std::string mPath) { tracePath = std::move(mPath); }
+
+    void setBotEnabled(bool mEnabled) noexcept
+    {
+        world.controller = mEnabled ? &bot : nullptr;
+    }
+    bool isBotEnabled() const noexcept { return world.controller == &bot; }
+
+    // Ripristina un savestate salvato su file, ad esempio per
+    // riprodurre un problema. Va chiamato dopo `restart`, con lo
+    // stesso livello usato durante il salvataggio.
+    bool loadState(const std::string& mPath)
+    {
+        std::ifstream file{mPath, std::ios::binary};
+        std::vector<char> blob;
+        if(file)
+            blob.assign(std::istreambuf_iterator<char>{file},
+                std::istreambuf_iterator<char>{});
+
+        if(blob.empty() || !world.loadState(blob.data(), blob.size()))
+        {
+            std::cerr << "Invalid state file `" << mPath << "`\n";
+            return false;
+        }
+
+        quickSave = std::move(blob);
+        return true;
+    }
+    void setHitchBudget(Ns mBudget) noexcept { hitchBudget = mBudget; }
+};
+
+// Esegue fino a `mTicks` tick di simulazione senza finestra, e
+// riporta il tempo medio per tick.
+int runStressTest(const LevelView& mLevel, std::size_t mTicks)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    ThreadPool threadPool;
+    World world{threadPool};
+    world.setLevel(mLevel);
+
+    // Il paddle è guidato dal bot, così la simulazione distrugge
+    // davvero i mattoncini.
+    BotController bot;
+    world.controller = &bot;
+
+    auto restartStart(Clock::now());
+    world.restart();
+    auto restartTime(Clock::now() - restartStart);
+
+    auto bricks(world.bricks.countLive());
+    world.state = World::State::InProgress;
+
+    std::size_t ticks{0};
+    std::uint64_t entityCount{0};
+    auto stepStart(Clock::now());
+    for(; ticks < mTicks && world.state == World::State::InProgress; ++ticks)
+    {
+        if(PerfCounters::isEnabled()) entityCount += world.countEntities();
+        world.step();
+    }
+    auto stepTime(Clock::now() - stepStart);
+
+    using Ms = std::chrono::duration<double, std::milli>;
+    std::cout << "Bricks: " << bricks << "\n"
+              << "Restart: " << Ms{restartTime}.count() << " ms\n"
+              << "Ticks: " << ticks << ", "
+              << Ms{stepTime}.count() / std::max<std::size_t>(1, ticks)
+              << " ms/tick\n"
+              << "Bricks destroyed: " << world.score << "\n";
+
+    world.getStepGraph().printPerf(std::cout, entityCount);
+    return 0;
+}
+
+// Simula molti `World` indipendenti, avanzandoli tutti di un tick
+// alla volta ("lockstep") sul thread pool. Ogni mondo ha il proprio
+// livello, generato da un seed diverso, e il proprio thread pool
+// senza worker: il suo grafo viene eseguito interamente dal thread
+// che lo avanza, senza condividere stato con gli altri mondi.
+class BatchRunner
+{
+public:
+    struct Outcome
+    {
+        World::State state{World::State::InProgress};
+        std::size_t ticks{0};
+        int bricksDestroyed{0};
+    };
+
+private:
+    struct Slot
+    {
+        ThreadPool inlinePool{0};
+        World world{inlinePool};
+        BotController bot;
+        std::vector<char> level;
+        Outcome outcome;
+    };
+
+    ThreadPool& threadPool;
+    std::vector<std::unique_ptr<Slot>> slots;
+
+    void resetSlot(std::size_t mIdx, const LevelGenParams& mParams)
+    {
+        if(!slots[mIdx]) slots[mIdx] = std::make_unique<Slot>();
+        auto& slot(*slots[mIdx]);
+
+        slot.level = generateLevel(mParams);
+
+        LevelView view;
+        LevelView::fromMemory(slot.level.data(), slot.level.size(), view);
+
+        slot.world.setLevel(view);
+        slot.world.setSeed(mParams.seed);
+        slot.world.restart();
+        slot.world.state = World::State::InProgress;
+        slot.outcome = {};
+    }
+
+    std::size_t getGrain() const noexcept
+    {
+        // Pochi blocchi per thread: abbastanza per bilanciare il
+        // carico, senza pagare troppo per la coda dei job.
+        auto chunks((threadPool.getThreadCount() + 1) * 4);
+        return std::max<std::size_t>(1, slots.size() / chunks);
+    }
+
+public:
+    BatchRunner(ThreadPool& mThreadPool) : threadPool(mThreadPool) {}
+
+    // Prepara `mCount` mondi: il mondo `i` usa un livello generato
+    // con il seed `mParams.seed + i`.
+    void reset(std::size_t mCount, const LevelGenParams& mParams)
+    {
+        slots.resize(mCount);
+
+        threadPool.parallelFor(mCount, getGrain(),
+            [this, &mParams](std::size_t mBegin, std::size_t mEnd)
+            {
+                for(auto i(mBegin); i < mEnd; ++i)
+                {
+                    auto params(mParams);
+                    params.seed += i;
+                    resetSlot(i, params);
+                }
+            });
+    }
+
+    // Come sopra, ma con un seed esplicito per ogni mondo esistente.
+    void reset(const std::uint64_t* mSeeds, const LevelGenParams& mParams)
+    {
+        threadPool.parallelFor(slots.size(), getGrain(),
+            [this, mSeeds, &mParams](std::size_t mBegin, std::size_t mEnd)
+            {
+                for(auto i(mBegin); i < mEnd; ++i)
+                {
+                    auto params(mParams);
+                    params.seed = mSeeds[i];
+                    resetSlot(i, params);
+                }
+            });
+    }
+
+    // Avanza di un tick tutti i mondi ancora in corso, e restituisce
+    // quanti lo sono ancora. `mInputs`, se presente, contiene l'input
+    // del paddle di ogni mondo; altrimenti il paddle è controllato da
+    // un `BotController`.
+    std::size_t step(const Paddle::Input* mInputs = nullptr)
+    {
+        std::atomic<std::size_t> running{0};
+
+        threadPool.parallelFor(slots.size(), getGrain(),
+            [this, mInputs, &running](std::size_t mBegin, std::size_t mEnd)
+            {
+                std::size_t localRunning{0};
+
+                for(auto i(mBegin); i < mEnd; ++i)
+                {
+                    auto& slot(*slots[i]);
+                    auto& world(slot.world);
+                    if(world.state != World::State::InProgress) continue;
+
+                    if(mInputs != nullptr)
+                    {
+                        world.controller = nullptr;
+                        world.paddleInputs[0] = mInputs[i];
+                    }
+                    else
+                        world.controller = &slot.bot;
+
+                    world.step();
+
+                    slot.outcome.state = world.state;
+                    slot.outcome.bricksDestroyed = world.score;
+                    ++slot.outcome.ticks;
+
+                    if(world.state == World::State::InProgress)
+                        ++localRunning;
+                }
+
+                running += localRunning;
+            });
+
+        return running;
+    }
+
+    // Esegue al massimo `mMaxTicks` tick, fermandosi prima se tutti i
+    // mondi sono terminati.
+    void run(std::size_t mMaxTicks)
+    {
+        for(std::size_t t{0}; t < mMaxTicks; ++t)
+            if(step() == 0) break;
+    }
+
+    std::size_t getWorldCount() const noexcept { return slots.size(); }
+    const Outcome& getOutcome(std::size_t mIdx) const noexcept
+    {
+        return slots[mIdx]->outcome;
+    }
+    const World& getWorld(std::size_t mIdx) const noexcept
+    {
+        return slots[mIdx]->world;
+    }
+
+    template <typename TFunc>
+    void parallelForEachWorld(TFunc&& mFunc) const
+    {
+        threadPool.parallelFor(slots.size(), getGrain(),
+            [this, &mFunc](std::size_t mBegin, std::size_t mEnd)
+            {
+                for(auto i(mBegin); i < mEnd; ++i)
+                    mFunc(i, static_cast<const World&>(slots[i]->world));
+            });
+    }
+};
+
+// Implementazione dell'API C dichiarata in `arkanoid.h`. Le
+// eccezioni non attraversano l'API: vengono convertite in `nullptr` o
+// in un valore negativo.
+struct ArkanoidEnv
+{
+    ThreadPool threadPool;
+    BatchRunner runner{threadPool};
+    LevelGenParams params;
+
+    // Buffer riutilizzato ad ogni `step` per convertire le azioni.
+    std::vector<Paddle::Input> inputs;
+};
+
+extern "C" ArkanoidEnv* arkanoid_create(std::size_t mCount, int mPattern,
+    std::uint32_t mWidth, std::uint32_t mHeight, float mDensity)
+{
+    // La densità è una probabilità: il confronto rifiuta anche NaN.
+    if(mPattern < 0 ||
+        mPattern > static_cast<int>(LevelGenParams::Pattern::Random) ||
+        mWidth == 0 || mHeight == 0 ||
+        !(mDensity >= 0.f && mDensity <= 1.f))
+        return nullptr;
+
+    try
+    {
+        auto env(std::make_unique<ArkanoidEnv>());
+        env->params.pattern = static_cast<LevelGenParams::Pattern>(mPattern);
+        env->params.width = mWidth;
+        env->params.height = mHeight;
+        env->params.density = mDensity;
+        env->inputs.resize(mCount);
+
+        env->runner.reset(mCount, env->params);
+        return env.release();
+    }
+    catch(...)
+    {
+        return nullptr;
+    }
+}
+
+extern "C" void arkanoid_destroy(ArkanoidEnv* mEnv) { delete mEnv; }
+
+extern "C" std::size_t arkanoid_env_count(const ArkanoidEnv* mEnv)
+{
+    return mEnv != nullptr ? mEnv->runner.getWorldCount() : 0;
+}
+
+extern "C" std::size_t arkanoid_grid_size(const ArkanoidEnv* mEnv)
+{
+    if(mEnv == nullptr) return 0;
+    return std::size_t(mEnv->params.width) * mEnv->params.height;
+}
+
+extern "C" int arkanoid_reset(ArkanoidEnv* mEnv, const std::uint64_t* mSeeds)
+{
+    if(mEnv == nullptr || mSeeds == nullptr) return -1;
+
+    try
+    {
+        mEnv->runner.reset(mSeeds, mEnv->params);
+        return 0;
+    }
+    catch(...)
+    {
+        return -1;
+    }
+}
+
+// Avanza tutte le partite in corso di un tick, e restituisce quante
+// sono ancora in corso.
+extern "C" long long arkanoid_step(
+    ArkanoidEnv* mEnv, const std::uint8_t* mActions)
+{
+    if(mEnv == nullptr || mActions == nullptr) return -1;
+
+    auto& inputs(mEnv->inputs);
+    for(std::size_t i{0}; i < inputs.size(); ++i)
+    {
+        inputs[i].left = mActions[i] == ARKANOID_LEFT;
+        inputs[i].right = mActions[i] == ARKANOID_RIGHT;
+    }
+
+    try
+    {
+        return static_cast<long long>(mEnv->runner.step(inputs.data()));
+    }
+    catch(...)
+    {
+        return -1;
+    }
+}
+
+extern "C" int arkanoid_observe(
+    const ArkanoidEnv* mEnv, float* mStates, std::uint8_t* mGrids)
+{
+    if(mEnv == nullptr || mStates == nullptr) return -1;
+
+    auto gridSize(arkanoid_grid_size(mEnv));
+
+    try
+    {
+        mEnv->runner.parallelForEachWorld(
+            [=](std::size_t mIdx, const World& mWorld)
+            {
+                auto state(mStates + mIdx * ARKANOID_STATE_SIZE);
+                std::fill(state, state + ARKANOID_STATE_SIZE, 0.f);
+
+                auto& balls(mWorld.manager.getAll<Ball>());
+                auto& paddles(mWorld.manager.getAll<Paddle>());
+
+                state[ARKANOID_BALL_COUNT] = balls.size();
+                if(!balls.empty())
+                {
+                    auto& b(*static_cast<const Ball*>(balls.front()));
+                    state[ARKANOID_BALL_X] = static_cast<float>(b.x());
+                    state[ARKANOID_BALL_Y] = static_cast<float>(b.y());
+                    state[ARKANOID_BALL_VX] =
+                        static_cast<float>(b.velocity.x);
+                    state[ARKANOID_BALL_VY] =
+                        static_cast<float>(b.velocity.y);
+                }
+
+                if(!paddles.empty())
+                {
+                    auto& p(*static_cast<const Paddle*>(paddles.front()));
+                    state[ARKANOID_PADDLE_X] = static_cast<float>(p.x());
+                    state[ARKANOID_PADDLE_Y] = static_cast<float>(p.y());
+                }
+
+                state[ARKANOID_LIVES] = mWorld.remainingLives;
+                state[ARKANOID_SCORE] = mWorld.score;
+                state[ARKANOID_STATUS] = static_cast<int>(mWorld.state);
+
+                if(mGrids == nullptr) return;
+
+                auto grid(mGrids + mIdx * gridSize);
+                const auto& bricks(mWorld.bricks);
+                auto cells(std::min<std::size_t>(gridSize,
+                    std::size_t(bricks.getWidth()) * bricks.getHeight()));
+
+                std::fill(grid, grid + gridSize, 0);
+                for(std::uint32_t c{0}; c < cells; ++c)
+                    grid[c] = static_cast<std::uint8_t>(bricks.getHits(c));
+            });
+
+        return 0;
+    }
+    catch(...)
+    {
+        return -1;
+    }
+}
+
+// Simula `mWorldCount` partite per al massimo `mTicks` tick, e
+// riporta un riassunto dei risultati.
+int runBatch(
+    std::size_t mWorldCount, std::size_t mTicks, const LevelGenParams& mParams)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    ThreadPool threadPool;
+    BatchRunner runner{threadPool};
+
+    runner.reset(mWorldCount, mParams);
+
+    auto start(Clock::now());
+    runner.run(mTicks);
+    auto elapsed(Clock::now() - start);
+
+    std::size_t victories{0}, gameOvers{0}, ticks{0};
+    long long bricks{0};
+
+    for(std::size_t i{0}; i < runner.getWorldCount(); ++i)
+    {
+        const auto& o(runner.getOutcome(i));
+        if(o.state == World::State::Victory) ++victories;
+        if(o.state == World::State::GameOver) ++gameOvers;
+        ticks += o.ticks;
+        bricks += o.bricksDestroyed;
+    }
+
+    using Seconds = std::chrono::duration<double>;
+    auto seconds(Seconds{elapsed}.count());
+
+    std::cout << "Worlds: " << mWorldCount << " ("
+              << threadPool.getThreadCount() + 1 << " threads)\n"
+              << "Victories: " << victories << ", game overs: " << gameOvers
+              << ", unfinished: " << mWorldCount - victories - gameOvers
+              << "\n"
+              << "Ticks: " << ticks << ", bricks destroyed: " << bricks
+              << "\n"
+              << "Time: " << seconds << " s, "
+              << static_cast<double>(ticks) / std::max(seconds, 1e-9)
+              << " ticks/s\n";
+
+    return 0;
+}
+
+// Partita "versus" senza finestra, in cui il paddle locale è
+// guidato dal bot: due processi avviati con porte scambiate devono
+// stampare lo stesso checksum finale.
+int runVersusHeadless(int mPlayer, std::uint16_t mLocalPort,
+    std::uint16_t mRemotePort, std::chrono::milliseconds mLatency,
+    std::uint32_t mTicks)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto level(buildDefaultLevel(true));
+    LevelView view;
+    LevelView::fromMemory(level.data(), level.size(), view);
+
+    ThreadPool threadPool;
+    World world{threadPool};
+    world.setLevel(view);
+    world.restart();
+    world.state = World::State::InProgress;
+
+    RollbackSession session{world, mPlayer, mLatency};
+    if(!session.connect(mLocalPort, mRemotePort))
+    {
+        std::cerr << "Cannot open UDP port " << mLocalPort << "\n";
+        return 1;
+    }
+
+    BotController bot;
+    auto botInput([&]
+        {
+            for(auto e : world.manager.getAll<Paddle>())
+            {
+                auto& p(*static_cast<const Paddle*>(e));
+                if(p.player == mPlayer)
+                    return bot.getInput(world.manager, world.bricks, p);
+            }
+            return Paddle::Input{};
+        });
+
+    // Un tick ogni 1/60 di secondo, come nel gioco.
+    const std::chrono::microseconds tick{16667};
+    auto next(Clock::now());
+
+    while(session.getFrame() < mTicks)
+    {
+        session.advance(botInput());
+
+        next += tick;
+        std::this_thread::sleep_until(next);
+    }
+
+    // Completiamo lo scambio degli input, e continuiamo a inviare
+    // per un po' perché anche l'altro processo possa completarlo.
+    auto deadline(Clock::now() + std::chrono::seconds{10});
+    while(!session.isSettled() && Clock::now() < deadline)
+    {
+        session.sync();
+        std::this_thread::sleep_for(tick);
+    }
+
+    auto settled(session.isSettled());
+    auto grace(Clock::now() + std::chrono::seconds{1});
+    while(Clock::now() < grace)
+    {
+        session.sync();
+        std::this_thread::sleep_for(tick);
+    }
+
+    session.printStats(std::cout);
+    std::cout << "Scores: " << world.playerScores[0] << " - "
+              << world.playerScores[1] << "\n"
+              << "Checksum: " << std::hex << getStateChecksum(world)
+              << std::dec << (settled ? "" : " (not settled)") << "\n";
+
+    return settled ? 0 : 1;
+}
+
+// Server senza finestra sul livello di default. Con `mTicks` pari a
+// zero, non termina mai.
+int runServer(std::uint16_t mPort, std::uint32_t mTicks)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto level(buildDefaultLevel());
+    LevelView view;
+    LevelView::fromMemory(level.data(), level.size(), view);
+
+    ThreadPool threadPool;
+    World world{threadPool};
+    world.setLevel(view);
+    world.restart();
+
+    SnapshotServer server{world};
+    if(!server.listen(mPort))
+    {
+        std::cerr << "Cannot open UDP port " << mPort << "\n";
+        return 1;
+    }
+
+    const std::chrono::microseconds tick{16667};
+    auto start(Clock::now()), next(start), lastReport(start);
+
+    while(mTicks == 0 || server.getTick() < mTicks)
+    {
+        server.update();
+
+        next += tick;
+        std::this_thread::sleep_until(next);
+
+        // Con un server senza fine, le statistiche vengono stampate
+        // ogni dieci secondi.
+        if(mTicks == 0 && next - lastReport > std::chrono::seconds{10})
+        {
+            lastReport = next;
+            server.printStats(std::cout,
+                std::chrono::duration<double>{next - start}.count());
+        }
+    }
+
+    server.printStats(
+        std::cout, std::chrono::duration<double>{next - start}.count());
+    std::cout << "Tick " << server.getTick() << " bricks: " << std::hex
+              << server.getBrickChecksum() << std::dec << "\n";
+
+    return 0;
+}
+
+// Client senza finestra: riceve `mTicks` snapshot e stampa il
+// checksum dei mattoncini all'ultimo tick ricevuto.
+int runClientHeadless(std::uint16_t mLocalPort, std::uint16_t mServerPort,
+    std::uint32_t mTicks)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto level(buildDefaultLevel());
+    LevelView view;
+    LevelView::fromMemory(level.data(), level.size(), view);
+
+    ThreadPool threadPool;
+    World world{threadPool};
+    world.setLevel(view);
+    world.restart();
+
+    SnapshotClient client;
+    if(!client.connect(mLocalPort, mServerPort))
+    {
+        std::cerr << "Cannot open UDP port " << mLocalPort << "\n";
+        return 1;
+    }
+
+    const std::chrono::microseconds tick{16667};
+    auto start(Clock::now()), next(start);
+    auto deadline(start + std::chrono::seconds{10} + mTicks * tick);
+
+    while(client.getLatestTick() == net::noTick ||
+          client.getLatestTick() < mTicks)
+    {
+        if(Clock::now() > deadline)
+        {
+            std::cerr << "Timed out waiting for the server\n";
+            return 1;
+        }
+
+        client.update(false, {});
+        client.present(world);
+
+        next += tick;
+        std::this_thread::sleep_until(next);
+    }
+
+    client.printStats(std::cout,
+        std::chrono::duration<double>{Clock::now() - start}.count());
+    std::cout << "Tick " << client.getLatestTick() << " bricks: " << std::hex
+              << client.getBrickChecksum() << std::dec << "\n";
+
+    return 0;
+}
+
+// Se `mArgs` contiene l'opzione `mName`, la rimuove e restituisce
+// `true`.
+bool takeFlag(std::vector<std::string>& mArgs, const char* mName)
+{
+    auto itr(std::find(std::begin(mArgs), std::end(mArgs), mName));
+    if(itr == std::end(mArgs)) return false;
+
+    mArgs.erase(itr);
+    return true;
+}
+
+// Se `mArgs` contiene l'opzione `mName` seguita da un valore, la
+// rimuove e scrive il valore in `mValue`.
+bool takeOption(std::vector<std::string>& mArgs, const char* mName,
+    std::string& mValue)
+{
+    auto itr(std::find(std::begin(mArgs), std::end(mArgs), mName));
+    if(itr == std::end(mArgs) || itr + 1 == std::end(mArgs)) return false;
+
+    mValue = *(itr + 1);
+    mArgs.erase(itr, itr + 2);
+    return true;
+}
+
+// Legge i parametri di un livello procedurale, `<seed> <pattern>
+// <larghezza> <altezza> [densità]`, a partire da `mArgs[mFirst]`.
+bool parseLevelGenParams(const std::vector<std::string>& mArgs,
+    std::size_t mFirst, LevelGenParams& mParams)
+{
+    if(mArgs.size() < mFirst + 4 ||
+        !parsePattern(mArgs[mFirst + 1], mParams.pattern))
+    {
+        std::cerr << "Level arguments: <seed> "
+                     "<solid|checker|stripes|diamond|random> "
+                     "<width> <height> [density]\n";
+        return false;
+    }
+
+    mParams.seed = std::strtoull(mArgs[mFirst].c_str(), nullptr, 10);
+    mParams.width = std::strtoul(mArgs[mFirst + 2].c_str(), nullptr, 10);
+    mParams.height = std::strtoul(mArgs[mFirst + 3].c_str(), nullptr, 10);
+    if(mArgs.size() > mFirst + 4)
+        mParams.density = std::strtof(mArgs[mFirst + 4].c_str(), nullptr);
+
+    if(mParams.width == 0 || mParams.height == 0)
+    {
+        std::cerr << "Level width and height must be positive\n";
+        return false;
+    }
+
+    return true;
+}
+
+// Le modalità senza finestra ricevono tutti gli argomenti, a partire
+// dal nome della modalità, e restituiscono il codice di uscita.
+using Command = int (*)(const std::vector<std::string>&);
+
+// `--convert-level <livello.txt> <livello.lvl>` converte un livello
+// testuale.
+int runConvertCommand(const std::vector<std::string>& mArgs)
+{
+    if(mArgs.size() != 3)
+    {
+        std::cerr << "Usage: --convert-level <level.txt> <level.lvl>\n";
+        return 1;
+    }
+
+    return convertLevel(mArgs[1], mArgs[2]) ? 0 : 1;
+}
+
+// `--stress <tick> <livello procedurale>` simula un livello
+// procedurale senza finestra.
+int runStressCommand(const std::vector<std::string>& mArgs)
+{
+    LevelGenParams params;
+    if(mArgs.size() < 2 || !parseLevelGenParams(mArgs, 2, params)) return 1;
+
+    auto blob(generateLevel(params));
+    LevelView view;
+    LevelView::fromMemory(blob.data(), blob.size(), view);
+
+    return runStressTest(view, std::strtoull(mArgs[1].c_str(), nullptr, 10));
+}
+
+// `--batch <mondi> <tick> <livello procedurale>` simula molte partite
+// in parallelo.
+int runBatchCommand(const std::vector<std::string>& mArgs)
+{
+    LevelGenParams params;
+    if(mArgs.size() < 3 || !parseLevelGenParams(mArgs, 3, params)) return 1;
+
+    return runBatch(std::strtoull(mArgs[1].c_str(), nullptr, 10),
+        std::strtoull(mArgs[2].c_str(), nullptr, 10), params);
+}
+
+// Parametri di una partita "versus" contro un altro processo sulla
+// stessa macchina.
+struct VersusParams
+{
+    int player{0};
+    std::uint16_t localPort{0}, remotePort{0};
+    std::chrono::milliseconds latency{0};
+};
+
+// Legge i parametri di una partita "versus", `<giocatore> <porta
+// locale> <porta remota> [latenza ms]`, a partire da `mArgs[mFirst]`.
+bool parseVersusParams(const std::vector<std::string>& mArgs,
+    std::size_t mFirst, VersusParams& mParams)
+{
+    if(mArgs.size() < mFirst + 3)
+    {
+        std::cerr << "Versus arguments: <player> <local port> "
+                     "<remote port> [latency ms]\n";
+        return false;
+    }
+
+    mParams.player = std::atoi(mArgs[mFirst].c_str()) != 0 ? 1 : 0;
+    mParams.localPort = std::atoi(mArgs[mFirst + 1].c_str());
+    mParams.remotePort = std::atoi(mArgs[mFirst + 2].c_str());
+    if(mArgs.size() > mFirst + 3)
+        mParams.latency =
+            std::chrono::milliseconds{std::atoi(mArgs[mFirst + 3].c_str())};
+
+    return true;
+}
+
+// `--versus-headless <giocatore> <porta locale> <porta remota>
+// <latenza ms> <tick>` fa giocare il bot senza finestra.
+int runVersusCommand(const std::vector<std::string>& mArgs)
+{
+    VersusParams params;
+    if(mArgs.size() != 6 || !parseVersusParams(mArgs, 1, params))
+    {
+        std::cerr << "Usage: --versus-headless <player> <local port> "
+                     "<remote port> <latency ms> <ticks>\n";
+        return 1;
+    }
+
+    return runVersusHeadless(params.player, params.localPort,
+        params.remotePort, params.latency,
+        std::strtoul(mArgs[5].c_str(), nullptr, 10));
+}
+
+// `--server <porta> [tick]` avvia un server senza finestra.
+int runServerCommand(const std::vector<std::string>& mArgs)
+{
+    if(mArgs.size() < 2 || mArgs.size() > 3)
+    {
+        std::cerr << "Usage: --server <port> [ticks]\n";
+        return 1;
+    }
+
+    return runServer(std::atoi(mArgs[1].c_str()),
+        mArgs.size() == 3 ? std::strtoul(mArgs[2].c_str(), nullptr, 10) : 0);
+}
+
+// `--client-headless <porta locale> <porta server> <tick>` riceve un
+// numero di tick senza finestra.
+int runClientCommand(const std::vector<std::string>& mArgs)
+{
+    if(mArgs.size() != 4)
+    {
+        std::cerr << "Usage: --client-headless <local port> "
+                     "<server port> <ticks>\n";
+        return 1;
+    }
+
+    return runClientHeadless(std::atoi(mArgs[1].c_str()),
+        std::atoi(mArgs[2].c_str()),
+        std::strtoul(mArgs[3].c_str(), nullptr, 10));
+}
+
+// Avvia il gioco con una finestra: `<livello.lvl>` gioca il livello
+// specificato, `--generate <livello procedurale>` un livello
+// procedurale, e `--versus <partita versus>` gioca contro un altro
+// processo sulla stessa macchina. `--client <porta locale> <porta
+// server> [play]` mostra la partita di un server, e con `play` la
+// controlla dalla tastiera. `mTracePath` è il file delle tracce
+// registrate con `T`.
+int runGame(std::vector<std::string> mArgs, const std::string& mTracePath)
+{
+    Game game;
+    if(!mTracePath.empty()) game.setTracePath(mTracePath);
+
+    // `--hitch-budget <ms>` cambia la durata oltre la quale un frame
+    // viene considerato un "hitch".
+    std::string budget;
+    if(takeOption(mArgs, "--hitch-budget", budget))
+    {
+        std::chrono::microseconds us{static_cast<std::int64_t>(
+            std::strtod(budget.c_str(), nullptr) * 1000.0)};
+        if(us.count() > 0) game.setHitchBudget(us);
+    }
+
+    // `--bot` affida il paddle al bot fin dall'avvio.
+    game.setBotEnabled(takeFlag(mArgs, "--bot"));
+
+    // `--load-state <file>` riprende una partita salvata con `F5`.
+    std::string statePath;
+    takeOption(mArgs, "--load-state", statePath);
+
+    VersusParams versus;
+    auto isVersus(!mArgs.empty() && mArgs[0] == "--versus");
+    if(isVersus && !parseVersusParams(mArgs, 1, versus)) return 1;
+
+    auto isClient(!mArgs.empty() && mArgs[0] == "--client");
+    if(isClient && mArgs.size() < 3)
+    {
+        std::cerr << "Usage: --client <local port> <server port> [play]\n";
+        return 1;
+    }
+
+    if(!mArgs.empty() && mArgs[0] == "--generate")
+    {
+        LevelGenParams params;
+        if(!parseLevelGenParams(mArgs, 1, params)) return 1;
+        game.generateLevel(params);
+    }
+    else if(mArgs.size() == 1 && !game.loadLevel(mArgs[0]))
+        return 1;
+
+    game.restart();
+    if(!statePath.empty() && !game.loadState(statePath)) return 1;
+    if(isVersus && !game.startVersus(versus.player, versus.localPort,
+                       versus.remotePort, versus.latency))
+        return 1;
+    if(isClient && !game.startClient(std::atoi(mArgs[1].c_str()),
+                       std::atoi(mArgs[2].c_str()),
+                       mArgs.size() >= 4 && mArgs[3] == "play"))
+        return 1;
+
+    game.run();
+    return 0;
+}
+
+// Compilando con `-DARKANOID_LIBRARY` si esclude `main`: si ottiene
+// solo l'API C, ad esempio come libreria condivisa (`-shared -fPIC`).
+// Anche `tests.cpp` include questo file in questo modo.
+#ifndef ARKANOID_LIBRARY
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+
+    // `--trace <file.json>` registra una traccia dall'avvio fino
+    // all'uscita.
+    std::string tracePath;
+    if(takeOption(args, "--trace", tracePath) &&
+        !Tracer::get().start(tracePath))
+        return 1;
+
+    // `--perf` misura i contatori hardware di ogni fase, se il
+    // sistema lo permette.
+    if(takeFlag(args, "--perf") && !PerfCounters::enable())
+        std::cerr << "Hardware performance counters unavailable\n";
+
+    const std::pair<const char*, Command> commands[]{
+        {"--convert-level", runConvertCommand},
+        {"--stress", runStressCommand}, {"--batch", runBatchCommand},
+        {"--versus-headless", runVersusCommand},
+        {"--server", runServerCommand},
+        {"--client-headless", runClientCommand}};
+
+    for(const auto& c : commands)
+        if(!args.empty() && args[0] == c.first)
+        {
+            auto result(c.second(args));
+            Tracer::get().stop();
+            return result;
+        }
+
+    auto result(runGame(args, tracePath));
+    Tracer::get().stop();
+    return result;
+}
+#endif
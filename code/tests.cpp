@@ -0,0 +1,401 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: MIT License | http://opensource.org/licenses/MIT
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+// Controlli automatici sulle parti del gioco che non si possono
+// verificare giocando. Il file include `p18.cpp` senza il suo
+// `main`, e sostituisce `operator new` per contare le allocazioni:
+// il gioco vero e proprio usa l'allocatore di sistema.
+//
+//     ./compile.sh tests.cpp
+//
+// Il programma termina con un codice diverso da zero se qualche
+// controllo fallisce.
+
+#define ARKANOID_LIBRARY
+#include "p18.cpp"
+
+// Numero di allocazioni dall'avvio del programma.
+std::atomic<std::uint64_t> allocationCount{0};
+
+void* operator new(std::size_t mSize)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if(auto ptr = std::malloc(mSize != 0 ? mSize : 1)) return ptr;
+    throw std::bad_alloc{};
+}
+
+// Le funzioni non vengono espanse inline, altrimenti GCC segnala
+// `std::free` su puntatori ottenuti da `operator new`.
+__attribute__((noinline)) void operator delete(void* mPtr) noexcept
+{
+    std::free(mPtr);
+}
+
+__attribute__((noinline)) void operator delete(
+    void* mPtr, std::size_t) noexcept
+{
+    std::free(mPtr);
+}
+
+// Controlla che `LevelView::fromMemory` accetti un livello valido e
+// rifiuti intestazioni corrotte. Restituisce il numero di errori.
+int checkLevelLoader(std::ostream& mStream)
+{
+    const auto valid(buildDefaultLevel());
+
+    int failures{0};
+    auto expect([&](const char* mName, bool mOk)
+        {
+            mStream << (mOk ? "ok    " : "FAIL  ") << "level loader: " << mName
+                    << "\n";
+            if(!mOk) ++failures;
+        });
+
+    // Modifica l'intestazione di una copia del livello valido, che
+    // deve essere rifiutata.
+    auto reject([&](const char* mName, auto mMutate)
+        {
+            auto blob(valid);
+            LevelHeader h;
+            std::memcpy(&h, blob.data(), sizeof(h));
+            mMutate(h);
+            std::memcpy(blob.data(), &h, sizeof(h));
+
+            LevelView view;
+            expect(mName,
+                !LevelView::fromMemory(blob.data(), blob.size(), view));
+        });
+
+    LevelView view;
+    expect("valid level",
+        LevelView::fromMemory(valid.data(), valid.size(), view));
+    expect("truncated level",
+        !LevelView::fromMemory(valid.data(), valid.size() - 1, view));
+
+    const auto nan(std::numeric_limits<float>::quiet_NaN());
+    const auto inf(std::numeric_limits<float>::infinity());
+
+    reject("bad magic", [](auto& mH) { mH.magic[0] = 'X'; });
+    reject("bad version", [](auto& mH) { ++mH.version; });
+    reject("zero width", [](auto& mH) { mH.width = 0; });
+    reject("zero height", [](auto& mH) { mH.height = 0; });
+    reject("huge grid", [](auto& mH) { mH.width = mH.height = 1u << 16; });
+    reject("zero cell width", [](auto& mH) { mH.cellWidth = 0.f; });
+    reject("negative cell height", [](auto& mH) { mH.cellHeight = -4.f; });
+    reject("negative spacing", [](auto& mH) { mH.spacing = -1.f; });
+    reject("NaN cell width", [nan](auto& mH) { mH.cellWidth = nan; });
+    reject("NaN spacing", [nan](auto& mH) { mH.spacing = nan; });
+    reject("NaN origin", [nan](auto& mH) { mH.originX = nan; });
+    reject("infinite cell height", [inf](auto& mH) { mH.cellHeight = inf; });
+    reject("infinite spacing", [inf](auto& mH) { mH.spacing = inf; });
+
+    return failures;
+}
+
+// Converte livelli testuali validi e non validi. Gli errori devono
+// indicare la riga che li causa.
+int checkLevelConverter(std::ostream& mStream)
+{
+    const std::string dir{P_tmpdir};
+    const auto textPath(dir + "/arkanoid-test-level.txt");
+    const auto binPath(dir + "/arkanoid-test-level.lvl");
+
+    int failures{0};
+    auto expect([&](const char* mName, bool mOk)
+        {
+            mStream << (mOk ? "ok    " : "FAIL  ") << "level converter: "
+                    << mName << "\n";
+            if(!mOk) ++failures;
+        });
+
+    // Converte `mText`, raccogliendo i messaggi di errore.
+    std::string errors;
+    auto convert([&](const std::string& mText)
+        {
+            std::ofstream{textPath} << mText;
+
+            std::ostringstream captured;
+            auto old(std::cerr.rdbuf(captured.rdbuf()));
+            auto result(convertLevel(textPath, binPath));
+            std::cerr.rdbuf(old);
+
+            errors = captured.str();
+            return result;
+        });
+
+    const std::string header{"grid 3 2\ncell 60 20 3\norigin 100 50\n"
+                             "spawn ball 400 300\n"};
+
+    expect("valid level", convert(header + "rows\n1.2\n.3.\n"));
+
+    std::ifstream in{binPath, std::ios::binary};
+    std::vector<char> blob{std::istreambuf_iterator<char>{in},
+        std::istreambuf_iterator<char>{}};
+    LevelView view;
+    expect("converted level loads",
+        LevelView::fromMemory(blob.data(), blob.size(), view) &&
+            view.getHeader().width == 3 && view.getHeader().height == 2 &&
+            view.getHits(0, 0) == 1 && view.getHits(1, 1) == 3);
+
+    expect("rows before grid",
+        !convert("rows\n1.2\n.3.\ngrid 3 2\n") &&
+            errors.find(":1:") != std::string::npos);
+    expect("short row", !convert(header + "rows\n1.2\n.3\n") &&
+                            errors.find(":7:") != std::string::npos);
+    expect("long row", !convert(header + "rows\n1.2\n.3..\n"));
+    expect("missing row", !convert(header + "rows\n1.2\n"));
+    expect("zero grid", !convert("grid 0 2\nrows\n"));
+    expect("grid after rows",
+        !convert(header + "rows\n1.2\n.3.\ngrid 2 2\n"));
+    expect("duplicate rows",
+        !convert(header + "rows\n1.2\n.3.\nrows\n1.2\n.3.\n"));
+    expect("negative spacing", !convert("cell 60 20 -1\n"));
+    expect("invalid cell", !convert(header + "rows\n1.4\n.3.\n"));
+
+    std::remove(textPath.c_str());
+    std::remove(binPath.c_str());
+    return failures;
+}
+
+// I valori fuori dall'intervallo di `Fixed` saturano, e la divisione
+// per zero ha un risultato definito.
+int checkFixed(std::ostream& mStream)
+{
+    int failures{0};
+    auto expect([&](const char* mName, bool mOk)
+        {
+            mStream << (mOk ? "ok    " : "FAIL  ") << "fixed: " << mName
+                    << "\n";
+            if(!mOk) ++failures;
+        });
+
+    constexpr auto max(std::numeric_limits<std::int32_t>::max());
+    constexpr auto min(std::numeric_limits<std::int32_t>::min());
+
+    expect("rounding", Fixed(1.5f).getRaw() == 3 * Fixed::one / 2 &&
+                           Fixed(-0.25f).getRaw() == -Fixed::one / 4);
+    expect("large float", Fixed(1e9f).getRaw() == max &&
+                              Fixed(-1e9f).getRaw() == min);
+    expect("NaN", Fixed(std::numeric_limits<float>::quiet_NaN()).getRaw() ==
+                      0);
+    expect("large integer",
+        Fixed(100000).getRaw() == max && Fixed(-100000).getRaw() == min);
+    expect("overflow", (Fixed(30000) * Fixed(30000)).getRaw() == max &&
+                           (Fixed(30000) + Fixed(30000)).getRaw() == max);
+    expect("division by zero", (Fixed(3) / Fixed(0)).getRaw() == max &&
+                                   (Fixed(-3) / Fixed(0)).getRaw() == min &&
+                                   (Fixed(0) / Fixed(0)).getRaw() == 0);
+
+    return failures;
+}
+
+// Gli argomenti non validi dell'API C vengono rifiutati senza
+// toccare la memoria.
+int checkBatchArguments(std::ostream& mStream)
+{
+    int failures{0};
+    auto expect([&](const char* mName, bool mOk)
+        {
+            mStream << (mOk ? "ok    " : "FAIL  ") << "batch arguments: "
+                    << mName << "\n";
+            if(!mOk) ++failures;
+        });
+
+    auto create([](std::uint32_t mWidth, float mDensity)
+        {
+            return arkanoid_create(1, 0, mWidth, 4, mDensity);
+        });
+
+    expect("zero width", create(0, 1.f) == nullptr);
+    expect("negative density", create(8, -0.1f) == nullptr);
+    expect("density above one", create(8, 1.5f) == nullptr);
+    expect("NaN density",
+        create(8, std::numeric_limits<float>::quiet_NaN()) == nullptr);
+
+    std::uint64_t seed{0};
+    std::uint8_t action{ARKANOID_NONE};
+    float state[ARKANOID_STATE_SIZE];
+
+    expect("null environment",
+        arkanoid_env_count(nullptr) == 0 &&
+            arkanoid_grid_size(nullptr) == 0 &&
+            arkanoid_reset(nullptr, &seed) < 0 &&
+            arkanoid_step(nullptr, &action) < 0 &&
+            arkanoid_observe(nullptr, state, nullptr) < 0);
+
+    auto env(create(8, 1.f));
+    expect("valid environment", env != nullptr);
+    if(env != nullptr)
+    {
+        expect("null buffers", arkanoid_reset(env, nullptr) < 0 &&
+                                   arkanoid_step(env, nullptr) < 0 &&
+                                   arkanoid_observe(env, nullptr, nullptr) < 0);
+        arkanoid_destroy(env);
+    }
+
+    return failures;
+}
+
+// Controlla che `arkanoid_step` e `arkanoid_observe` non allochino
+// memoria dopo `arkanoid_reset`.
+int checkBatchAllocations(std::ostream& mStream)
+{
+    constexpr std::size_t envCount{32};
+    constexpr int ticks{600};
+
+    auto env(arkanoid_create(envCount,
+        static_cast<int>(LevelGenParams::Pattern::Random), 20, 8, 0.8f));
+    if(env == nullptr)
+    {
+        mStream << "FAIL  batch: cannot create environment\n";
+        return 1;
+    }
+
+    std::vector<std::uint64_t> seeds(envCount);
+    for(std::size_t i{0}; i < envCount; ++i) seeds[i] = i;
+
+    std::vector<float> states(envCount * ARKANOID_STATE_SIZE);
+    std::vector<std::uint8_t> grids(envCount * arkanoid_grid_size(env));
+    std::vector<std::uint8_t> actions(envCount);
+
+    arkanoid_reset(env, seeds.data());
+    auto allocations(allocationCount.load());
+
+    for(int t{0}; t < ticks; ++t)
+    {
+        for(std::size_t i{0}; i < envCount; ++i)
+            actions[i] = static_cast<std::uint8_t>((t / 30 + i) % 3);
+
+        arkanoid_step(env, actions.data());
+        arkanoid_observe(env, states.data(), grids.data());
+    }
+
+    allocations = allocationCount.load() - allocations;
+    arkanoid_destroy(env);
+
+    auto ok(allocations == 0);
+    mStream << (ok ? "ok    " : "FAIL  ") << "batch: " << allocations
+            << " allocations in " << ticks << " steps of " << envCount
+            << " worlds\n";
+    return ok ? 0 : 1;
+}
+
+// Gioca una partita "versus" tra due sessioni nello stesso processo,
+// collegate su localhost, e controlla che dopo il primo tick, che
+// riserva la memoria dei savestate, i rollback avvengano senza
+// allocare memoria.
+int checkRollbackAllocations(std::ostream& mStream)
+{
+    constexpr std::uint16_t portA{47311}, portB{47312};
+    constexpr std::uint32_t firstTicks{1}, ticks{900};
+
+    // Un livello "versus" con molti più mattoncini di quello di
+    // default: la dimensione dei savestate dipende dal livello.
+    LevelGenParams params;
+    params.width = 160;
+    params.height = 60;
+    auto generated(generateLevel(params));
+
+    LevelHeader header;
+    std::memcpy(&header, generated.data(), sizeof(header));
+    auto level(buildLevel(header,
+        {{LevelSpawn::Ball, wndWidth / 3.f, wndHeight * 0.75f},
+            {LevelSpawn::Ball, wndWidth * 2.f / 3.f, wndHeight * 0.75f},
+            {LevelSpawn::Paddle, wndWidth / 4.f, wndHeight - 50.f},
+            {LevelSpawn::Paddle, wndWidth * 3.f / 4.f, wndHeight - 50.f}},
+        std::vector<std::uint8_t>(
+            std::size_t(header.width) * header.height, 3)));
+
+    LevelView view;
+    LevelView::fromMemory(level.data(), level.size(), view);
+
+    ThreadPool threadPool;
+    World worldA{threadPool}, worldB{threadPool};
+
+    // Le sessioni vengono create prima di caricare il livello: la
+    // memoria dei savestate deve comunque bastare.
+    RollbackSession sessionA{worldA, 0}, sessionB{worldB, 1};
+    if(!sessionA.connect(portA, portB) || !sessionB.connect(portB, portA))
+    {
+        mStream << "FAIL  rollback: cannot open UDP ports " << portA
+                << " and " << portB << "\n";
+        return 1;
+    }
+
+    for(auto w : {&worldA, &worldB})
+    {
+        w->setLevel(view);
+        w->restart();
+        w->state = World::State::InProgress;
+    }
+
+    BotController bot;
+    auto botInput([&bot](const World& mWorld, int mPlayer)
+        {
+            for(auto e : mWorld.manager.getAll<Paddle>())
+            {
+                auto& p(*static_cast<const Paddle*>(e));
+                if(p.player == mPlayer)
+                    return bot.getInput(mWorld.manager, mWorld.bricks, p);
+            }
+            return Paddle::Input{};
+        });
+
+    auto play([&](std::uint32_t mUntil)
+        {
+            while(sessionA.getFrame() < mUntil || sessionB.getFrame() < mUntil)
+            {
+                sessionA.advance(botInput(worldA, 0));
+                sessionB.advance(botInput(worldB, 1));
+            }
+        });
+
+    play(firstTicks);
+    auto rollbacks(sessionA.getStats().rollbacks +
+                   sessionB.getStats().rollbacks);
+    auto allocations(allocationCount.load());
+
+    play(firstTicks + ticks);
+    allocations = allocationCount.load() - allocations;
+    rollbacks = sessionA.getStats().rollbacks +
+                sessionB.getStats().rollbacks - rollbacks;
+
+    for(int i{0}; i < 1000 && !(sessionA.isSettled() && sessionB.isSettled());
+        ++i)
+    {
+        sessionA.sync();
+        sessionB.sync();
+    }
+
+    int failures{0};
+    auto expect([&](const char* mName, bool mOk)
+        {
+            mStream << (mOk ? "ok    " : "FAIL  ") << "rollback: " << mName
+                    << "\n";
+            if(!mOk) ++failures;
+        });
+
+    mStream << "      rollback: " << rollbacks << " rollbacks, "
+            << allocations << " allocations in " << ticks << " ticks\n";
+    expect("rollbacks happened", rollbacks > 0);
+    expect("no allocations", allocations == 0);
+    expect("sessions agree",
+        sessionA.isSettled() && sessionB.isSettled() &&
+            getStateChecksum(worldA) == getStateChecksum(worldB));
+
+    return failures;
+}
+
+int main()
+{
+    auto failures(checkLevelLoader(std::cout));
+    failures += checkLevelConverter(std::cout);
+    failures += checkFixed(std::cout);
+    failures += checkBatchArguments(std::cout);
+    failures += checkBatchAllocations(std::cout);
+    failures += checkRollbackAllocations(std::cout);
+
+    std::cout << (failures == 0 ? "All checks passed\n" : "Checks failed\n");
+    return failures == 0 ? 0 : 1;
+}